@@ -23,6 +23,7 @@ for which a new license (GPL+exception) is in place.
 #include "litemanwindow.h"
 #include "mylineedit.h"
 #include "sqlparser.h"
+#include "tablerebuilder.h"
 #include "utils.h"
 
 
@@ -101,9 +102,18 @@ void AlterTableDialog::resetClicked()
 		}
 	}
 
+	m_wasIndexed.resize(n);
+	for (i = 0; i < n; i++)
+	{
+		m_wasIndexed[i] = m_isIndexed[i];
+	}
+	m_indexCount = Database::getObjects("index", m_item->text(1))
+				   .values(m_item->text(0)).count();
+
 	m_hadRowid = parsed->m_hasRowid;
 	ui.withoutRowid->setChecked(!m_hadRowid);
 	delete parsed;
+	m_rowEstimate = Database::rowEstimate(m_item->text(0), m_item->text(1));
 	m_dropped = false;
 	checkChanges();
 }
@@ -115,6 +125,9 @@ AlterTableDialog::AlterTableDialog(LiteManWindow * parent,
 	m_item(item)
 {
 	m_alteringActive = isActive;
+	m_rowEstimate = -1;
+	m_indexCount = 0;
+	m_sqliteVersion = Database::sqliteVersion();
 	ui.removeButton->setEnabled(false);
 	ui.removeButton->hide();
 	setWindowTitle(tr("Alter Table"));
@@ -144,6 +157,9 @@ AlterTableDialog::AlterTableDialog(LiteManWindow * parent,
 	ui.tabWidget->removeTab(2);
 	ui.tabWidget->removeTab(1);
 	m_tabWidgetIndex = ui.tabWidget->currentIndex();
+	// shows the plan, see showPlan()
+	ui.adviceLabel->setAlignment(Qt::AlignLeft);
+	ui.adviceLabel->setWordWrap(true);
 	ui.adviceLabel->hide();
 
 	ui.columnTable->insertColumn(4);
@@ -263,52 +279,246 @@ bool AlterTableDialog::renameTable(QString oldTableName, QString newTableName)
 	return execSql(sql, message);
 }
 
-bool AlterTableDialog::checkColumn(int i, QString cname,
-								   QString ctype, QString cextra)
+QString AlterTableDialog::oldType(int j)
 {
-	int j = m_oldColumn[i];
-	if (j >= 0)
+	bool useNull = m_prefs->nullHighlight();
+	QString nullText = m_prefs->nullHighlightText();
+
+	QString ftype(m_fields[j].type);
+	if (ftype.isEmpty())
 	{
-		bool useNull = m_prefs->nullHighlight();
-		QString nullText = m_prefs->nullHighlightText();
+		if (useNull && !nullText.isEmpty())
+		{
+			ftype = nullText;
+		}
+		else
+		{
+			ftype = "NULL";
+		}
+	}
+	return ftype;
+}
 
-		QString ftype(m_fields[j].type);
-		if (ftype.isEmpty())
+QString AlterTableDialog::oldExtra(int j)
+{
+	QString fextra;
+	if (m_fields[j].isAutoIncrement)
+	{
+		if (!fextra.isEmpty()) { fextra.append(" "); }
+		fextra.append("AUTOINCREMENT");
+	}
+	if (m_fields[j].isPartOfPrimaryKey)
+	{
+		if (!m_fields[j].isAutoIncrement)
 		{
-			if (useNull && !nullText.isEmpty())
+			if (!fextra.isEmpty()) { fextra.append(" "); }
+			fextra.append("PRIMARY KEY");
+		}
+	}
+	if (m_fields[j].isNotNull)
+	{
+		if (!fextra.isEmpty()) { fextra.append(" "); }
+		fextra.append("NOT NULL");
+	}
+	return fextra;
+}
+
+bool AlterTableDialog::nativePlan(QStringList & statements, QString & reason)
+{
+	statements.clear();
+	if (ui.tabWidget->currentWidget() != ui.designTab)
+	{
+		reason = tr("the SQL has been edited");
+		return false;
+	}
+	if (m_hadRowid == ui.withoutRowid->isChecked())
+	{
+		reason = tr("WITHOUT ROWID is changed");
+		return false;
+	}
+
+	QStringList drops;
+	QStringList renames;
+	QStringList adds;
+	QVector<bool> kept(m_fields.count(), false);
+	int last = -1;
+	for (int i = 0; i < ui.columnTable->rowCount(); ++i)
+	{
+		MyLineEdit * edit =
+			qobject_cast<MyLineEdit*>(ui.columnTable->cellWidget(i, 0));
+		QString name(edit->text());
+		QComboBox * types =
+			qobject_cast<QComboBox*>(ui.columnTable->cellWidget(i, 1));
+		QComboBox * extras =
+			qobject_cast<QComboBox*>(ui.columnTable->cellWidget(i, 2));
+		QString extra(extras->currentText());
+		edit = qobject_cast<MyLineEdit*>(ui.columnTable->cellWidget(i, 3));
+		QString defval(edit->text());
+		int j = m_oldColumn[i];
+		if (j < 0)
+		{
+			// the restrictions of ALTER TABLE ADD COLUMN
+			if (extra.contains("PRIMARY KEY") || extra.contains("AUTOINCREMENT"))
 			{
-				ftype = nullText;
+				reason = tr("new column %1 is part of the primary key")
+						 .arg(name);
+				return false;
 			}
-			else
+			if (   extra.contains("NOT NULL")
+				&& (   defval.isEmpty()
+					|| (defval.compare("NULL", Qt::CaseInsensitive) == 0)))
+			{
+				reason = tr("new column %1 is NOT NULL without a default")
+						 .arg(name);
+				return false;
+			}
+			if (   defval.startsWith("(")
+				|| defval.startsWith("CURRENT_", Qt::CaseInsensitive))
+			{
+				reason = tr("the default of new column %1 is not constant")
+						 .arg(name);
+				return false;
+			}
+			QString sql("ADD COLUMN " + Utils::q(name));
+			if (types->currentIndex())
+			{
+				sql += " " + Utils::q(types->currentText());
+			}
+			if (extra.contains("NOT NULL"))
+			{
+				sql += " NOT NULL";
+			}
+			if (!defval.isEmpty())
 			{
-				ftype = "NULL";
+				sql += " DEFAULT " + defval;
 			}
+			adds.append(sql);
+			continue;
 		}
-		QString fextra;
-		if (m_fields[j].isAutoIncrement)
+		// new columns can only be added at the end
+		if (!adds.isEmpty() || (j < last))
 		{
-			if (!fextra.isEmpty()) { fextra.append(" "); }
-			fextra.append("AUTOINCREMENT");
+			reason = tr("columns are reordered");
+			return false;
 		}
-		if (m_fields[j].isPartOfPrimaryKey)
+		last = j;
+		kept[j] = true;
+		if (   (types->currentText() != oldType(j))
+			|| (extra != oldExtra(j))
+			|| (defval != SqlParser::defaultToken(m_fields[j])))
 		{
-			if (!m_fields[j].isAutoIncrement)
+			reason = tr("column %1 has a new type or constraints").arg(name);
+			return false;
+		}
+		if (name != m_fields[j].name)
+		{
+			if (m_sqliteVersion < 3025000)
 			{
-				if (!fextra.isEmpty()) { fextra.append(" "); }
-				fextra.append("PRIMARY KEY");
+				reason = tr("RENAME COLUMN needs sqlite 3.25.0");
+				return false;
 			}
+			renames.append(QString("RENAME COLUMN %1 TO %2")
+						   .arg(Utils::q(m_fields[j].name), Utils::q(name)));
 		}
-		if (m_fields[j].isNotNull)
+	}
+	for (int j = 0; j < kept.count(); ++j)
+	{
+		if (kept[j]) { continue; }
+		if (m_sqliteVersion < 3035000)
 		{
-			if (!fextra.isEmpty()) { fextra.append(" "); }
-			fextra.append("NOT NULL");
+			reason = tr("DROP COLUMN needs sqlite 3.35.0");
+			return false;
+		}
+		if (m_fields[j].isPartOfPrimaryKey || m_wasIndexed.value(j))
+		{
+			reason = tr("dropped column %1 is indexed").arg(m_fields[j].name);
+			return false;
 		}
+		drops.append("DROP COLUMN " + Utils::q(m_fields[j].name));
+	}
+	// drop first, so a column can take the name of a dropped one
+	statements << drops << renames << adds;
+	return true;
+}
+
+bool AlterTableDialog::alterNative(QString oldTableName, QString newTableName,
+								   const QStringList & statements)
+{
+	if (newTableName != oldTableName)
+	{
+		if (newTableName.compare(oldTableName, Qt::CaseInsensitive) == 0)
+		{
+			// only the case changes, which needs a temporary name
+			QString tmpName = Database::getTempName(m_item->text(1));
+			if (!renameTable(oldTableName, tmpName)) { return false; }
+			oldTableName = tmpName;
+		}
+		if (!renameTable(oldTableName, newTableName)) { return false; }
+	}
+	foreach (QString statement, statements)
+	{
+		QString sql(QString("ALTER TABLE %1.%2 %3;")
+					.arg(Utils::q(m_item->text(1)), Utils::q(newTableName),
+						 statement));
+		if (!execSql(sql, tr("Cannot alter table ") + newTableName))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void AlterTableDialog::showPlan()
+{
+	if (!m_alterButton->isEnabled())
+	{
+		ui.adviceLabel->hide();
+		return;
+	}
+	QString rows(m_rowEstimate < 0 ? tr("all")
+									: tr("about %1").arg(m_rowEstimate));
+	QStringList statements;
+	QString reason;
+	QString text;
+	if (!m_altered)
+	{
+		text = tr("Plan: ALTER TABLE RENAME TO. "
+				  "Only the schema is changed, no rows are copied.");
+	}
+	else if (nativePlan(statements, reason))
+	{
+		text = tr("Plan: ALTER TABLE %1.").arg(statements.join(", "));
+		if (statements.filter("DROP COLUMN").isEmpty())
+		{
+			text += tr(" Only the schema is changed, no rows are copied.");
+		}
+		else
+		{
+			text += tr(" DROP COLUMN rewrites %1 rows in place.").arg(rows);
+		}
+	}
+	else
+	{
+		text = tr("Plan: rebuild the table because %1. "
+				  "It copies %2 rows and recreates %3 indexes.")
+			   .arg(reason, rows).arg(m_indexCount);
+	}
+	ui.adviceLabel->setText(text);
+	ui.adviceLabel->show();
+}
+
+bool AlterTableDialog::checkColumn(int i, QString cname,
+								   QString ctype, QString cextra)
+{
+	int j = m_oldColumn[i];
+	if (j >= 0)
+	{
 		QLineEdit * defval =
 			qobject_cast<QLineEdit*>(ui.columnTable->cellWidget(i, 3));
 		if (   (j != i)
 			|| (cname != m_fields[j].name)
-			|| (ctype != ftype)
-			|| (fextra != cextra)
+			|| (ctype != oldType(j))
+			|| (oldExtra(j) != cextra)
 			|| (defval->text() != SqlParser::defaultToken(m_fields[j])))
 		{
 			m_altered = true;
@@ -569,6 +779,36 @@ void AlterTableDialog::alterButton_clicked()
 		return;
 	}
 
+	QStringList statements;
+	QString reason;
+	if (nativePlan(statements, reason))
+	{
+		if (alterNative(oldTableName, newTableName, statements))
+		{
+			if (!execSql("RELEASE ALTER_TABLE;",
+						 tr("Cannot release savepoint")))
+			{
+				if (doRollback(tr("Cannot roll back either")))
+				{
+					return;
+				}
+			}
+			updated = true;
+			m_item->setText(0, newTableName);
+			resetClicked();
+			resultAppend(tr("Alter Table Done"));
+			return;
+		}
+		// the savepoint stays open, so the table can be rebuilt instead
+		if (!execSql("ROLLBACK TO ALTER_TABLE;",
+					 tr("Cannot roll back after error")))
+		{
+			resultAppend(tr("Database may be left with a pending savepoint."));
+			return;
+		}
+		resultAppend(tr("Rebuilding the table instead."));
+	}
+
 	if (newTableName.compare(oldTableName, Qt::CaseInsensitive) == 0)
 	{
 		// generate unique temporary tablename
@@ -655,36 +895,48 @@ void AlterTableDialog::alterButton_clicked()
 			columnMap.insert(m_fields[j].name, nameItem->text());
 		}
 	}
+	// copy the data, drop the old table and recreate the indexes
+	// on a worker thread, still inside the savepoint
+	TableRebuilder rebuilder(Database::sqlite3handle(), m_rowEstimate, this);
 	if (!insert.isEmpty())
 	{
 		select += " FROM "
 				  + Utils::q(m_item->text(1))
 				  + "."
-				  + Utils::q(oldTableName)
-				  + ";";
-		message = tr("Cannot insert data into ")
-				  + newTableName;
-		if (!execSql(insert + select, message))
+				  + Utils::q(oldTableName);
+		rebuilder.setCopy(insert + select);
+	}
+	rebuilder.setDrop(QString("DROP TABLE ")
+					  + Utils::q(m_item->text(1))
+					  + "."
+					  + Utils::q(oldTableName)
+					  + ";");
+	while (!originalIx.isEmpty())
+	{
+		SqlParser * parser = originalIx.takeFirst();
+		if (parser->replace(columnMap, ui.nameEdit->text()))
 		{
-			if (!doRollback(tr("Cannot roll back after error")))
-			{
-				updated = true;
-				m_item->setText(0, oldTableName);
-			}
-			return;
+			rebuilder.addIndex(parser->m_indexName, parser->toString(),
+							   parser->m_isUnique);
 		}
+		delete parser;
 	}
-
-	// drop old table
-	sql = "DROP TABLE ";
-	sql += Utils::q(m_item->text(1))
-		   + "."
-		   + Utils::q(oldTableName)
-		   + ";";
-	message = tr("Cannot drop table ")
-			  + oldTableName;
-	if (!execSql(sql, message))
+	rebuilder.runWithProgress(tr("Rebuilding table ") + newTableName, this);
+	if (rebuilder.isCancelled() || !rebuilder.errorMessage().isEmpty())
 	{
+		if (rebuilder.isCancelled())
+		{
+			resultAppend(tr("Alter Table cancelled"));
+		}
+		else
+		{
+			resultAppend(tr("Cannot rebuild table ")
+						 + newTableName
+						 + ":<br/><span style=\" color:#ff0000;\">"
+						 + rebuilder.errorMessage()
+						 + "<br/></span>" + tr("using sql statement:")
+						 + "<br/><tt>" + rebuilder.failedSql());
+		}
 		if (!doRollback(tr("Cannot roll back after error")))
 		{
 			updated = true;
@@ -692,6 +944,24 @@ void AlterTableDialog::alterButton_clicked()
 		}
 		return;
 	}
+	resultAppend(tr("%1 rows copied").arg(rebuilder.copied()));
+	foreach (TableRebuilder::Index ix, rebuilder.indexes())
+	{
+		if (ix.error.isEmpty())
+		{
+			resultAppend(tr("Index %1 created in %2 ms")
+						 .arg(ix.name).arg(ix.ms));
+		}
+		else
+		{
+			resultAppend(tr("Cannot recreate index ")
+						 + ix.name
+						 + ":<br/><span style=\" color:#ff0000;\">"
+						 + ix.error
+						 + "<br/></span>" + tr("using sql statement:")
+						 + "<br/><tt>" + ix.sql);
+		}
+	}
 
 	// restoring original triggers
 	// FIXME fix up if columns dropped or renamed
@@ -701,19 +971,6 @@ void AlterTableDialog::alterButton_clicked()
 		(void)execSql(restoreSql, tr("Cannot recreate original trigger"));
 	}
 
-	// recreate indices
-	while (!originalIx.isEmpty())
-	{
-		SqlParser * parser = originalIx.takeFirst();
-		if (parser->replace(columnMap, ui.nameEdit->text()))
-		{
-			// continue after failure here
-			(void)execSql(parser->toString(),
-						  tr("Cannot recreate index ") + parser->m_indexName);
-		}
-		delete parser;
-	}
-
 	if (!execSql("RELEASE ALTER_TABLE;", tr("Cannot release savepoint")))
 	{
 		if (doRollback(tr("Cannot roll back either")))
@@ -737,4 +994,5 @@ void AlterTableDialog::checkChanges()
 	m_alterButton->setEnabled(   ok
 							  && (   m_altered
 								  || (newName != m_item->text(0))));
+	showPlan();
 }
@@ -15,14 +15,14 @@ class QTreeWidgetItem;
 class QPushButton;
 
 /*! \brief Handle alter table features.
-Sqlite3 has very limited ALTER TABLE feature set, so
-there is only support for "table rename" and "add column".
-Table Renaming is handled directly in the LiteManWindow
-method renameTable().
-Adding columns - see addColumns(). It's a wrapper around
-plain ALTER TABLE ADD COLUMN statement.
-Drop Column is using a workaround with tmp table, insert-select
-statement and renaming. See createButton_clicked()
+Renaming, adding and dropping columns are done with the native ALTER
+TABLE statements when the sqlite version and the constraints allow it,
+see nativePlan(). Only DROP COLUMN rewrites the rows then.
+Anything else (changed types or constraints, reordered columns, WITHOUT
+ROWID) is using a workaround with tmp table, insert-select statement and
+renaming. See alterButton_clicked(). The copy is done by a TableRebuilder
+showing progress and allowing to cancel. The cost of the chosen way is shown
+before the table is altered.
 \author Petr Vanek <petr@scribus.info>
 */
 
@@ -52,11 +52,15 @@ class AlterTableDialog : public TableEditorDialog
 		QPushButton * m_alterButton;
 		QList<FieldInfo> m_fields;
 		QVector<bool> m_isIndexed;
+		QVector<bool> m_wasIndexed; // by old column
 		QVector<int> m_oldColumn; // -1 if no old column
 		bool m_hadRowid;
 		bool m_alteringActive; // true if altering currently active table
 		bool m_altered; // something changed other than the name
 		bool m_dropped; // a column has been dropped
+		int m_sqliteVersion; // like SQLITE_VERSION_NUMBER
+		qlonglong m_rowEstimate; // -1 if unknown
+		int m_indexCount;
 
 		/*! \brief Execute statement, handle errors,
 		and output message to the GUI.
@@ -80,6 +84,23 @@ class AlterTableDialog : public TableEditorDialog
 		*/
 		bool renameTable(QString oldTableName, QString newTableName);
 
+		/*! \brief ALTER TABLE clauses doing the column changes in place.
+		\param statements gets clauses to append to "ALTER TABLE name"
+		\param reason why the table has to be rebuilt instead
+		\retval bool false if the table has to be rebuilt
+		*/
+		bool nativePlan(QStringList & statements, QString & reason);
+		/*! \brief Rename the table if needed and run statements on it.
+		On failure the caller rolls back to the savepoint.
+		*/
+		bool alterNative(QString oldTableName, QString newTableName,
+						 const QStringList & statements);
+		//! \brief Show the predicted cost of altering the table.
+		void showPlan();
+
+		//! \brief Type and constraints of old column j as the GUI shows them
+		QString oldType(int j);
+		QString oldExtra(int j);
 		bool checkColumn(int i, QString cname,
 						 QString ctype, QString cextra);
 		void resizeTable();
@@ -5,12 +5,19 @@ a copyright and/or license notice that predates the release of Sqliteman
 for which a new license (GPL+exception) is in place.
 */
 
+#include <QElapsedTimer>
 #include <QSettings>
+#include <QSqlQuery>
 
 #include "analyzedialog.h"
+#include "analyzerunner.h"
 #include "database.h"
+#include "preferences.h"
 #include "utils.h"
 
+// first sqlite version with PRAGMA analysis_limit
+#define ANALYSIS_LIMIT_VERSION 3032000
+
 AnalyzeDialog::AnalyzeDialog(QWidget * parent)
 	: QDialog(parent)
 {
@@ -19,12 +26,37 @@ AnalyzeDialog::AnalyzeDialog(QWidget * parent)
 	int hh = settings.value("analyze/height", QVariant(500)).toInt();
 	int ww = settings.value("analyze/width", QVariant(600)).toInt();
 	resize(ww, hh);
+	ui.limitSpinBox->setValue(settings.value("analyze/limit", 1000).toInt());
+	if (Database::sqliteVersion() < ANALYSIS_LIMIT_VERSION)
+	{
+		ui.limitSpinBox->setValue(0);
+		ui.limitSpinBox->setEnabled(false);
+	}
+	ui.optimizeCheckBox->setChecked(
+		Preferences::instance()->optimizeOnClose());
+
+	foreach (QString schema, Database::getDatabases().keys())
+	{
+		foreach (QString table, Database::getObjects("table", schema).keys())
+		{
+			QListWidgetItem * item = new QListWidgetItem(
+				(schema == "main") ? table : schema + "." + table,
+				ui.tableList);
+			item->setData(Qt::UserRole, schema);
+			item->setData(Qt::UserRole + 1, table);
+		}
+	}
 
-	ui.tableList->addItems(Database::getObjects("table").keys());
+	ui.statsTree->setHeaderLabels(QStringList() << tr("Table / Index")
+		<< tr("Rows") << tr("Distinct Keys") << tr("Rows per Key")
+		<< tr("Selectivity") << tr("Samples"));
+	showStatistics();
 
 	connect(ui.dropButton, SIGNAL(clicked()), this, SLOT(dropButton_clicked()));
 	connect(ui.allButton, SIGNAL(clicked()), this, SLOT(allButton_clicked()));
 	connect(ui.tableButton, SIGNAL(clicked()), this, SLOT(tableButton_clicked()));
+	connect(ui.optimizeCheckBox, SIGNAL(toggled(bool)),
+			this, SLOT(optimizeCheckBox_toggled(bool)));
 }
 
 AnalyzeDialog::~AnalyzeDialog()
@@ -32,26 +64,163 @@ AnalyzeDialog::~AnalyzeDialog()
 	QSettings settings("yarpen.cz", "sqliteman");
     settings.setValue("analyze/height", QVariant(height()));
     settings.setValue("analyze/width", QVariant(width()));
+	if (ui.limitSpinBox->isEnabled())
+		settings.setValue("analyze/limit", ui.limitSpinBox->value());
+}
+
+void AnalyzeDialog::showStatistics()
+{
+	ui.statsTree->clear();
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	foreach (QString schema, Database::getDatabases().keys())
+	{
+		QSqlQuery query(QString("SELECT name FROM %1 WHERE type = 'table' "
+								"AND name IN ('sqlite_stat1', 'sqlite_stat4');")
+						.arg(Database::getMaster(schema)), db);
+		QStringList statTables;
+		while (query.next())
+			statTables.append(query.value(0).toString());
+		if (!statTables.contains("sqlite_stat1"))
+			continue;
+
+		QMap<QString,int> samples;
+		if (statTables.contains("sqlite_stat4"))
+		{
+			query.exec(QString("SELECT idx, count(*) FROM %1.sqlite_stat4 "
+							   "GROUP BY idx;").arg(Utils::q(schema)));
+			while (query.next())
+				samples.insert(query.value(0).toString(),
+							   query.value(1).toInt());
+		}
+
+		QMap<QString,QTreeWidgetItem *> tables;
+		query.exec(QString("SELECT tbl, idx, stat FROM %1.sqlite_stat1 "
+						   "ORDER BY tbl, idx;").arg(Utils::q(schema)));
+		while (query.next())
+		{
+			QString table(query.value(0).toString());
+			QTreeWidgetItem * tableItem = tables.value(table);
+			if (!tableItem)
+			{
+				tableItem = new QTreeWidgetItem(ui.statsTree);
+				tableItem->setText(0, (schema == "main")
+									  ? table : schema + "." + table);
+				tables.insert(table, tableItem);
+			}
+
+			// "rows perKey1 perKey2 ..." followed by flags like
+			// "unordered" or "sz=..."
+			QList<qlonglong> stat;
+			foreach (QString token, query.value(2).toString().split(' '))
+			{
+				bool ok;
+				qlonglong n = token.toLongLong(&ok);
+				if (!ok) { break; }
+				stat.append(n);
+			}
+			if (stat.isEmpty()) { continue; }
+			qlonglong rows = stat.at(0);
+			tableItem->setText(1, QString::number(rows));
+			if (query.value(1).isNull()) { continue; }
+
+			QString index(query.value(1).toString());
+			QTreeWidgetItem * indexItem = new QTreeWidgetItem(tableItem);
+			indexItem->setText(0, index);
+			indexItem->setText(1, QString::number(rows));
+			if (samples.contains(index))
+				indexItem->setText(5, QString::number(samples.value(index)));
+
+			// one line per leading column prefix the index can be
+			// searched with
+			QStringList columns(Database::indexFields(index, schema));
+			QStringList prefix;
+			for (int i = 1; i < stat.count(); ++i)
+			{
+				QString column(columns.value(i - 1));
+				prefix.append(column.isEmpty() ? tr("(expression)") : column);
+				qlonglong perKey = qMax(stat.at(i), (qlonglong)1);
+				QTreeWidgetItem * item = new QTreeWidgetItem(indexItem);
+				item->setText(0, prefix.join(", "));
+				item->setText(2, QString::number(rows / perKey));
+				item->setText(3, QString::number(perKey));
+				if (rows > 0)
+				{
+					item->setText(4, QString("%1 %")
+							.arg(100.0 * perKey / rows, 0, 'g', 3));
+				}
+			}
+		}
+	}
+	ui.statsTree->expandAll();
+	for (int i = 0; i < ui.statsTree->columnCount(); ++i)
+		ui.statsTree->resizeColumnToContents(i);
+}
+
+void AnalyzeDialog::analyze(const QList<QListWidgetItem *> & items)
+{
+	AnalyzeRunner runner(Database::sqlite3handle(), this);
+	runner.setLimit(ui.limitSpinBox->value());
+	foreach (QListWidgetItem * item, items)
+	{
+		runner.addTable(item->data(Qt::UserRole).toString(),
+						item->data(Qt::UserRole + 1).toString());
+	}
+	QElapsedTimer timer;
+	timer.start();
+	runner.runWithProgress(tr("Analyzing"), this);
+
+	QString result(tr("%1 of %2 tables analyzed in %3 s.")
+				   .arg(runner.analyzed()).arg(items.count())
+				   .arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+	if (!runner.errorMessage().isEmpty())
+	{
+		if (!runner.failedTable().isEmpty())
+			result += " " + tr("Failed on %1").arg(runner.failedTable());
+		result += ":<br/><span style=\" color:#ff0000;\">"
+				  + runner.errorMessage() + "<br/></span>";
+	}
+	ui.resultLabel->setText(result);
+	showStatistics();
 }
 
 void AnalyzeDialog::dropButton_clicked()
 {
-	Database::execSql("delete from sqlite_stat1;");
+	// the statistics tree shows every schema, so clear them all
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	foreach (QString schema, Database::getDatabases().keys())
+	{
+		// there is no sqlite_stat4 unless the library was built with it
+		QSqlQuery query(QString("SELECT name FROM %1 WHERE type = 'table' "
+								"AND name IN ('sqlite_stat1', 'sqlite_stat4');")
+						.arg(Database::getMaster(schema)), db);
+		QStringList statTables;
+		while (query.next())
+			statTables.append(query.value(0).toString());
+		foreach (QString table, statTables)
+		{
+			if (!Database::execSql(QString("delete from %1.%2;")
+								   .arg(Utils::q(schema)).arg(table)))
+				break;
+		}
+	}
+	ui.resultLabel->clear();
+	showStatistics();
 }
 
 void AnalyzeDialog::allButton_clicked()
 {
-	Database::execSql("analyze;");
+	QList<QListWidgetItem *> items;
+	for (int i = 0; i < ui.tableList->count(); ++i)
+		items.append(ui.tableList->item(i));
+	analyze(items);
 }
 
 void AnalyzeDialog::tableButton_clicked()
 {
-	QList<QListWidgetItem *> list(ui.tableList->selectedItems());
-	for (int i = 0; i < list.size(); ++i)
-	{
-		if (!Database::execSql(QString("analyze %1;")
-							   .arg(Utils::q(list.at(i)->text()))))
-			break;
-	}
+	analyze(ui.tableList->selectedItems());
 }
 
+void AnalyzeDialog::optimizeCheckBox_toggled(bool checked)
+{
+	Preferences::instance()->setOptimizeOnClose(checked);
+}
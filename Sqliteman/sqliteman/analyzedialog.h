@@ -15,6 +15,9 @@ for which a new license (GPL+exception) is in place.
 
 /*! \brief Handle DB statistics here.
 Sqlite3 offers simple statistics for its internal SQL optimizer.
+ANALYZE runs table by table in an AnalyzeRunner, optionally sampled.
+The statistics gathered (sqlite_stat1 and the sample count of
+sqlite_stat4) are shown per index and per leading column prefix.
 \author Petr Vanek <petr@scribus.info>
  */
 class AnalyzeDialog : public QDialog
@@ -28,10 +31,15 @@ class AnalyzeDialog : public QDialog
 	private:
 		Ui::AnalyzeDialog ui;
 
+		//! \brief Fill statsTree from the sqlite_stat tables.
+		void showStatistics();
+		void analyze(const QList<QListWidgetItem *> & items);
+
     private slots:
 		void dropButton_clicked();
 		void allButton_clicked();
 		void tableButton_clicked();
+		void optimizeCheckBox_toggled(bool checked);
 };
 
 #endif
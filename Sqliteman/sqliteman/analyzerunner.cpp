@@ -0,0 +1,73 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "analyzerunner.h"
+#include "utils.h"
+
+
+AnalyzeRunner::AnalyzeRunner(sqlite3 * handle, QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_limit(0),
+	  m_analyzed(0)
+{
+}
+
+void AnalyzeRunner::addTable(const QString & schema, const QString & table)
+{
+	useOwnConnection(schema, true);
+	m_schemas.append(schema);
+	m_tables.append(table);
+}
+
+int AnalyzeRunner::progressHandler(void * worker)
+{
+	return ((AnalyzeRunner *)worker)->isCancelled() ? 1 : 0;
+}
+
+void AnalyzeRunner::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+
+	// an unknown pragma is a no-op, so older libraries just analyze it all
+	int oldLimit = 0;
+	sqlite3_stmt * stmt = 0;
+	if (   (sqlite3_prepare_v2(m_handle, "PRAGMA analysis_limit;", -1,
+							   &stmt, 0) == SQLITE_OK)
+		&& (sqlite3_step(stmt) == SQLITE_ROW))
+	{
+		oldLimit = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	exec(QString("PRAGMA analysis_limit = %1;").arg(m_limit));
+	m_error.clear();
+
+	sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+	for (int i = 0; (i < m_tables.count()) && !isCancelled(); ++i)
+	{
+		reportProgress(i, m_tables.count());
+		emit label(tr("Analyzing %1 (%2 of %3)")
+				   .arg(m_tables.at(i)).arg(i + 1).arg(m_tables.count()));
+		if (!exec(QString("ANALYZE %1.%2;").arg(Utils::q(m_schemas.at(i)),
+												Utils::q(m_tables.at(i)))))
+		{
+			m_failedTable = m_tables.at(i);
+			break;
+		}
+		++m_analyzed;
+	}
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+	if (isCancelled())
+		m_error = tr("Cancelled");
+
+	QString error(m_error);
+	exec(QString("PRAGMA analysis_limit = %1;").arg(oldLimit));
+	m_error = error;
+}
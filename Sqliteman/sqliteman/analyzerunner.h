@@ -0,0 +1,54 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef ANALYZERUNNER_H
+#define ANALYZERUNNER_H
+
+#include <QStringList>
+
+#include "databaseworker.h"
+
+
+/*! \brief Runs ANALYZE table by table on the worker thread.
+One ANALYZE per table gives the progress and lets a cancel stop between
+tables, keeping the statistics gathered so far. With a limit, PRAGMA
+analysis_limit (sqlite 3.32) makes ANALYZE look at about that many rows
+of each index instead of all of them, which is good enough for the
+planner and much faster on big tables. The previous limit of the
+connection is restored afterwards.
+In WAL mode it uses a connection of its own
+(DatabaseWorker::useOwnConnection()).
+*/
+class AnalyzeRunner : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		AnalyzeRunner(sqlite3 * handle, QObject * parent = 0);
+
+		void addTable(const QString & schema, const QString & table);
+		//! \brief Rows sampled per index, 0 for all of them.
+		void setLimit(int limit) { m_limit = limit; }
+
+		//! \brief Table the error occurred on.
+		QString failedTable() { return m_failedTable; }
+		int analyzed() { return m_analyzed; }
+
+	protected:
+		void run();
+
+	private:
+		QStringList m_schemas;
+		QStringList m_tables;
+		int m_limit;
+		int m_analyzed;
+		QString m_failedTable;
+
+		static int progressHandler(void * worker);
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSettings>
+
+#include "backupdialog.h"
+#include "databasebackup.h"
+#include "utils.h"
+
+// first sqlite version with VACUUM INTO
+#define VACUUM_INTO_VERSION 3027000
+
+
+BackupDialog::BackupDialog(LiteManWindow * parent)
+	: QDialog(parent)
+{
+	creator = parent;
+	ui.setupUi(this);
+
+	m_files = Database::getDatabases();
+	ui.schemaCombo->addItems(m_files.keys());
+	ui.schemaCombo->setCurrentIndex(ui.schemaCombo->findText("main"));
+
+	if (Database::sqliteVersion() < VACUUM_INTO_VERSION)
+	{
+		ui.vacuumRadio->setEnabled(false);
+		ui.vacuumRadio->setToolTip(tr("VACUUM INTO needs sqlite 3.27 or newer"));
+	}
+
+	QSettings settings("yarpen.cz", "sqliteman");
+	ui.pagesSpinBox->setValue(settings.value("backup/pages", 100).toInt());
+	ui.sleepSpinBox->setValue(settings.value("backup/sleep", 10).toInt());
+	if (   settings.value("backup/vacuum", false).toBool()
+		&& ui.vacuumRadio->isEnabled())
+	{
+		ui.vacuumRadio->setChecked(true);
+	}
+
+	m_backupButton =
+		ui.buttonBox->addButton(tr("&Back Up"), QDialogButtonBox::ApplyRole);
+	updateButtons();
+
+	connect(ui.fileEdit, SIGNAL(textChanged(const QString &)),
+			this, SLOT(updateButtons()));
+	connect(ui.backupRadio, SIGNAL(toggled(bool)),
+			this, SLOT(updateButtons()));
+	connect(ui.browseButton, SIGNAL(clicked()),
+			this, SLOT(browseButton_clicked()));
+	connect(m_backupButton, SIGNAL(clicked()),
+			this, SLOT(backupButton_clicked()));
+}
+
+BackupDialog::~BackupDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("backup/pages", ui.pagesSpinBox->value());
+	settings.setValue("backup/sleep", ui.sleepSpinBox->value());
+	settings.setValue("backup/vacuum", ui.vacuumRadio->isChecked());
+}
+
+void BackupDialog::updateButtons()
+{
+	bool paced = ui.backupRadio->isChecked();
+	ui.pagesLabel->setEnabled(paced);
+	ui.pagesSpinBox->setEnabled(paced);
+	ui.sleepLabel->setEnabled(paced);
+	ui.sleepSpinBox->setEnabled(paced);
+	m_backupButton->setEnabled(!ui.fileEdit->text().trimmed().isEmpty());
+}
+
+void BackupDialog::browseButton_clicked()
+{
+	QString dir(ui.fileEdit->text());
+	if (dir.isEmpty())
+	{
+		QString source(m_files.value(ui.schemaCombo->currentText()));
+		dir = source.isEmpty() ? QDir::currentPath()
+							   : QFileInfo(source).absolutePath();
+	}
+	// overwriting is confirmed by prepareFile()
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Back Up Database"),
+						dir, tr("SQLite database (*)"), 0,
+						QFileDialog::DontConfirmOverwrite);
+	if (!fileName.isNull())
+		ui.fileEdit->setText(fileName);
+}
+
+bool BackupDialog::prepareFile(const QString & fileName)
+{
+	QFileInfo target(fileName);
+	if (!target.exists())
+		return true;
+
+	QString source(m_files.value(ui.schemaCombo->currentText()));
+	if (   !source.isEmpty()
+		&& (QFileInfo(source).canonicalFilePath() == target.canonicalFilePath()))
+	{
+		QMessageBox::warning(this, tr("Back Up Database"),
+			tr("A database cannot be backed up into its own file."));
+		return false;
+	}
+	if (QMessageBox::question(this, tr("Back Up Database"),
+			tr("%1 already exists.\nDo you want to replace it?")
+				.arg(fileName),
+			QMessageBox::Yes | QMessageBox::No, QMessageBox::No)
+		!= QMessageBox::Yes)
+	{
+		return false;
+	}
+	// VACUUM INTO refuses to write into an existing database, while the
+	// backup API replaces its content and leaves it alone on failure
+	if (ui.vacuumRadio->isChecked() && !QFile::remove(fileName))
+	{
+		QMessageBox::warning(this, tr("Back Up Database"),
+			tr("Cannot remove %1.").arg(fileName));
+		return false;
+	}
+	return true;
+}
+
+void BackupDialog::backupButton_clicked()
+{
+	QString schema(ui.schemaCombo->currentText());
+	QString fileName(QDir::fromNativeSeparators(ui.fileEdit->text().trimmed()));
+	if (!creator || !creator->checkForPending() || !prepareFile(fileName))
+		return;
+
+	DatabaseBackup worker(Database::sqlite3handle(), schema, fileName, this);
+	worker.setVacuum(ui.vacuumRadio->isChecked());
+	worker.setSteps(ui.pagesSpinBox->value(), ui.sleepSpinBox->value());
+	QElapsedTimer timer;
+	timer.start();
+	worker.runWithProgress(tr("Backing up %1").arg(schema), this);
+
+	if (!worker.errorMessage().isEmpty())
+	{
+		ui.resultLabel->setText(tr("Backup failed")
+			+ ":<br/><span style=\" color:#ff0000;\">"
+			+ worker.errorMessage() + "<br/></span>");
+		return;
+	}
+	ui.resultLabel->setText(tr("%1 saved into %2: %3 pages, %4 in %5 s.")
+		.arg(schema, fileName)
+		.arg(worker.pageCount())
+		.arg(Utils::formatSize(QFileInfo(fileName).size()))
+		.arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+}
@@ -0,0 +1,51 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef BACKUPDIALOG_H
+#define BACKUPDIALOG_H
+
+#include <qdialog.h>
+
+#include "database.h"
+#include "litemanwindow.h"
+#include "ui_backupdialog.h"
+
+class QPushButton;
+
+
+/*! \brief Copy the open database or an attached one into a file.
+The copy is a DatabaseBackup run with a progress dialog, either with the
+online backup API or as VACUUM INTO.
+*/
+class BackupDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		BackupDialog(LiteManWindow * parent = 0);
+		~BackupDialog();
+
+	private:
+		Ui::BackupDialog ui;
+		QPushButton * m_backupButton;
+		//! \brief schema name to its file, empty for in-memory ones
+		DbAttach m_files;
+
+		// We ought to be able use use parent() for this, but for some reason
+		// qobject_cast<LiteManWindow*>(parent()) doesn't work
+		LiteManWindow * creator;
+
+		//! \brief Ask before overwriting the file and check it can be.
+		bool prepareFile(const QString & fileName);
+
+	private slots:
+		void browseButton_clicked();
+		void backupButton_clicked();
+		void updateButtons();
+};
+
+#endif
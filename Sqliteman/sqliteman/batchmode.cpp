@@ -0,0 +1,457 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <stdio.h>
+
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#ifdef INTERNAL_SQLDRIVER
+#include "driver/qsql_sqlite.h"
+#endif
+
+#include "batchmode.h"
+#include "database.h"
+#include "importtabledialog.h"
+#include "schemacatalog.h"
+#include "utils.h"
+
+#define ARG_DB "--db"
+#define ARG_EXEC "--exec"
+#define ARG_EXPORT "--export"
+#define ARG_OUT "--out"
+#define ARG_IMPORT "--import"
+#define ARG_TABLE "--table"
+#define ARG_SEPARATOR "--separator"
+#define ARG_SKIPHEADER "--skip-header"
+#define ARG_DUMP "--dump"
+
+// same layout as the CSV export of DataExportDialog
+#define CSV_SEPARATOR ", "
+
+
+bool BatchMode::requested(int argc, char ** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (QString(argv[i]) == ARG_DB) { return true; }
+	}
+	return false;
+}
+
+BatchMode::BatchMode(int argc, char ** argv)
+	: m_separator(","),
+	  m_skipHeader(false),
+	  m_handle(0),
+	  m_outFile(0)
+{
+	for (int i = 1; i < argc; ++i)
+		m_args.append(QFile::decodeName(argv[i]));
+	Database::setBatchMode(true);
+}
+
+BatchMode::~BatchMode()
+{
+	m_outStream.flush();
+	m_outStream.setDevice(0);
+	delete m_outFile;
+	closeDatabase();
+}
+
+void BatchMode::error(const QString & message, const QString & sql)
+{
+	QTextStream cerr(stderr, QIODevice::WriteOnly);
+	cerr << "sqliteman: " << message << "\n";
+	if (!sql.isEmpty())
+		cerr << tr("using sql statement:") << "\n" << sql << "\n";
+}
+
+bool BatchMode::parseArgs()
+{
+	for (int i = 0; i < m_args.count(); ++i)
+	{
+		QString arg(m_args.at(i));
+		if (arg == ARG_SKIPHEADER)
+		{
+			m_skipHeader = true;
+			continue;
+		}
+		QString * value = 0;
+		if (arg == ARG_DB) { value = &m_db; }
+		else if (arg == ARG_EXEC) { value = &m_exec; }
+		else if (arg == ARG_EXPORT) { value = &m_export; }
+		else if (arg == ARG_OUT) { value = &m_out; }
+		else if (arg == ARG_IMPORT) { value = &m_import; }
+		else if (arg == ARG_TABLE) { value = &m_table; }
+		else if (arg == ARG_SEPARATOR) { value = &m_separator; }
+		else if (arg == ARG_DUMP) { value = &m_dump; }
+		else
+		{
+			error(tr("Invalid argument: %1").arg(arg));
+			return false;
+		}
+		if (++i >= m_args.count())
+		{
+			error(tr("Missing value for %1").arg(arg));
+			return false;
+		}
+		*value = m_args.at(i);
+	}
+
+	if (m_db.isEmpty())
+	{
+		error(tr("No database given"));
+		return false;
+	}
+	if (!m_export.isEmpty() && (m_export.toLower() != "csv"))
+	{
+		error(tr("Unsupported export format %1. Only csv is available"
+				 " in batch mode.").arg(m_export));
+		return false;
+	}
+	if (!m_export.isEmpty() && m_exec.isEmpty())
+	{
+		error(tr("%1 needs a script to run with %2")
+			  .arg(ARG_EXPORT).arg(ARG_EXEC));
+		return false;
+	}
+	if (!m_import.isEmpty() && m_table.isEmpty())
+	{
+		error(tr("%1 needs a target table given with %2")
+			  .arg(ARG_IMPORT).arg(ARG_TABLE));
+		return false;
+	}
+	if (m_exec.isEmpty() && m_import.isEmpty() && m_dump.isEmpty())
+	{
+		error(tr("Nothing to do: use %1, %2 or %3")
+			  .arg(ARG_EXEC).arg(ARG_IMPORT).arg(ARG_DUMP));
+		return false;
+	}
+	return true;
+}
+
+bool BatchMode::openDatabase()
+{
+#ifdef INTERNAL_SQLDRIVER
+	QSqlDatabase db =
+		QSqlDatabase::addDatabase(new QSQLiteDriver(), SESSION_NAME);
+#else
+	QSqlDatabase db =
+		QSqlDatabase::addDatabase("QSQLITE", SESSION_NAME);
+#endif
+	db.setDatabaseName(m_db);
+	if (!db.open())
+	{
+		error(tr("Cannot open or create %1: %2")
+			  .arg(m_db).arg(db.lastError().text()));
+		return false;
+	}
+	// same "is it a database" check as LiteManWindow::openDatabase()
+	QSqlQuery q("select 1 from sqlite_master where 1=2", db);
+	if (q.lastError().isValid())
+	{
+		error(tr("Cannot access %1: %2. It is probably not a database.")
+			  .arg(m_db).arg(q.lastError().text()));
+		return false;
+	}
+	m_handle = Database::sqlite3handle();
+	if (!m_handle) { return false; }
+	Database::makeUserFunctions(m_handle);
+	return true;
+}
+
+void BatchMode::closeDatabase()
+{
+	m_handle = 0;
+	SchemaCatalog::deleteInstance();
+	bool isValid = false;
+	{
+		QSqlDatabase db = QSqlDatabase::database(SESSION_NAME, false);
+		if (db.isValid())
+		{
+			isValid = true;
+			db.close();
+		}
+	}
+	if (isValid) { QSqlDatabase::removeDatabase(SESSION_NAME); }
+}
+
+bool BatchMode::openOutput()
+{
+	if (m_outFile) { return true; }
+	m_outFile = new QFile();
+	bool ok;
+	if (m_out.isEmpty() || (m_out == "-"))
+		ok = m_outFile->open(stdout, QIODevice::WriteOnly);
+	else
+	{
+		m_outFile->setFileName(m_out);
+		ok = m_outFile->open(QIODevice::WriteOnly | QIODevice::Truncate);
+	}
+	if (!ok)
+	{
+		error(tr("Cannot open file %1 for writing").arg(m_out));
+		return false;
+	}
+	m_outStream.setDevice(m_outFile);
+	m_outStream.setCodec("UTF-8");
+	return true;
+}
+
+bool BatchMode::importCSV()
+{
+	QFile file(m_import);
+	bool opened = (m_import == "-")
+				  ? file.open(stdin, QIODevice::ReadOnly | QIODevice::Text)
+				  : file.open(QIODevice::ReadOnly | QIODevice::Text);
+	if (!opened)
+	{
+		error(tr("Cannot open file %1 for reading").arg(m_import));
+		return false;
+	}
+	QTextStream in(&file);
+	in.setCodec("UTF-8");
+
+	int cols = Database::tableFields(m_table, "main").count();
+	if (cols == 0)
+	{
+		error(tr("Table %1 does not exist").arg(m_table));
+		return false;
+	}
+	QStringList binds;
+	for (int i = 0; i < cols; ++i) { binds << "?"; }
+	QString sql = QString("INSERT INTO ")
+				  + Utils::q(m_table)
+				  + " VALUES ("
+				  + binds.join(", ")
+				  + ");";
+	QByteArray utf(sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(m_handle, utf.constData(), -1, &stmt, 0)
+		!= SQLITE_OK)
+	{
+		error(QString::fromUtf8(sqlite3_errmsg(m_handle)), sql);
+		return false;
+	}
+
+	// one transaction for the whole file, and all or nothing
+	sqlite3_exec(m_handle, "SAVEPOINT IMPORT_TABLE;", 0, 0, 0);
+	bool result = true;
+	int row = 0;
+	if (m_skipHeader && !in.atEnd())
+		ImportTableDialog::splitLine(&in, m_separator, "\"");
+	while (!in.atEnd())
+	{
+		// splitLine() reads one record, which may span several lines
+		QStringList l(ImportTableDialog::splitLine(&in, m_separator, "\""));
+		++row;
+		if (l.count() != cols)
+		{
+			error(tr("Row = %1; Imported values = %2; "
+					 "Table columns count = %3; Values = (%4)")
+				  .arg(row).arg(l.count()).arg(cols).arg(l.join(", ")));
+			result = false;
+			break;
+		}
+		for (int i = 0; i < cols; ++i)
+		{
+			const QString & s = l.at(i);
+			if (s.isEmpty())
+			{
+				sqlite3_bind_null(stmt, i + 1);
+			}
+			else if (s.startsWith("X'", Qt::CaseInsensitive)
+					 && s.endsWith("'"))
+			{
+				QByteArray b(QByteArray::fromHex(s.mid(2, s.length() - 3)
+												 .toLatin1()));
+				sqlite3_bind_blob(stmt, i + 1, b.constData(), b.size(),
+								  SQLITE_TRANSIENT);
+			}
+			else
+			{
+				QByteArray v(s.toUtf8());
+				sqlite3_bind_text(stmt, i + 1, v.constData(), v.size(),
+								  SQLITE_TRANSIENT);
+			}
+		}
+		int rc = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			error(tr("Row = %1; %2").arg(row)
+				  .arg(QString::fromUtf8(sqlite3_errmsg(m_handle))));
+			result = false;
+			break;
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	if (!result)
+		sqlite3_exec(m_handle, "ROLLBACK TO IMPORT_TABLE;", 0, 0, 0);
+	sqlite3_exec(m_handle, "RELEASE IMPORT_TABLE;", 0, 0, 0);
+	return result;
+}
+
+void BatchMode::exportHeader(sqlite3_stmt * stmt)
+{
+	int cols = sqlite3_column_count(stmt);
+	for (int i = 0; i < cols; ++i)
+	{
+		m_outStream << '"'
+					<< QString::fromUtf8(sqlite3_column_name(stmt, i))
+					   .replace('"', "\"\"")
+					<< '"';
+		if (i != (cols - 1))
+			m_outStream << CSV_SEPARATOR;
+	}
+	m_outStream << "\n";
+}
+
+void BatchMode::exportRow(sqlite3_stmt * stmt)
+{
+	int cols = sqlite3_column_count(stmt);
+	for (int i = 0; i < cols; ++i)
+	{
+		if (sqlite3_column_type(stmt, i) == SQLITE_BLOB)
+		{
+			QByteArray b((const char *)sqlite3_column_blob(stmt, i),
+						 sqlite3_column_bytes(stmt, i));
+			m_outStream << Database::hex(b);
+		}
+		else
+		{
+			const char * text = (const char *)sqlite3_column_text(stmt, i);
+			m_outStream << '"'
+						<< QString::fromUtf8(text,
+											 sqlite3_column_bytes(stmt, i))
+						   .replace('"', "\"\"")
+						<< '"';
+		}
+		if (i != (cols - 1))
+			m_outStream << CSV_SEPARATOR;
+	}
+	m_outStream << "\n";
+}
+
+bool BatchMode::execScript()
+{
+	QFile file(m_exec);
+	bool opened = (m_exec == "-")
+				  ? file.open(stdin, QIODevice::ReadOnly)
+				  : file.open(QIODevice::ReadOnly);
+	if (!opened)
+	{
+		error(tr("Cannot open file %1 for reading").arg(m_exec));
+		return false;
+	}
+
+	bool exporting = !m_export.isEmpty();
+	if (exporting && !openOutput()) { return false; }
+
+	QByteArray statement;
+	bool first = true;
+	while (true)
+	{
+		QByteArray line(file.readLine());
+		if (line.isEmpty()) { break; } // end of file
+		if (first && line.startsWith("\xEF\xBB\xBF"))
+			line.remove(0, 3); // UTF-8 byte order mark
+		first = false;
+		statement += line;
+		// a statement can only end on a line with a semicolon
+		if (   !line.contains(';')
+			|| !sqlite3_complete(statement.constData()))
+		{
+			continue;
+		}
+		if (!execStatements(statement, exporting)) { return false; }
+		statement.clear();
+	}
+	// the last statement may lack its semicolon
+	if (   !statement.trimmed().isEmpty()
+		&& !execStatements(statement, exporting))
+	{
+		return false;
+	}
+	m_outStream.flush();
+	return true;
+}
+
+bool BatchMode::execStatements(const QByteArray & sql, bool exporting)
+{
+	const char * tail = sql.constData();
+	const char * end = tail + sql.size();
+	while (tail < end)
+	{
+		const char * start = tail;
+		sqlite3_stmt * stmt = 0;
+		if (sqlite3_prepare_v2(m_handle, start, end - start, &stmt, &tail)
+			!= SQLITE_OK)
+		{
+			error(QString::fromUtf8(sqlite3_errmsg(m_handle)),
+				  QString::fromUtf8(start, tail - start).trimmed());
+			return false;
+		}
+		// only whitespace or comments left
+		if (!stmt) { continue; }
+
+		// every result set gets its own header line
+		bool header = exporting && (sqlite3_column_count(stmt) > 0);
+		int rc;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			if (!exporting) { continue; }
+			if (header)
+			{
+				exportHeader(stmt);
+				header = false;
+			}
+			exportRow(stmt);
+		}
+		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE)
+		{
+			error(QString::fromUtf8(sqlite3_errmsg(m_handle)),
+				  QString::fromUtf8(start, tail - start).trimmed());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BatchMode::dump()
+{
+	if (m_dump != "-")
+		return Database::dumpDatabase(m_dump);
+
+	QFile file;
+	if (!file.open(stdout, QIODevice::WriteOnly | QIODevice::Text))
+	{
+		error(tr("Cannot write to stdout"));
+		return false;
+	}
+	m_outStream.flush();
+	QTextStream stream(&file);
+	stream.setCodec("UTF-8");
+	return Database::dumpDatabase(stream);
+}
+
+int BatchMode::run()
+{
+	if (!parseArgs() || !openDatabase())
+		return 1;
+	if (!m_import.isEmpty() && !importCSV())
+		return 1;
+	if (!m_exec.isEmpty() && !execScript())
+		return 1;
+	if (!m_dump.isEmpty() && !dump())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef BATCHMODE_H
+#define BATCHMODE_H
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include "sqlite3.h"
+
+class QFile;
+
+
+/*! \brief Headless command line mode.
+Runs without any widgets, so it can be used from cron or other
+scripts on machines without a display:
+
+sqliteman --db x.db [--import data.csv --table t] [--exec script.sql]
+[--export csv] [--out y.csv] [--dump dump.sql]
+
+The steps run in the order import, exec, dump. Rows are streamed with
+the sqlite3 API one at a time and never collected in a model, so memory
+use does not depend on the size of the data.
+Errors are written to stderr and the process exits with a non-zero
+status.
+*/
+class BatchMode
+{
+		Q_DECLARE_TR_FUNCTIONS(BatchMode)
+
+	public:
+		//! \brief True when the command line asks for batch mode (--db).
+		static bool requested(int argc, char ** argv);
+
+		BatchMode(int argc, char ** argv);
+		~BatchMode();
+
+		//! \brief Run the requested steps. Returns the process exit code.
+		int run();
+
+	private:
+		QStringList m_args;
+		QString m_db;
+		QString m_exec;
+		QString m_export;
+		QString m_out;
+		QString m_import;
+		QString m_table;
+		QString m_separator;
+		bool m_skipHeader;
+		QString m_dump;
+
+		sqlite3 * m_handle;
+		QFile * m_outFile;
+		QTextStream m_outStream;
+
+		bool parseArgs();
+		bool openDatabase();
+		void closeDatabase();
+		//! \brief Open --out, or stdout for "-" and when it is not given.
+		bool openOutput();
+		bool importCSV();
+		/*! \brief Run --exec, reading it a statement at a time.
+		Lines are collected until sqlite3_complete() says they end a
+		statement, so only the current statement is held in memory.
+		*/
+		bool execScript();
+		//! \brief Prepare and step all statements of sql.
+		bool execStatements(const QByteArray & sql, bool exporting);
+		void exportHeader(sqlite3_stmt * stmt);
+		void exportRow(sqlite3_stmt * stmt);
+		bool dump();
+		void error(const QString & message,
+				   const QString & sql = QString());
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+
+Benchmark of SqlParser on generated CREATE TABLE statements.
+*/
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+
+#include "sqlparser.h"
+
+// best of this many runs is reported
+#define RUNS 5
+// largest per character time allowed, relative to the smallest statement
+#define MAX_SLOWDOWN 3.0
+
+
+// CREATE TABLE with columns columns using all kinds of tokens
+static QString createTable(int columns)
+{
+	QStringList defs;
+	defs.append("\"id\" INTEGER PRIMARY KEY AUTOINCREMENT");
+	for (int i = 1; i < columns; ++i)
+	{
+		switch (i % 5)
+		{
+			case 0:
+				defs.append(QString("c%1 TEXT NOT NULL DEFAULT 'it''s %1'")
+							.arg(i));
+				break;
+			case 1:
+				defs.append(QString("[c %1] REAL DEFAULT 1.5e-3").arg(i));
+				break;
+			case 2:
+				defs.append(QString("`c%1` BLOB DEFAULT X'00ff%1'").arg(i % 10));
+				break;
+			case 3:
+				defs.append(QString("\"c\"\"%1\" INTEGER CHECK (\"c\"\"%1\" >= 0"
+									" AND \"c\"\"%1\" <> 0x%1)").arg(i));
+				break;
+			default:
+				defs.append(QString("c%1 VARCHAR(20) COLLATE NOCASE").arg(i));
+				break;
+		}
+	}
+	return QString("CREATE TABLE \"big\" (\n\t%1\n);")
+		   .arg(defs.join(",\n\t"));
+}
+
+// best time of RUNS runs in nanoseconds
+static qint64 timeScan(const QString & sql, int * tokens)
+{
+	qint64 best = -1;
+	SqlParser parser(QString(""));
+	for (int run = 0; run < RUNS; ++run)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		*tokens = parser.scan(sql).count();
+		qint64 ns = timer.nsecsElapsed();
+		if ((best < 0) || (ns < best)) { best = ns; }
+	}
+	return best;
+}
+
+static qint64 timeParse(const QString & sql, int * fields)
+{
+	qint64 best = -1;
+	for (int run = 0; run < RUNS; ++run)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		SqlParser parser(sql);
+		*fields = parser.m_fields.count();
+		qint64 ns = timer.nsecsElapsed();
+		if ((best < 0) || (ns < best)) { best = ns; }
+	}
+	return best;
+}
+
+int main(int /*argc*/, char ** /*argv*/)
+{
+	QTextStream out(stdout);
+	out << "columns\tchars\ttokens\tscan ms\tparse ms\tscan ns/char"
+		<< "\tparse ns/char\n";
+
+	double firstScan = 0.0;
+	double firstParse = 0.0;
+	double lastScan = 0.0;
+	double lastParse = 0.0;
+	for (int columns = 500; columns <= 32000; columns *= 2)
+	{
+		QString sql(createTable(columns));
+		int tokens;
+		int fields;
+		qint64 scan = timeScan(sql, &tokens);
+		qint64 parse = timeParse(sql, &fields);
+		if (fields != columns)
+		{
+			out << "error: parsed " << fields << " of " << columns
+				<< " columns\n";
+			return 1;
+		}
+		lastScan = (double)scan / sql.length();
+		lastParse = (double)parse / sql.length();
+		if (firstScan == 0.0)
+		{
+			firstScan = lastScan;
+			firstParse = lastParse;
+		}
+		out << columns << "\t" << sql.length() << "\t" << tokens << "\t"
+			<< scan / 1000000.0 << "\t" << parse / 1000000.0 << "\t"
+			<< lastScan << "\t" << lastParse << "\n";
+	}
+
+	bool linear =    (lastScan <= firstScan * MAX_SLOWDOWN)
+				  && (lastParse <= firstParse * MAX_SLOWDOWN);
+	out << (linear ? "linear\n" : "NOT linear\n");
+	return linear ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = sqlparserbench
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QT += sql
+DEFINES += ICON_DIR=\\\"\\\" TRANSLATION_DIR=\\\"\\\"
+
+win32:CONFIG += console
+
+# Input
+SOURCES += sqlparserbench.cpp ../sqlparser.cpp ../utils.cpp
@@ -0,0 +1,272 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QRegExp>
+#include <QSettings>
+#include <QTextStream>
+
+#include <math.h>
+
+#include "benchmarkdialog.h"
+#include "litemanwindow.h"
+#include "utils.h"
+
+
+BenchmarkDialog::BenchmarkDialog(const QString & sql, LiteManWindow * parent)
+	: QDialog(parent),
+	  m_sql(sql),
+	  m_cancelled(false)
+{
+	creator = parent;
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("benchmark/height", QVariant(450)).toInt();
+	int ww = settings.value("benchmark/width", QVariant(600)).toInt();
+	resize(ww, hh);
+	ui.runsSpinBox->setValue(settings.value("benchmark/runs", 20).toInt());
+	ui.modeComboBox->setCurrentIndex(
+		settings.value("benchmark/mode", Warm).toInt());
+
+	ui.sqlLabel->setText(sql.simplified());
+	ui.exportButton->setEnabled(false);
+
+	connect(ui.runButton, SIGNAL(clicked()), this, SLOT(runButton_clicked()));
+	connect(ui.exportButton, SIGNAL(clicked()),
+			this, SLOT(exportButton_clicked()));
+}
+
+BenchmarkDialog::~BenchmarkDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("benchmark/height", QVariant(height()));
+	settings.setValue("benchmark/width", QVariant(width()));
+	settings.setValue("benchmark/runs", ui.runsSpinBox->value());
+	settings.setValue("benchmark/mode", ui.modeComboBox->currentIndex());
+}
+
+void BenchmarkDialog::showError(const QString & error)
+{
+	ui.summaryLabel->setText(tr("Benchmark failed")
+							 + ":<br/><span style=\" color:#ff0000;\">"
+							 + error + "<br/></span>");
+}
+
+bool BenchmarkDialog::runOnce(sqlite3 * handle, BenchmarkRun & run,
+							  QString * error)
+{
+	QByteArray sql(m_sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	QElapsedTimer timer;
+	timer.start();
+	int rc = sqlite3_prepare_v2(handle, sql.constData(), sql.size(),
+								&stmt, NULL);
+	qint64 ns = timer.nsecsElapsed();
+	if (rc != SQLITE_OK)
+	{
+		*error = QString::fromUtf8(sqlite3_errmsg(handle));
+		return false;
+	}
+	if (!stmt)
+	{
+		*error = tr("There is no statement to run");
+		return false;
+	}
+
+	// writes are undone after every run
+	bool writes = !sqlite3_stmt_readonly(stmt);
+	if (writes)
+	{
+		sqlite3_exec(handle, "SAVEPOINT BENCHMARK;", NULL, NULL, NULL);
+	}
+
+	run.rows = 0;
+	timer.restart();
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) { ++run.rows; }
+	if (writes) { run.rows = sqlite3_changes(handle); }
+#ifdef SQLITE_STMTSTATUS_VM_STEP
+	run.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+#else
+	run.vmSteps = -1;
+#endif
+	run.fullScanSteps =
+		sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+	run.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+	sqlite3_finalize(stmt);
+	ns += timer.nsecsElapsed();
+	run.ms = ns / 1000000.0;
+
+	if (rc != SQLITE_DONE)
+	{
+		*error = QString::fromUtf8(sqlite3_errmsg(handle));
+	}
+	if (writes)
+	{
+		sqlite3_exec(handle, "ROLLBACK TO BENCHMARK; RELEASE BENCHMARK;",
+					 NULL, NULL, NULL);
+	}
+	return rc == SQLITE_DONE;
+}
+
+void BenchmarkDialog::runButton_clicked()
+{
+	if (creator && !creator->checkForPending()) { return; }
+
+	// these would break the savepoint around writing statements
+	QRegExp txn("^\\s*(BEGIN|COMMIT|END|ROLLBACK|SAVEPOINT|RELEASE"
+				"|VACUUM|ATTACH|DETACH)\\b", Qt::CaseInsensitive);
+	if (txn.indexIn(m_sql) == 0)
+	{
+		showError(tr("%1 statements cannot be benchmarked")
+				  .arg(txn.cap(1).toUpper()));
+		return;
+	}
+
+	m_runs.clear();
+	m_cancelled = false;
+	int count = ui.runsSpinBox->value();
+	int mode = ui.modeComboBox->currentIndex();
+	sqlite3 * mainHandle = Database::sqlite3handle();
+	if (!mainHandle) { return; }
+
+	QProgressDialog progress(tr("Running benchmark"), tr("Cancel"),
+							 0, count, this);
+	progress.setWindowModality(Qt::WindowModal);
+	progress.setMinimumDuration(500);
+	connect(&progress, SIGNAL(canceled()), this, SLOT(cancel()));
+
+	QString error;
+	for (int i = 0; i < count; ++i)
+	{
+		sqlite3 * handle = mainHandle;
+		if (mode == NewConnection)
+		{
+			handle = Database::openConnection(false, &error);
+			if (!handle) { break; }
+		}
+		else if (mode == ReleaseMemory)
+		{
+			sqlite3_db_release_memory(handle);
+		}
+		BenchmarkRun run;
+		bool ok = runOnce(handle, run, &error);
+		if (mode == NewConnection) { sqlite3_close(handle); }
+		if (!ok) { break; }
+		m_runs.append(run);
+		progress.setValue(i + 1);
+		qApp->processEvents();
+		if (m_cancelled) { break; }
+	}
+	progress.reset();
+
+	showResults();
+	if (!error.isEmpty()) { showError(error); }
+}
+
+double BenchmarkDialog::percentile(const QList<double> & sorted, int p)
+{
+	if (sorted.isEmpty()) { return 0.0; }
+	// nearest rank
+	int rank = (int)ceil(p / 100.0 * sorted.count());
+	return sorted.at(qBound(0, rank - 1, sorted.count() - 1));
+}
+
+void BenchmarkDialog::showResults()
+{
+	ui.resultTable->clearContents();
+	ui.resultTable->setRowCount(m_runs.count());
+	QList<double> times;
+	double total = 0.0;
+	qint64 rows = 0;
+	qint64 steps = 0;
+	for (int i = 0; i < m_runs.count(); ++i)
+	{
+		const BenchmarkRun & run = m_runs.at(i);
+		QStringList cells;
+		cells << QString::number(i + 1)
+			  << QString::number(run.ms, 'f', 3)
+			  << QString::number(run.rows)
+			  << QString::number(run.vmSteps)
+			  << QString::number(run.fullScanSteps)
+			  << QString::number(run.sorts);
+		for (int j = 0; j < cells.count(); ++j)
+		{
+			QTableWidgetItem * item = new QTableWidgetItem(cells.at(j));
+			item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+			item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+			ui.resultTable->setItem(i, j, item);
+		}
+		times.append(run.ms);
+		total += run.ms;
+		rows += run.rows;
+		steps += run.vmSteps;
+	}
+	ui.resultTable->resizeColumnsToContents();
+	ui.exportButton->setEnabled(!m_runs.isEmpty());
+	if (m_runs.isEmpty())
+	{
+		ui.summaryLabel->clear();
+		return;
+	}
+
+	qSort(times);
+	QString text(tr("%1 runs. Min %2 ms, median %3 ms, p95 %4 ms, p99 %5 ms.")
+				 .arg(m_runs.count())
+				 .arg(times.first(), 0, 'f', 3)
+				 .arg(percentile(times, 50), 0, 'f', 3)
+				 .arg(percentile(times, 95), 0, 'f', 3)
+				 .arg(percentile(times, 99), 0, 'f', 3));
+	if (total > 0.0)
+	{
+		text += " " + tr("%1 rows/s.").arg(rows * 1000.0 / total, 0, 'f', 0);
+	}
+	if (m_runs.first().vmSteps >= 0)
+	{
+		text += " " + tr("%1 VM steps per run.").arg(steps / m_runs.count());
+	}
+	ui.summaryLabel->setText(text);
+}
+
+void BenchmarkDialog::exportButton_clicked()
+{
+	QString fileName = QFileDialog::getSaveFileName(this,
+		tr("Export Benchmark"), QDir::currentPath(),
+		tr("CSV file (*.csv);;All Files (*)"));
+	if (fileName.isNull()) { return; }
+
+	QFile f(fileName);
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		QMessageBox::warning(this, tr("Export Benchmark"),
+							 tr("Cannot open file %1 for writing")
+							 .arg(fileName));
+		return;
+	}
+	QTextStream out(&f);
+	out.setCodec("UTF-8");
+	QString statement(Utils::q(m_sql.simplified(), "\""));
+	QString mode(Utils::q(ui.modeComboBox->currentText(), "\""));
+	out << "statement,mode,run,ms,rows,vm_steps,fullscan_steps,sorts\n";
+	for (int i = 0; i < m_runs.count(); ++i)
+	{
+		const BenchmarkRun & run = m_runs.at(i);
+		out << statement << "," << mode << "," << (i + 1) << ","
+			<< QString::number(run.ms, 'f', 3) << "," << run.rows << ","
+			<< run.vmSteps << "," << run.fullScanSteps << ","
+			<< run.sorts << "\n";
+	}
+}
+
+void BenchmarkDialog::cancel()
+{
+	m_cancelled = true;
+}
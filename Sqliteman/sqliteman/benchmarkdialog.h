@@ -0,0 +1,80 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef BENCHMARKDIALOG_H
+#define BENCHMARKDIALOG_H
+
+#include <QDialog>
+
+#include "database.h"
+#include "ui_benchmarkdialog.h"
+
+class LiteManWindow;
+
+
+/*! \brief Result of one benchmark run.
+*/
+typedef struct
+{
+	double ms;
+	int rows;
+	int vmSteps;
+	int fullScanSteps;
+	int sorts;
+}
+BenchmarkRun;
+
+
+/*! \brief Repeatable micro-benchmark of a single statement.
+The statement is prepared, stepped to completion and finalized N times
+with the sqlite3 API directly, so no model is built and no rows are
+kept. Statements which write are run inside a savepoint which is rolled
+back after every run.
+Runs can be warm (the connection's page cache is kept), cold (the cache
+is released with sqlite3_db_release_memory before every run) or on a
+new connection for every run.
+*/
+class BenchmarkDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		BenchmarkDialog(const QString & sql, LiteManWindow * parent = 0);
+		~BenchmarkDialog();
+
+	private:
+		enum Mode
+		{
+			Warm = 0,
+			ReleaseMemory,
+			NewConnection
+		};
+
+		Ui::BenchmarkDialog ui;
+
+		QString m_sql;
+		QList<BenchmarkRun> m_runs;
+		bool m_cancelled;
+
+		// We ought to be able use use parent() for this, but for some reason
+		// qobject_cast<LiteManWindow*>(parent()) doesn't work
+		LiteManWindow * creator;
+
+		//! \brief Run the statement once on handle.
+		bool runOnce(sqlite3 * handle, BenchmarkRun & run, QString * error);
+		//! \brief Value at percentile p (0-100) of the sorted timings.
+		static double percentile(const QList<double> & sorted, int p);
+		void showResults();
+		void showError(const QString & error);
+
+	private slots:
+		void runButton_clicked();
+		void exportButton_clicked();
+		void cancel();
+};
+
+#endif
@@ -8,6 +8,7 @@ for which a new license (GPL+exception) is in place.
 #include <QFile>
 
 #include "blobpreviewwidget.h"
+#include "utils.h"
 
 
 BlobPreviewWidget::BlobPreviewWidget(QWidget * parent)
@@ -44,7 +45,7 @@ void BlobPreviewWidget::createPreview()
 		}
 		else
 			m_blobPreview->setPixmap(pm);
-	m_blobSize->setText(formatSize(m_data.size()));
+	m_blobSize->setText(Utils::formatSize(m_data.size()));
 	}
 }
 
@@ -65,20 +66,3 @@ void BlobPreviewWidget::resizeEvent(QResizeEvent * event)
 	createPreview();
 	QWidget::resizeEvent(event);
 }
-
-QString BlobPreviewWidget::formatSize(qulonglong size/*, bool persec*/)
-{
-	QString rval;
-
-	if(size < 1024)
-		rval = QString("%L1 B").arg(size);
-	else if(size < 1024*1024)
-		rval = QString("%L1 KB").arg(size/1024);
-	else if(size < 1024*1024*1024)
-		rval = QString("%L1 MB").arg(double(size)/1024.0/1024.0, 0, 'f', 1);
-	else
-		rval = QString("%L1 GB").arg(double(size)/1024.0/1024.0/1024.0, 0, 'f', 1);
-
-// 	if(persec) rval += "/s";
-	return rval;
-}
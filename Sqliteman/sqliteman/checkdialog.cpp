@@ -0,0 +1,176 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QElapsedTimer>
+#include <QPushButton>
+#include <QSettings>
+
+#include "checkdialog.h"
+#include "database.h"
+#include "databasechecker.h"
+
+// first sqlite version checking the integrity of a single table
+#define TABLE_CHECK_VERSION 3033000
+// rows listed below a foreign key group, the others are only counted
+#define GROUP_ROWS 1000
+
+// columns of the foreign key groups
+#define GROUP_COLUMNS 1
+#define GROUP_VIOLATIONS 2
+#define GROUP_INDEX 3
+
+
+CheckDialog::CheckDialog(QWidget * parent)
+	: QDialog(parent)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("check/height", QVariant(600)).toInt();
+	int ww = settings.value("check/width", QVariant(600)).toInt();
+	resize(ww, hh);
+	m_sqliteVersion = Database::sqliteVersion();
+
+	m_checkButton =
+		ui.buttonBox->addButton(tr("&Check"), QDialogButtonBox::ApplyRole);
+
+	connect(ui.schemaCombo, SIGNAL(currentIndexChanged(const QString &)),
+			this, SLOT(schemaCombo_currentIndexChanged(const QString &)));
+	connect(ui.checkCombo, SIGNAL(currentIndexChanged(int)),
+			this, SLOT(checkCombo_currentIndexChanged(int)));
+	connect(m_checkButton, SIGNAL(clicked()), this, SLOT(checkButton_clicked()));
+
+	ui.schemaCombo->addItems(Database::getDatabases().keys());
+	ui.schemaCombo->setCurrentIndex(ui.schemaCombo->findText("main"));
+	ui.checkCombo->setCurrentIndex(settings.value("check/mode", 0).toInt());
+	checkCombo_currentIndexChanged(ui.checkCombo->currentIndex());
+}
+
+CheckDialog::~CheckDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("check/height", QVariant(height()));
+	settings.setValue("check/width", QVariant(width()));
+	settings.setValue("check/mode", ui.checkCombo->currentIndex());
+}
+
+void CheckDialog::schemaCombo_currentIndexChanged(const QString & schema)
+{
+	ui.tableList->clear();
+	if (!schema.isEmpty())
+		ui.tableList->addItems(Database::getObjects("table", schema).keys());
+}
+
+void CheckDialog::checkCombo_currentIndexChanged(int index)
+{
+	bool perTable = (index == DatabaseChecker::ForeignKeyCheck)
+					|| (m_sqliteVersion >= TABLE_CHECK_VERSION);
+	ui.tableList->setEnabled(perTable);
+	ui.tableLabel->setEnabled(perTable);
+}
+
+QTreeWidgetItem * CheckDialog::group(const QString & table,
+									 const QString & parent,
+									 const QString & columns)
+{
+	QString key(table + "\n" + parent + "\n" + columns);
+	QTreeWidgetItem * item = m_groups.value(key);
+	if (!item)
+	{
+		item = new QTreeWidgetItem(ui.resultTree);
+		item->setText(0, QString("%1 -> %2").arg(table, parent));
+		item->setText(GROUP_COLUMNS, columns);
+		item->setText(GROUP_VIOLATIONS, "0");
+		item->setTextAlignment(GROUP_VIOLATIONS,
+							   Qt::AlignRight | Qt::AlignVCenter);
+		m_groups.insert(key, item);
+	}
+	return item;
+}
+
+void CheckDialog::problem(QString object, QString message)
+{
+	QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultTree);
+	item->setText(0, object);
+	item->setText(1, message);
+	item->setToolTip(1, message);
+}
+
+void CheckDialog::violation(QString table, QString parent, QString columns,
+							qlonglong rowid)
+{
+	QTreeWidgetItem * item = group(table, parent, columns);
+	int count = item->text(GROUP_VIOLATIONS).toInt() + 1;
+	item->setText(GROUP_VIOLATIONS, QString::number(count));
+	if (count <= GROUP_ROWS)
+	{
+		QTreeWidgetItem * row = new QTreeWidgetItem(item);
+		row->setText(0, tr("rowid %1").arg(rowid));
+	}
+}
+
+void CheckDialog::unindexed(QString table, QString parent, QString columns)
+{
+	QTreeWidgetItem * item = group(table, parent, columns);
+	item->setText(GROUP_INDEX, tr("missing"));
+	item->setForeground(GROUP_INDEX, Qt::red);
+	item->setToolTip(GROUP_INDEX,
+		tr("No index of %1 starts with %2, so every change of a key in %3 "
+		   "scans the whole %1.").arg(table, columns, parent));
+}
+
+void CheckDialog::checkButton_clicked()
+{
+	DatabaseChecker::Mode mode =
+		(DatabaseChecker::Mode)ui.checkCombo->currentIndex();
+	QString schema(ui.schemaCombo->currentText());
+
+	ui.resultTree->clear();
+	ui.resultLabel->clear();
+	m_groups.clear();
+	if (mode == DatabaseChecker::ForeignKeyCheck)
+	{
+		ui.resultTree->setColumnCount(4);
+		ui.resultTree->setHeaderLabels(QStringList()
+			<< tr("Child -> Parent") << tr("Child Columns")
+			<< tr("Violations") << tr("Index"));
+	}
+	else
+	{
+		ui.resultTree->setColumnCount(2);
+		ui.resultTree->setHeaderLabels(QStringList() << tr("Object")
+													 << tr("Problem"));
+	}
+
+	DatabaseChecker checker(schema, mode, this);
+	if (ui.tableList->isEnabled())
+	{
+		foreach (QListWidgetItem * item, ui.tableList->selectedItems())
+			checker.addTable(item->text());
+	}
+	connect(&checker, SIGNAL(problem(QString, QString)),
+			this, SLOT(problem(QString, QString)));
+	connect(&checker, SIGNAL(violation(QString, QString, QString, qlonglong)),
+			this, SLOT(violation(QString, QString, QString, qlonglong)));
+	connect(&checker, SIGNAL(unindexed(QString, QString, QString)),
+			this, SLOT(unindexed(QString, QString, QString)));
+	QElapsedTimer timer;
+	timer.start();
+	checker.runWithProgress(tr("Checking %1").arg(schema), this);
+
+	for (int i = 0; i < ui.resultTree->columnCount(); ++i)
+		ui.resultTree->resizeColumnToContents(i);
+	QString result((checker.findings() == 0)
+				   ? tr("No problems found in %1 s.")
+				   : tr("%1 findings in %2 s.").arg(checker.findings()));
+	result = result.arg(timer.elapsed() / 1000.0, 0, 'f', 1);
+	if (!checker.errorMessage().isEmpty())
+	{
+		result += "<br/><span style=\" color:#ff0000;\">"
+				  + checker.errorMessage() + "<br/></span>";
+	}
+	ui.resultLabel->setText(result);
+}
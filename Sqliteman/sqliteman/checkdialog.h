@@ -0,0 +1,52 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef CHECKDIALOG_H
+#define CHECKDIALOG_H
+
+#include <qdialog.h>
+
+#include "ui_checkdialog.h"
+
+class QPushButton;
+
+
+/*! \brief Integrity, quick and foreign key checks of a database.
+The check runs in a DatabaseChecker and its findings are added to the
+result tree as they come. Foreign key violations are grouped by child
+table, parent table and child columns, and foreign keys without an index
+on their child columns are flagged in the same groups.
+*/
+class CheckDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		CheckDialog(QWidget * parent = 0);
+		~CheckDialog();
+
+	private:
+		Ui::CheckDialog ui;
+		QPushButton * m_checkButton;
+		//! \brief foreign key groups by "table\nparent\ncolumns"
+		QMap<QString,QTreeWidgetItem *> m_groups;
+		int m_sqliteVersion;
+
+		QTreeWidgetItem * group(const QString & table, const QString & parent,
+								const QString & columns);
+
+	private slots:
+		void schemaCombo_currentIndexChanged(const QString & schema);
+		void checkCombo_currentIndexChanged(int index);
+		void checkButton_clicked();
+		void problem(QString object, QString message);
+		void violation(QString table, QString parent, QString columns,
+					   qlonglong rowid);
+		void unindexed(QString table, QString parent, QString columns);
+};
+
+#endif
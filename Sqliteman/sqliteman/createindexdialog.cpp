@@ -13,13 +13,21 @@ for which a new license (GPL+exception) is in place.
 
 #include "createindexdialog.h"
 #include "database.h"
+#include "indexbuilder.h"
 #include "utils.h"
 
+// leaf pages and rows read to estimate the index size
+#define SAMPLE_PAGES 64
+#define SAMPLE_ROWS 1000
+// part of an index page holding entries
+#define INDEX_FILL 0.9
+
 
 CreateIndexDialog::CreateIndexDialog(const QString & tabName,
 									 const QString & schema,
 									 LiteManWindow * parent)
-	: QDialog(parent), m_schema(schema), m_table(tabName)
+	: QDialog(parent), m_schema(schema), m_table(tabName),
+	  m_sampled(false), m_rows(-1), m_rowsPerPage(0)
 {
 	creator = parent;
 	update = false;
@@ -48,6 +56,7 @@ CreateIndexDialog::CreateIndexDialog(const QString & tabName,
 		asc->setEnabled(false);
 		ui.tableColumns->setCellWidget(i, 2, asc);
 	}
+
 	QSettings settings("yarpen.cz", "sqliteman");
 	int hh = settings.value("createindex/height", QVariant(500)).toInt();
 	resize(width(), hh);
@@ -95,13 +104,22 @@ void CreateIndexDialog::createButton_clicked()
 					  + cols.join(", ")
 					  + ");";
 
-		QSqlQuery q(sql, QSqlDatabase::database(SESSION_NAME));
-		if(q.lastError().isValid())
+		qlonglong pages = (m_rowsPerPage > 0)
+						  ? (qlonglong)(m_rows / m_rowsPerPage) : 0;
+		IndexBuilder builder(sql, m_schema, pages, this);
+		builder.runWithProgress(tr("Creating index ")
+								+ ui.indexNameEdit->text(), this);
+		if (builder.isCancelled())
+		{
+			resultAppend(tr("Index creation cancelled."));
+			return;
+		}
+		if (!builder.errorMessage().isEmpty())
 		{
 			resultAppend(tr("Error while creating index ")
 						 + ui.indexNameEdit->text()
 						 + ":<br/><span style=\" color:#ff0000;\">"
-						 + q.lastError().text()
+						 + builder.errorMessage()
 						 + "<br/></span>" + tr("using sql statement:")
 						 + "<br/><tt>" + sql);
 			return;
@@ -111,6 +129,82 @@ void CreateIndexDialog::createButton_clicked()
 	}
 }
 
+void CreateIndexDialog::sampleTable()
+{
+	m_sampled = true;
+	int columns = ui.tableColumns->rowCount();
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	m_rows = Database::rowEstimate(m_table, m_schema);
+	m_rowsPerPage = 0;
+	m_widths.fill(0, columns);
+	if (m_rows <= 0) { return; }
+
+	// dbstat walks the pages lazily, so the LIMIT keeps it short
+	QSqlQuery query(QString("SELECT sum(ncell), count(*) FROM "
+							"(SELECT ncell FROM dbstat(%1) WHERE name = %2 "
+							"AND pagetype = 'leaf' LIMIT %3);")
+					.arg(Utils::q(m_schema, "'"), Utils::q(m_table, "'"))
+					.arg(SAMPLE_PAGES), db);
+	if (query.next() && (query.value(1).toInt() > 0))
+	{
+		m_rowsPerPage = query.value(0).toDouble() / query.value(1).toInt();
+	}
+
+	// the size each column takes in a record
+	QStringList widths;
+	for (int i = 0; i < columns; ++i)
+	{
+		widths.append(QString("avg(CASE typeof(%1) WHEN 'null' THEN 0 "
+							  "WHEN 'integer' THEN 4 WHEN 'real' THEN 8 "
+							  "ELSE length(CAST(%1 AS BLOB)) END)")
+					  .arg(Utils::q(ui.tableColumns->item(i, 0)->text())));
+	}
+	query.exec(QString("SELECT %1 FROM (SELECT * FROM %2.%3 LIMIT %4);")
+			   .arg(widths.join(", "), Utils::q(m_schema), Utils::q(m_table))
+			   .arg(SAMPLE_ROWS));
+	if (query.next())
+	{
+		for (int i = 0; i < columns; ++i)
+		{
+			m_widths[i] = query.value(i).toDouble();
+		}
+	}
+}
+
+void CreateIndexDialog::showEstimate()
+{
+	QList<int> checked;
+	for (int i = 0; i < ui.tableColumns->rowCount(); ++i)
+	{
+		if (ui.tableColumns->item(i, 1)->checkState() == Qt::Checked)
+			checked.append(i);
+	}
+	if (checked.isEmpty())
+	{
+		ui.estimateLabel->clear();
+		return;
+	}
+	if (!m_sampled) { sampleTable(); }
+	double entry = 0;
+	int n = checked.count();
+	foreach (int i, checked)
+		entry += m_widths.value(i);
+	if (m_rows < 0)
+	{
+		ui.estimateLabel->setText(
+			tr("The size of the index is unknown: the table has "
+			   "no rowid and no statistics from ANALYZE."));
+		return;
+	}
+	// record header, rowid and the cell's size and pointer
+	entry += n + 2 + 4 + 4;
+	qulonglong size = (qulonglong)(m_rows * entry / INDEX_FILL);
+	ui.estimateLabel->setText(tr("Estimated index size: %1 "
+								 "(about %2 rows of %3 bytes)")
+							  .arg(Utils::formatSize(size))
+							  .arg(m_rows).arg(qRound(entry)));
+}
+
 void CreateIndexDialog::tableColumns_itemChanged(QTableWidgetItem* item)
 {
 	int r = item->row();
@@ -138,6 +232,7 @@ void CreateIndexDialog::checkToEnable()
 		}
 	}
 	ui.createButton->setEnabled(nameTest && columnTest);
+	showEstimate();
 }
 
 void CreateIndexDialog::resultAppend(QString text)
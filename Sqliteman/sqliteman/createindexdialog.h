@@ -37,7 +37,23 @@ class CreateIndexDialog : public QDialog
 		Ui::CreateIndexDialog ui;
 		QString m_schema;
 		QString m_table;
+		bool m_sampled;
+		//! \brief rows of the table, -1 if unknown
+		qlonglong m_rows;
+		//! \brief rows per leaf page from dbstat, 0 if not available
+		double m_rowsPerPage;
+		//! \brief average stored width of each column in bytes
+		QVector<double> m_widths;
 
+		/*! \brief Sample the table for showEstimate().
+		Rows per page come from the first leaf pages in dbstat (if sqlite
+		has it), the column widths from the first rows of the table.
+		It runs when the first column is chosen, not when the dialog
+		opens, so opening it does not read the table.
+		*/
+		void sampleTable();
+		//! \brief Show the estimated size of the index.
+		void showEstimate();
 		void checkToEnable();
 		void resultAppend(QString text);
 		bool resizeWanted;
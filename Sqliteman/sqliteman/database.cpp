@@ -16,11 +16,25 @@ for which a new license (GPL+exception) is in place.
 
 #include "database.h"
 #include "preferences.h"
+#include "schemacatalog.h"
 #include "sqlparser.h"
 #include "utils.h"
 
+bool Database::m_batchMode = false;
+
+void Database::setBatchMode(bool batch)
+{
+	m_batchMode = batch;
+}
+
 void Database::exception(const QString & message)
 {
+	if (m_batchMode)
+	{
+		QTextStream cerr(stderr, QIODevice::WriteOnly);
+		cerr << tr("SQL Error") << ": " << message << "\n";
+		return;
+	}
 	QMessageBox::critical(0, tr("SQL Error"), message);
 }
 
@@ -58,26 +72,17 @@ DbAttach Database::getDatabases()
 
 SqlParser * Database::parseTable(const QString & table, const QString & schema)
 {
-	// Build a query string to SELECT the CREATE statement from sqlite_master
-	QString createSQL = QString("SELECT sql FROM ")
-						+ getMaster(schema)
-						+ " WHERE lower(name) = "
-						+ Utils::q(table.toLower())
-						+ ";";
-	// Run the query
-
-	QSqlQuery createQuery(createSQL, QSqlDatabase::database(SESSION_NAME));
-	// Make sure the query ran successfully
-	if(createQuery.lastError().isValid()) {
+	// The CREATE statement comes from the cached sqlite_master
+	QString error;
+	QString createStatement =
+		SchemaCatalog::instance()->objectSql(table, schema, &error);
+	if (!error.isEmpty())
+	{
 		exception(tr("Error grabbing CREATE statement: ")
 				  + table
 				  + ": "
-				  + createQuery.lastError().text());
+				  + error);
 	}
-	// Position the Query on the first (only) result
-	createQuery.first();
-	// Grab the complete CREATE statement
-	QString createStatement = createQuery.value(0).toString();
 
 	// Parse the CREATE statement
 	return new SqlParser(createStatement);
@@ -85,11 +90,20 @@ SqlParser * Database::parseTable(const QString & table, const QString & schema)
 
 QList<FieldInfo> Database::tableFields(const QString & table, const QString & schema)
 {
-	SqlParser * parser = parseTable(table, schema);
-	QList<FieldInfo> result(parser->m_fields);
-	delete parser;
+	// parsed once per table and schema version
+	QString error;
+	QList<FieldInfo> result =
+		SchemaCatalog::instance()->fields(table, schema, &error);
+	if (!error.isEmpty())
+	{
+		exception(tr("Error grabbing CREATE statement: ")
+				  + table
+				  + ": "
+				  + error);
+	}
 	return result;
 }
+
 QStringList Database::indexFields(const QString & index, const QString &schema)
 {
 	QString sql = QString("PRAGMA ")
@@ -117,59 +131,30 @@ QStringList Database::indexFields(const QString & index, const QString &schema)
 
 DbObjects Database::getObjects(const QString type, const QString schema)
 {
-	DbObjects objs;
-
-	QString sql;
-	if (type.isNull())
+	QString error;
+	const SchemaSnapshot * snapshot =
+		SchemaCatalog::instance()->snapshot(schema, &error);
+	if (!snapshot)
 	{
-        sql = QString("SELECT name, tbl_name FROM ")
-			  + getMaster(schema)
-			  + ";";
-	}
-	else
-	{
-        sql = QString("SELECT name, tbl_name FROM ")
-			  + getMaster(schema)
-			  + " WHERE lower(type) = "
-			  + Utils::q(type.toLower())
-			  + " and name not like 'sqlite_%';";
-	}
-
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
-	while(query.next())
-		objs.insertMulti(query.value(1).toString(), query.value(0).toString());
-
-	if(query.lastError().isValid())
 		exception(tr("Error getting the list of ")
 				  + type
 				  + ": "
-				  + query.lastError().text());
+				  + error);
+		return DbObjects();
+	}
 
-	return objs;
+	if (type.isNull())
+		return snapshot->all;
+	return snapshot->byType.value(type.toLower());
 }
 
 QStringList Database::getSysIndexes(const QString & table, const QString & schema)
 {
-	QStringList orig = Database::getObjects("index", schema).values(table);
-	// really all indexes
-	QStringList sysIx;
-	QSqlQuery query(QString("PRAGMA ")
-					+ Utils::q(schema)
-					+ ".index_list("
-					+ Utils::q(table)
-					+ ");", QSqlDatabase::database(SESSION_NAME));
-
-	QString curr;
-	while(query.next())
-	{
-		curr = query.value(1).toString();
-		if (!orig.contains(curr))
-			sysIx.append(curr);
-	}
-
-	if(query.lastError().isValid())
-		exception(tr("Error getting the list of indexes: ")
-				  + query.lastError().text());
+	QString error;
+	QStringList sysIx =
+		SchemaCatalog::instance()->sysIndexes(table, schema, &error);
+	if (!error.isEmpty())
+		exception(tr("Error getting the list of indexes: ") + error);
 
 	return sysIx;
 }
@@ -178,10 +163,9 @@ DbObjects Database::getSysObjects(const QString & schema)
 {
 	DbObjects objs;
 
-    QSqlQuery query(QString("SELECT name, tbl_name FROM %1 "
-							"WHERE type = 'table' and name like 'sqlite_%';")
-					.arg(getMaster(schema)),
-					QSqlDatabase::database(SESSION_NAME));
+	QString error;
+	const SchemaSnapshot * snapshot =
+		SchemaCatalog::instance()->snapshot(schema, &error);
 
 	if (schema.compare("temp", Qt::CaseInsensitive))
 	{
@@ -191,11 +175,10 @@ DbObjects Database::getSysObjects(const QString & schema)
 	{
 		objs.insert("sqlite_temp_master", "");
 	}
-	while(query.next())
-		objs.insertMulti(query.value(1).toString(), query.value(0).toString());
-
-	if(query.lastError().isValid())
-		exception(tr("Error getting the system catalogue: %1.").arg(query.lastError().text()));
+	if (snapshot)
+		objs.unite(snapshot->sys);
+	else
+		exception(tr("Error getting the system catalogue: %1.").arg(error));
 
 	return objs;
 }
@@ -292,7 +275,13 @@ bool Database::dumpDatabase(const QString & fileName)
 	}
 
 	QTextStream stream(&file);
-	
+	bool result = dumpDatabase(stream);
+	file.close();
+	return result;
+}
+
+bool Database::dumpDatabase(QTextStream & stream)
+{
 	// Run query for whole schema
 	QString sql = "SELECT sql FROM sqlite_master;";
 	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
@@ -331,7 +320,10 @@ bool Database::dumpDatabase(const QString & fileName)
         QString tablename = q1.value(0).toString();
         sql = "SELECT * FROM ";
         sql.append(Utils::q(tablename)).append(";");
-        QSqlQuery q2(sql, QSqlDatabase::database(SESSION_NAME));
+        // forward only, so the rows are not cached while dumping
+        QSqlQuery q2(QSqlDatabase::database(SESSION_NAME));
+        q2.setForwardOnly(true);
+        q2.exec(sql);
         if (q2.lastError().isValid())
         {
             exception(tr(
@@ -380,8 +372,7 @@ bool Database::dumpDatabase(const QString & fileName)
         }
     }
 	stream << "COMMIT;\n";
-	
-	file.close();
+	stream.flush();
 	return true;
 }
 
@@ -558,6 +549,52 @@ QString Database::getTempName(const QString & schema)
 	return QString("tmpname_%1").arg(i);
 }
 
+qlonglong Database::rowEstimate(const QString & table, const QString & schema)
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	// sqlite_stat1 has the row count of the last ANALYZE, and max(rowid)
+	// reads a single path down the table
+	QSqlQuery query(QString("SELECT stat FROM %1.sqlite_stat1 "
+							"WHERE tbl = %2 LIMIT 1;")
+					.arg(Utils::q(schema), Utils::q(table, "'")), db);
+	if (query.next())
+	{
+		return query.value(0).toString().section(' ', 0, 0).toLongLong();
+	}
+	query.exec(QString("SELECT max(rowid) FROM %1.%2;")
+			   .arg(Utils::q(schema), Utils::q(table)));
+	if (query.next())
+	{
+		return query.value(0).toLongLong();
+	}
+	return -1;
+}
+
+int Database::sqliteVersion()
+{
+	// the Qt driver may be built with its own copy of the library, so
+	// sqlite3_libversion_number() could tell about another one
+	QSqlQuery query("select sqlite_version();",
+					QSqlDatabase::database(SESSION_NAME));
+	if (!query.next())
+		return 0;
+	QStringList v(query.value(0).toString().split('.'));
+	return   v.value(0).toInt() * 1000000
+		   + v.value(1).toInt() * 1000
+		   + v.value(2).toInt();
+}
+
+void Database::optimize()
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME, false));
+	if (!db.isOpen() || !Preferences::instance()->optimizeOnClose())
+		return;
+	QSqlQuery query(db);
+	// the limit sqlite suggests for optimize, it keeps big tables quick
+	query.exec("PRAGMA analysis_limit = 400;");
+	query.exec("PRAGMA optimize;");
+}
+
 bool Database::isAutoCommit()
 {
     // can't use sqlite3handle() because there may be no database open
@@ -695,9 +732,9 @@ extern "C" int do_localized_case(void * unused, int n1, const void *v1,
 	return s1.localeAwareCompare(s2);
 }
 
-int Database::makeUserFunctions()
+int Database::makeUserFunctions(sqlite3 * handle)
 {
-	sqlite3 * handle = sqlite3handle();
+	if (!handle) { handle = sqlite3handle(); }
 	int res = sqlite3_create_function(
 		handle, "exec", 2, SQLITE_UTF8, NULL, do_exec, NULL, NULL);
 	if (res != SQLITE_OK) { return res; }
@@ -707,3 +744,60 @@ int Database::makeUserFunctions()
 	return sqlite3_create_collation(
 		handle, "LOCALIZED_CASE", SQLITE_UTF16, NULL, do_localized_case);
 }
+
+bool Database::canOpenConnection(const QString & schema)
+{
+	// openConnection() opens the main file and attaches the others
+	DbAttach dbs(getDatabases());
+	return    (schema != "temp") && !dbs.value(schema).isEmpty()
+		   && !dbs.value("main").isEmpty();
+}
+
+sqlite3 * Database::openConnection(bool readOnly, QString * error)
+{
+	QString fileName(QSqlDatabase::database(SESSION_NAME).databaseName());
+	if (fileName.isEmpty() || (fileName == ":memory:"))
+	{
+		*error = tr("An in-memory database cannot be opened twice");
+		return 0;
+	}
+	sqlite3 * handle = 0;
+	int rc = sqlite3_open_v2(fileName.toUtf8().data(), &handle,
+							 readOnly ? SQLITE_OPEN_READONLY
+									  : SQLITE_OPEN_READWRITE,
+							 NULL);
+	if (rc != SQLITE_OK)
+	{
+		*error = handle ? QString::fromUtf8(sqlite3_errmsg(handle))
+						: tr("Out of memory");
+		sqlite3_close(handle);
+		return 0;
+	}
+	sqlite3_busy_timeout(handle, 5000);
+	makeUserFunctions(handle);
+
+	DbAttach dbs(getDatabases());
+	QMapIterator<QString,QString> it(dbs);
+	while (it.hasNext())
+	{
+		it.next();
+		if (   (it.key() == "main") || (it.key() == "temp")
+			|| it.value().isEmpty())
+		{
+			continue;
+		}
+		QString attach(QString("ATTACH DATABASE %1 AS %2;")
+					   .arg(Utils::q(it.value(), "'"))
+					   .arg(Utils::q(it.key())));
+		char * zErr = 0;
+		if (sqlite3_exec(handle, attach.toUtf8().data(), NULL, NULL, &zErr)
+			!= SQLITE_OK)
+		{
+			*error = QString::fromUtf8(zErr);
+			sqlite3_free(zErr);
+			sqlite3_close(handle);
+			return 0;
+		}
+	}
+	return handle;
+}
@@ -11,6 +11,7 @@ for which a new license (GPL+exception) is in place.
 #include <QCoreApplication>
 #include <QSqlDatabase>
 #include <QStringList>
+#include <QTextStream>
 
 #include "sqlite3.h"
 #include "sqlparser.h"
@@ -157,6 +158,11 @@ class Database
 		static bool exportSql(const QString & fileName);
 
 		static bool dumpDatabase(const QString & fileName);
+		/*! \brief Dump schema and data of the main database to stream.
+		Table rows are read forward only, so memory use does not grow
+		with the size of the tables.
+		*/
+		static bool dumpDatabase(QTextStream & stream);
 
 		static QString describeObject(const QString & name,
 									  const QString & schema,
@@ -193,12 +199,61 @@ class Database
 		// get a name which isn't already in use
 		static QString getTempName(const QString & schema);
 
+		/*! \brief Cheap guess of the number of rows of a table.
+		It uses sqlite_stat1 of the last ANALYZE or else max(rowid),
+		so the table is never scanned.
+		\retval qlonglong -1 if unknown (no statistics and WITHOUT ROWID)
+		*/
+		static qlonglong rowEstimate(const QString & table,
+									 const QString & schema);
+
+		/*! \brief Version of the sqlite library behind the connection.
+		\retval int like SQLITE_VERSION_NUMBER, 0 if no database is open
+		*/
+		static int sqliteVersion();
+
+		/*! \brief Refresh the statistics sqlite thinks are stale.
+		Runs PRAGMA optimize with a sampling analysis_limit when the
+		preferences ask for it; called before the database is closed.
+		Errors are ignored, e.g. for read only files.
+		*/
+		static void optimize();
+
 		// are we in autocommit mode = !(did the sql editor do a BEGIN)?
 		static bool isAutoCommit();
 
-		static int makeUserFunctions();
+		/*! \brief Register Sqliteman's SQL functions and collations.
+		\param handle a connection; the main one when it is 0
+		\retval int sqlite3 result code
+		*/
+		static int makeUserFunctions(sqlite3 * handle = 0);
+
+		/*! \brief Open a new sqlite3 connection to the current database.
+		The connection gets the same user functions, collations and
+		attached databases as the main one, but it does not see the main
+		connection's temp schema or uncommitted changes.
+		Call it from the GUI thread; the handle can then be used by one
+		worker thread. The caller closes it with sqlite3_close().
+		\param readOnly open the database read only
+		\param error set to the error message on failure
+		\retval sqlite3* handle or 0 on error.
+		*/
+		static sqlite3 * openConnection(bool readOnly, QString * error);
+
+		/*! \brief Whether schema can be read on another connection.
+		Connections from openConnection() see neither the temp schema
+		nor in-memory databases, so work on those has to stay on the
+		main connection.
+		*/
+		static bool canOpenConnection(const QString & schema);
+
+		/*! \brief Report errors on stderr instead of message boxes.
+		Used by the command line batch mode, which runs without widgets.
+		*/
+		static void setBatchMode(bool batch);
 
 	private:
+		static bool m_batchMode;
 		//! \brief Error feedback to the user.
 		static void exception(const QString & message);
 };
@@ -0,0 +1,148 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QFile>
+#include <QFileInfo>
+
+#include "databasebackup.h"
+#include "utils.h"
+
+// milliseconds between two looks at the size of the new file
+#define SIZE_INTERVAL 200
+// milliseconds between two label updates
+#define LABEL_INTERVAL 500
+// milliseconds to wait at least when the source is busy or locked
+#define BUSY_SLEEP 10
+
+
+DatabaseBackup::DatabaseBackup(sqlite3 * handle, const QString & schema,
+							   const QString & fileName, QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_schema(schema),
+	  m_fileName(fileName),
+	  m_pages(-1),
+	  m_sleep(0),
+	  m_vacuum(false),
+	  m_pageCount(0),
+	  m_expectedSize(0)
+{
+	useOwnConnection(schema, false);
+}
+
+void DatabaseBackup::setSteps(int pages, int sleep)
+{
+	m_pages = (pages > 0) ? pages : -1;
+	m_sleep = qMax(sleep, 0);
+}
+
+int DatabaseBackup::progressHandler(void * worker)
+{
+	DatabaseBackup * self = (DatabaseBackup *)worker;
+	if (   (self->m_expectedSize > 0)
+		&& (self->m_sizeTimer.elapsed() >= SIZE_INTERVAL))
+	{
+		self->m_sizeTimer.restart();
+		qint64 size = QFileInfo(self->m_fileName).size();
+		self->reportProgress(qMin(size, self->m_expectedSize),
+							 self->m_expectedSize);
+	}
+	return self->isCancelled() ? 1 : 0;
+}
+
+void DatabaseBackup::backup()
+{
+	sqlite3 * dest = 0;
+	QByteArray fileName(m_fileName.toUtf8());
+	if (sqlite3_open_v2(fileName.constData(), &dest,
+						SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL)
+		!= SQLITE_OK)
+	{
+		m_error = dest ? QString::fromUtf8(sqlite3_errmsg(dest))
+					   : tr("Cannot open %1").arg(m_fileName);
+		sqlite3_close(dest);
+		return;
+	}
+
+	QByteArray schema(m_schema.toUtf8());
+	sqlite3_backup * backup =
+		sqlite3_backup_init(dest, "main", m_handle, schema.constData());
+	if (!backup)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(dest));
+		sqlite3_close(dest);
+		return;
+	}
+
+	QElapsedTimer labelTimer;
+	labelTimer.start();
+	int rc;
+	do
+	{
+		rc = sqlite3_backup_step(backup, m_pages);
+		// both are only known after the first step, and the page count
+		// changes when another connection writes to the source
+		m_pageCount = sqlite3_backup_pagecount(backup);
+		int done = m_pageCount - sqlite3_backup_remaining(backup);
+		reportProgress(done, m_pageCount);
+		if (labelTimer.elapsed() >= LABEL_INTERVAL)
+		{
+			labelTimer.restart();
+			emit label(tr("Copied %1 of %2 pages").arg(done).arg(m_pageCount));
+		}
+		// lets other processes write; a write to the source makes
+		// the next step start over
+		if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+			msleep(qMax(m_sleep, BUSY_SLEEP));
+		else if ((rc == SQLITE_OK) && (m_sleep > 0))
+			msleep(m_sleep);
+	} while (   (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+			 && !isCancelled());
+
+	// an unfinished backup is rolled back in the destination, and the
+	// error of the copy is left on its connection
+	sqlite3_backup_finish(backup);
+	if (rc != SQLITE_DONE)
+	{
+		m_error = isCancelled() ? tr("Cancelled")
+								: QString::fromUtf8(sqlite3_errmsg(dest));
+	}
+	sqlite3_close(dest);
+}
+
+void DatabaseBackup::vacuumInto()
+{
+	m_pageCount = pragma(m_schema, "page_count");
+	m_expectedSize =   (m_pageCount - pragma(m_schema, "freelist_count"))
+					 * pragma(m_schema, "page_size");
+	m_sizeTimer.start();
+	sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+	if (   !exec(QString("VACUUM %1 INTO %2;")
+				 .arg(Utils::q(m_schema), Utils::q(m_fileName, "'")))
+		&& isCancelled())
+	{
+		m_error = tr("Cancelled");
+	}
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+}
+
+void DatabaseBackup::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	bool existed = QFile::exists(m_fileName);
+	if (m_vacuum)
+		vacuumInto();
+	else
+		backup();
+	// don't leave a half written file behind, but never remove one
+	// which was there before
+	if (!m_error.isEmpty() && !existed)
+		QFile::remove(m_fileName);
+}
@@ -0,0 +1,67 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef DATABASEBACKUP_H
+#define DATABASEBACKUP_H
+
+#include "databaseworker.h"
+
+
+/*! \brief Copies a schema of the main connection into a database file.
+By default it uses the online backup API: sqlite3_backup_step() copies a
+few pages at a time and the worker sleeps between the steps, so other
+processes get the database in between. A write by another connection
+makes sqlite restart the copy, which is why the steps should be short
+on a busy database. The progress comes from sqlite3_backup_remaining()
+and sqlite3_backup_pagecount().
+With setVacuum() it runs VACUUM INTO instead (sqlite 3.27), which writes
+a compacted copy without the free pages. sqlite has no progress for it,
+so the size of the new file is compared with the used pages of the
+source.
+It reads on a connection of its own where it can
+(DatabaseWorker::useOwnConnection()), otherwise on the main connection,
+so in-memory databases and the temp schema can be saved too.
+*/
+class DatabaseBackup : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		DatabaseBackup(sqlite3 * handle, const QString & schema,
+					   const QString & fileName, QObject * parent = 0);
+
+		/*! \brief Pace of the online backup.
+		\param pages pages copied by one sqlite3_backup_step(), -1 for all
+		\param sleep milliseconds to wait between two steps, and at least
+		10 after a step which found the source busy or locked
+		*/
+		void setSteps(int pages, int sleep);
+		//! \brief Use VACUUM INTO instead of the backup API.
+		void setVacuum(bool vacuum) { m_vacuum = vacuum; }
+
+		//! \brief Pages of the source database, known after run().
+		int pageCount() { return m_pageCount; }
+
+	protected:
+		void run();
+
+	private:
+		QString m_schema;
+		QString m_fileName;
+		int m_pages;
+		int m_sleep;
+		bool m_vacuum;
+		int m_pageCount;
+		qint64 m_expectedSize;
+		QElapsedTimer m_sizeTimer;
+
+		void backup();
+		void vacuumInto();
+		static int progressHandler(void * worker);
+};
+
+#endif
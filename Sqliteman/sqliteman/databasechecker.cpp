@@ -0,0 +1,241 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QMap>
+
+#include "database.h"
+#include "databasechecker.h"
+#include "utils.h"
+
+
+DatabaseChecker::DatabaseChecker(const QString & schema, Mode mode,
+								 QObject * parent)
+	: DatabaseWorker(Database::sqlite3handle(), parent),
+	  m_schema(schema),
+	  m_mode(mode),
+	  m_findings(0),
+	  m_startPages(0),
+	  m_pages(0)
+{
+	useOwnConnection(schema, false);
+}
+
+int DatabaseChecker::progressHandler(void * worker)
+{
+	DatabaseChecker * self = (DatabaseChecker *)worker;
+	if (self->m_pages > 0)
+	{
+		qint64 done = self->pagesRead() - self->m_startPages;
+		self->reportProgress(qMin(done, self->m_pages), self->m_pages);
+	}
+	return self->isCancelled() ? 1 : 0;
+}
+
+QList<QStringList> DatabaseChecker::rows(const QString & sql, bool * ok)
+{
+	QList<QStringList> result;
+	QByteArray utf(sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, utf.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			QStringList row;
+			for (int i = 0; i < sqlite3_column_count(stmt); ++i)
+			{
+				row.append(QString::fromUtf8(
+					(const char *)sqlite3_column_text(stmt, i)));
+			}
+			result.append(row);
+		}
+	}
+	*ok = (rc == SQLITE_OK) || (rc == SQLITE_DONE);
+	if (!*ok)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	return result;
+}
+
+bool DatabaseChecker::integrityCheck(const QString & table)
+{
+	QString sql(QString("PRAGMA %1.%2")
+				.arg(Utils::q(m_schema),
+					 (m_mode == QuickCheck) ? "quick_check"
+											: "integrity_check"));
+	if (!table.isEmpty())
+		sql += QString("(%1)").arg(Utils::q(table, "'"));
+	QByteArray utf(sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, utf.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		// every problem is a row of its own, a sound schema gives "ok"
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			QString message(QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 0)));
+			if (message == "ok") { continue; }
+			++m_findings;
+			emit problem(table.isEmpty() ? m_schema : table, message);
+		}
+	}
+	bool ok = (rc == SQLITE_OK) || (rc == SQLITE_DONE);
+	if (!ok)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	return ok;
+}
+
+bool DatabaseChecker::isIndexed(const QString & table,
+								const QStringList & columns)
+{
+	QStringList wanted;
+	foreach (QString column, columns)
+		wanted.append(column.toLower());
+	wanted.sort();
+	bool ok;
+
+	// an INTEGER PRIMARY KEY is the rowid, the table itself is the index
+	if (wanted.count() == 1)
+	{
+		QList<QStringList> info(rows(QString("PRAGMA %1.table_info(%2);")
+									 .arg(Utils::q(m_schema),
+										  Utils::q(table, "'")), &ok));
+		QStringList pk;
+		QString pkType;
+		foreach (QStringList column, info)
+		{
+			if (column.value(5).toInt() > 0)
+			{
+				pk.append(column.value(1).toLower());
+				pkType = column.value(2);
+			}
+		}
+		if (   (pk == wanted)
+			&& (pkType.compare("INTEGER", Qt::CaseInsensitive) == 0))
+		{
+			return true;
+		}
+	}
+
+	QList<QStringList> indexes(rows(QString("PRAGMA %1.index_list(%2);")
+									.arg(Utils::q(m_schema),
+										 Utils::q(table, "'")), &ok));
+	foreach (QStringList index, indexes)
+	{
+		// a partial index does not cover every row
+		if (index.value(4) == "1") { continue; }
+		QList<QStringList> info(rows(QString("PRAGMA %1.index_info(%2);")
+									 .arg(Utils::q(m_schema),
+										  Utils::q(index.value(1), "'")),
+									 &ok));
+		if (info.count() < wanted.count()) { continue; }
+		QStringList leading;
+		for (int i = 0; i < wanted.count(); ++i)
+			leading.append(info.at(i).value(2).toLower());
+		leading.sort();
+		if (leading == wanted)
+			return true;
+	}
+	return false;
+}
+
+bool DatabaseChecker::foreignKeyCheck(const QString & table)
+{
+	bool ok;
+	QMap<int,ForeignKey> keys;
+	QList<QStringList> list(rows(QString("PRAGMA %1.foreign_key_list(%2);")
+								 .arg(Utils::q(m_schema),
+									  Utils::q(table, "'")), &ok));
+	if (!ok) { return false; }
+	// id, seq, table, from, to, on_update, on_delete, match
+	foreach (QStringList row, list)
+	{
+		ForeignKey & key = keys[row.value(0).toInt()];
+		key.parent = row.value(2);
+		key.columns.append(row.value(3));
+	}
+	QMap<int,ForeignKey>::const_iterator it;
+	for (it = keys.constBegin(); it != keys.constEnd(); ++it)
+	{
+		if (!isIndexed(table, it.value().columns))
+		{
+			++m_findings;
+			emit unindexed(table, it.value().parent,
+						   it.value().columns.join(", "));
+		}
+	}
+	if (keys.isEmpty()) { return true; }
+
+	QByteArray sql(QString("PRAGMA %1.foreign_key_check(%2);")
+				   .arg(Utils::q(m_schema), Utils::q(table, "'")).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		// table, rowid (NULL WITHOUT ROWID), parent, fkid
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			++m_findings;
+			ForeignKey key(keys.value(sqlite3_column_int(stmt, 3)));
+			emit violation(table, key.parent, key.columns.join(", "),
+						   sqlite3_column_int64(stmt, 1));
+		}
+	}
+	ok = (rc == SQLITE_OK) || (rc == SQLITE_DONE);
+	if (!ok)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	return ok;
+}
+
+void DatabaseChecker::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+
+	QStringList tables(m_tables);
+	if ((m_mode == ForeignKeyCheck) && tables.isEmpty())
+	{
+		bool ok;
+		QList<QStringList> list(rows(QString("SELECT name FROM %1 "
+											 "WHERE type = 'table' "
+											 "AND name NOT LIKE 'sqlite_%';")
+									 .arg(Database::getMaster(m_schema)),
+									 &ok));
+		foreach (QStringList row, list)
+			tables.append(row.value(0));
+	}
+
+	sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+	if (tables.isEmpty() && (m_mode != ForeignKeyCheck))
+	{
+		// the whole check reads about every page once
+		bool ok;
+		QList<QStringList> count(rows(QString("PRAGMA %1.page_count;")
+									  .arg(Utils::q(m_schema)), &ok));
+		m_pages = count.isEmpty() ? 0 : count.at(0).value(0).toLongLong();
+		m_startPages = pagesRead();
+		integrityCheck(QString());
+	}
+	for (int i = 0; (i < tables.count()) && !isCancelled(); ++i)
+	{
+		reportProgress(i, tables.count());
+		emit label(tr("Checking %1 (%2 of %3)")
+				   .arg(tables.at(i)).arg(i + 1).arg(tables.count()));
+		bool ok = (m_mode == ForeignKeyCheck) ? foreignKeyCheck(tables.at(i))
+											  : integrityCheck(tables.at(i));
+		if (!ok) { break; }
+	}
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+	if (isCancelled())
+		m_error = tr("Cancelled");
+}
@@ -0,0 +1,83 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef DATABASECHECKER_H
+#define DATABASECHECKER_H
+
+#include <QStringList>
+
+#include "databaseworker.h"
+
+
+/*! \brief Runs integrity_check, quick_check or foreign_key_check.
+It uses a read only connection of its own where it can
+(DatabaseWorker::useOwnConnection()), which leaves the main connection
+alone.
+Findings are signalled as soon as sqlite returns them, so the dialog can
+show them while the check goes on.
+The checks can be limited to some tables (with their indexes) with
+addTable(); that needs sqlite 3.33 for the integrity checks, older
+libraries check the whole schema. The foreign
+key check always goes table by table, and reports the foreign keys
+whose child columns are not the leading columns of an index, as every
+change to the parent table has to scan the child table for them.
+*/
+class DatabaseChecker : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		typedef enum
+		{
+			IntegrityCheck,
+			QuickCheck,
+			ForeignKeyCheck
+		} Mode;
+
+		DatabaseChecker(const QString & schema, Mode mode, QObject * parent = 0);
+
+		void addTable(const QString & name) { m_tables.append(name); }
+		//! \brief Findings signalled so far.
+		int findings() { return m_findings; }
+
+	signals:
+		//! \brief A line of integrity_check or quick_check other than "ok".
+		void problem(QString object, QString message);
+		//! \brief A row of table which has no parent row.
+		void violation(QString table, QString parent, QString columns,
+					   qlonglong rowid);
+		//! \brief A foreign key of table without an index on its columns.
+		void unindexed(QString table, QString parent, QString columns);
+
+	protected:
+		void run();
+
+	private:
+		typedef struct
+		{
+			QString parent;
+			QStringList columns;
+		} ForeignKey;
+
+		QString m_schema;
+		Mode m_mode;
+		QStringList m_tables;
+		int m_findings;
+		int m_startPages;
+		qint64 m_pages;
+
+		//! \brief Rows of sql as strings, empty on error with m_error set.
+		QList<QStringList> rows(const QString & sql, bool * ok);
+		//! \brief Check table, or the whole schema when it is empty.
+		bool integrityCheck(const QString & table);
+		bool foreignKeyCheck(const QString & table);
+		//! \brief Whether columns lead an index of table (or are its rowid).
+		bool isIndexed(const QString & table, const QStringList & columns);
+		static int progressHandler(void * worker);
+};
+
+#endif
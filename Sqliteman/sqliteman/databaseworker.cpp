@@ -0,0 +1,315 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QSqlQuery>
+
+#include "database.h"
+#include "databaseworker.h"
+#include "rowhash.h"
+#include "utils.h"
+
+// milliseconds between progress signals
+#define PROGRESS_INTERVAL 100
+// milliseconds between two looks at the running hashers
+#define POLL_INTERVAL 100
+// milliseconds between two label updates while hashing
+#define LABEL_INTERVAL 500
+
+
+MainConnectionMonitor * MainConnectionMonitor::_instance = 0;
+
+MainConnectionMonitor * MainConnectionMonitor::instance()
+{
+	if (_instance == 0)
+		_instance = new MainConnectionMonitor();
+
+	return _instance;
+}
+
+void MainConnectionMonitor::deleteInstance()
+{
+	if (_instance)
+		delete _instance;
+	_instance = 0;
+}
+
+MainConnectionMonitor::MainConnectionMonitor()
+	: QObject(),
+	  m_workers(0)
+{
+}
+
+void MainConnectionMonitor::acquire()
+{
+	if (m_workers++ == 0)
+		emit busy();
+}
+
+void MainConnectionMonitor::release()
+{
+	if (--m_workers == 0)
+		emit idle();
+}
+
+
+DatabaseWorker::DatabaseWorker(sqlite3 * handle, QObject * parent)
+	: QThread(parent),
+	  m_handle(handle),
+	  m_ownHandle(false),
+	  m_mainOnly(false),
+	  m_cancelled(0),
+	  m_permille(-1)
+{
+}
+
+DatabaseWorker::~DatabaseWorker()
+{
+	wait();
+	if (m_ownHandle)
+		sqlite3_close(m_handle);
+}
+
+void DatabaseWorker::useOwnConnection(const QString & schema, bool writes)
+{
+	if (m_mainOnly || !m_handle)
+		return;
+	bool own = Database::canOpenConnection(schema) && Database::isAutoCommit();
+	if (own && writes)
+	{
+		QSqlQuery query(QString("PRAGMA %1.journal_mode;")
+						.arg(Utils::q(schema)),
+						QSqlDatabase::database(SESSION_NAME));
+		own =    query.next()
+			  && (query.value(0).toString()
+				  .compare("wal", Qt::CaseInsensitive) == 0);
+	}
+	if (own && !m_ownHandle)
+	{
+		QString error;
+		sqlite3 * handle = Database::openConnection(!writes, &error);
+		if (handle)
+		{
+			m_handle = handle;
+			m_ownHandle = true;
+		}
+		else
+			own = false;
+	}
+	if (!own)
+	{
+		m_mainOnly = true;
+		if (m_ownHandle)
+			sqlite3_close(m_handle);
+		m_ownHandle = false;
+		m_handle = Database::sqlite3handle();
+	}
+}
+
+void DatabaseWorker::cancel()
+{
+	m_cancelled = 1;
+	if (m_handle && isRunning())
+		sqlite3_interrupt(m_handle);
+}
+
+void DatabaseWorker::runWithProgress(const QString & label, QWidget * parent)
+{
+	QProgressDialog progressDialog(label, tr("Cancel"), 0, 1000, parent);
+	progressDialog.setWindowModality(Qt::WindowModal);
+	progressDialog.setMinimumDuration(500);
+	connect(this, SIGNAL(progress(int)), &progressDialog, SLOT(setValue(int)));
+	connect(this, SIGNAL(label(QString)),
+			&progressDialog, SLOT(setLabelText(const QString &)));
+	connect(&progressDialog, SIGNAL(canceled()), this, SLOT(cancel()));
+
+	bool onMain = m_handle && (m_handle == Database::sqlite3handle());
+	if (onMain)
+		MainConnectionMonitor::instance()->acquire();
+
+	QEventLoop loop;
+	// queued from the worker, so it cannot arrive before exec()
+	connect(this, SIGNAL(finished()), &loop, SLOT(quit()));
+	start();
+	loop.exec();
+	wait();
+
+	if (onMain)
+		MainConnectionMonitor::instance()->release();
+}
+
+void DatabaseWorker::reportProgress(qint64 done, qint64 total)
+{
+	if (!m_progressTimer.isValid())
+		m_progressTimer.start();
+	else if (m_progressTimer.elapsed() < PROGRESS_INTERVAL)
+		return;
+	m_progressTimer.restart();
+
+	int permille = (total > 0) ? (int)(done * 1000 / total) : 0;
+	if (permille != m_permille)
+	{
+		m_permille = permille;
+		emit progress(permille);
+	}
+}
+
+int DatabaseWorker::pagesRead()
+{
+	int hits = 0;
+	int misses = 0;
+	int highwater = 0;
+	sqlite3_db_status(m_handle, SQLITE_DBSTATUS_CACHE_HIT,
+					  &hits, &highwater, 0);
+	sqlite3_db_status(m_handle, SQLITE_DBSTATUS_CACHE_MISS,
+					  &misses, &highwater, 0);
+	return hits + misses;
+}
+
+qint64 DatabaseWorker::pragma(const QString & schema, const char * name)
+{
+	qint64 value = 0;
+	QByteArray sql(QString("PRAGMA %1.%2;")
+				   .arg(Utils::q(schema), name).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (   (sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0)
+			== SQLITE_OK)
+		&& (sqlite3_step(stmt) == SQLITE_ROW))
+	{
+		value = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return value;
+}
+
+bool DatabaseWorker::beginRead(sqlite3 * handle, const QStringList & schemas)
+{
+	QString sql;
+	bool begin = sqlite3_get_autocommit(handle) != 0;
+	if (begin)
+		sql = "BEGIN;";
+	foreach (QString schema, schemas)
+		sql += QString("SELECT count(*) FROM %1;").arg(Database::getMaster(schema));
+	char * errmsg = 0;
+	QByteArray utf(sql.toUtf8());
+	int rc = sqlite3_exec(handle, utf.constData(), NULL, NULL, &errmsg);
+	if (begin && !sqlite3_get_autocommit(handle))
+		m_reads.append(handle);
+	if (rc != SQLITE_OK)
+	{
+		m_error = QString::fromUtf8(errmsg ? errmsg : sqlite3_errmsg(handle));
+		sqlite3_free(errmsg);
+		return false;
+	}
+	return true;
+}
+
+void DatabaseWorker::endReads()
+{
+	foreach (sqlite3 * handle, m_reads)
+	{
+		// an interrupt may have ended it already
+		if (!sqlite3_get_autocommit(handle))
+			sqlite3_exec(handle, "COMMIT;", NULL, NULL, NULL);
+	}
+	m_reads.clear();
+}
+
+QStringList DatabaseWorker::columns(const QString & schema,
+									const QString & table)
+{
+	QStringList result;
+	QByteArray sql(QString("PRAGMA %1.table_info(%2);")
+				   .arg(Utils::q(schema), Utils::q(table)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			result.append(QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 1)));
+		}
+	}
+	if (rc != SQLITE_DONE)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+		result.clear();
+	}
+	else if (result.isEmpty())
+		m_error = tr("There is no table %1 in %2").arg(table, schema);
+	sqlite3_finalize(stmt);
+	return result;
+}
+
+bool DatabaseWorker::rowidRange(const QString & schema, const QString & table,
+								qint64 * lo, qint64 * hi)
+{
+	// both are a single seek to an end of the table b-tree
+	QByteArray sql(QString("SELECT min(rowid), max(rowid) FROM %1.%2;")
+				   .arg(Utils::q(schema), Utils::q(table)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	bool found = false;
+	int rc = sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0);
+	if ((rc == SQLITE_OK) && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+	{
+		found = (sqlite3_column_type(stmt, 0) != SQLITE_NULL);
+		*lo = sqlite3_column_int64(stmt, 0);
+		*hi = sqlite3_column_int64(stmt, 1);
+	}
+	else if (rc != SQLITE_DONE)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+void DatabaseWorker::waitFor(const QList<RangeHasher *> & hashers)
+{
+	QElapsedTimer labelTimer;
+	labelTimer.start();
+	bool running = true;
+	while (running)
+	{
+		msleep(POLL_INTERVAL);
+		if (isCancelled())
+		{
+			foreach (RangeHasher * hasher, hashers)
+				hasher->cancel();
+		}
+		running = false;
+		qlonglong rows = 0;
+		foreach (RangeHasher * hasher, hashers)
+		{
+			running = running || !hasher->isFinished();
+			rows += hasher->rows();
+		}
+		bool showLabel = labelTimer.elapsed() >= LABEL_INTERVAL;
+		if (showLabel)
+			labelTimer.restart();
+		hashing(rows, showLabel);
+	}
+	foreach (RangeHasher * hasher, hashers)
+		hasher->wait();
+}
+
+bool DatabaseWorker::exec(const QString & sql)
+{
+	char * errmsg = 0;
+	QByteArray utf(sql.toUtf8());
+	if (sqlite3_exec(m_handle, utf.constData(), NULL, NULL, &errmsg)
+		!= SQLITE_OK)
+	{
+		m_error = QString::fromUtf8(errmsg ? errmsg
+										   : sqlite3_errmsg(m_handle));
+		sqlite3_free(errmsg);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,170 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef DATABASEWORKER_H
+#define DATABASEWORKER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+
+#include "sqlite3.h"
+
+class RangeHasher;
+
+/*! \brief Tells the GUI thread when a worker uses the main connection.
+The sqlite library is serialized, so whatever the GUI thread reads
+from the main connection (Database::sqlite3handle()) while a worker
+steps on it waits for the worker's statement, and the GUI freezes.
+Timers and other readers of the main connection stay away from it
+between busy() and idle(). It is a singleton like SchemaCatalog.
+*/
+class MainConnectionMonitor : public QObject
+{
+		Q_OBJECT
+
+	public:
+		static MainConnectionMonitor * instance();
+		static void deleteInstance();
+
+		//! \brief Whether a worker is running on the main connection.
+		bool isBusy() { return m_workers > 0; }
+
+	signals:
+		void busy();
+		void idle();
+
+	private:
+		friend class DatabaseWorker;
+
+		static MainConnectionMonitor * _instance;
+		int m_workers;
+
+		MainConnectionMonitor();
+		void acquire();
+		void release();
+};
+
+
+/*! \brief Base of the threads running long operations on a connection.
+The GUI thread calls runWithProgress(), which shows a window modal
+progress dialog until the thread has finished, so the user cannot touch
+the database meanwhile. Workers which read, or write in WAL mode, use a
+connection of their own (useOwnConnection()). The others use the main
+connection, e.g. for the temp schema or within a savepoint of the
+caller, and MainConnectionMonitor keeps the GUI thread off it while
+they run.
+Subclasses implement run(), call reportProgress() as they go and check
+isCancelled().
+*/
+class DatabaseWorker : public QThread
+{
+		Q_OBJECT
+
+	public:
+		DatabaseWorker(sqlite3 * handle, QObject * parent = 0);
+		~DatabaseWorker();
+
+		bool isCancelled() { return m_cancelled != 0; }
+		//! \brief The error which stopped the worker, empty if none.
+		QString errorMessage() { return m_error; }
+
+		/*! \brief Start the thread and wait for it with a progress dialog.
+		Cancel in the dialog calls cancel().
+		*/
+		void runWithProgress(const QString & label, QWidget * parent);
+
+	public slots:
+		/*! \brief Ask the worker to stop.
+		The running statement is interrupted (sqlite3_interrupt()).
+		It can be called from any thread.
+		*/
+		void cancel();
+
+	signals:
+		//! \brief Progress in thousandths of the whole work.
+		void progress(int permille);
+		//! \brief New text for the progress dialog.
+		void label(QString text);
+		//! \brief A line for the script output of the data viewer.
+		void message(QString line);
+
+	protected:
+		//! \brief VM instructions between two progress handler calls.
+		static const int ProgressOps = 10000;
+
+		sqlite3 * m_handle;
+		QString m_error;
+
+		//! \brief Emit progress(), but not more often than every 100 ms.
+		void reportProgress(qint64 done, qint64 total);
+		/*! \brief Run sql (one or more statements) to completion.
+		\retval bool false on error, with m_error set
+		*/
+		bool exec(const QString & sql);
+		/*! \brief Pages fetched by the connection so far.
+		Page cache hits and misses, so a progress handler can measure a
+		statement which reads every page against the pages to read.
+		*/
+		int pagesRead();
+		//! \brief Integer value of PRAGMA schema.name, 0 on error.
+		qint64 pragma(const QString & schema, const char * name);
+		/*! \brief Read schemas on handle in one transaction until endReads().
+		A deferred BEGIN takes no snapshot yet, so the schema table of each
+		of them is read at once. A connection which is in a transaction
+		already, e.g. the main one within a savepoint of the caller, keeps
+		that one.
+		\retval bool false on error, with m_error set
+		*/
+		bool beginRead(sqlite3 * handle, const QStringList & schemas);
+		//! \brief End the transactions started by beginRead().
+		void endReads();
+		/*! \brief Work on schema on a connection of its own if possible.
+		That is a connection from Database::openConnection(), which
+		needs Database::canOpenConnection(schema). It is not used while
+		the main connection is in a transaction, as it would not see
+		its changes, nor for writes unless schema is in WAL mode, as
+		a read transaction of the main connection, e.g. of a table
+		model not fetched to the end, would keep it from committing.
+		A worker on several schemas calls it for each of them with the
+		same writes, and keeps the main connection if any of them
+		needs it. It is called on the GUI thread, before the start.
+		*/
+		void useOwnConnection(const QString & schema, bool writes);
+		//! \brief Whether useOwnConnection() got a connection.
+		bool ownsConnection() { return m_ownHandle; }
+
+		//! \brief Column names of table in schema, empty on error.
+		QStringList columns(const QString & schema, const QString & table);
+		/*! \brief Lowest and highest rowid of table in schema.
+		\retval bool false if it is empty or on error, with m_error set
+		*/
+		bool rowidRange(const QString & schema, const QString & table,
+						qint64 * lo, qint64 * hi);
+		/*! \brief Wait for hashers started by the worker.
+		They are cancelled with it, and hashing() is told the rows they
+		have hashed so far every 100 ms.
+		*/
+		void waitFor(const QList<RangeHasher *> & hashers);
+		/*! \brief Progress of waitFor(), for progress() and label().
+		showLabel is set every half second, when a new label is due.
+		*/
+		virtual void hashing(qlonglong /*rows*/, bool /*showLabel*/) {}
+
+	private:
+		bool m_ownHandle;
+		//! \brief connections with a transaction of beginRead()
+		QList<sqlite3 *> m_reads;
+		//! \brief a schema needs the main connection
+		bool m_mainOnly;
+		QAtomicInt m_cancelled;
+		QElapsedTimer m_progressTimer;
+		int m_permille;
+};
+
+#endif
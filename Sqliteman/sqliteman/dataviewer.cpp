@@ -9,6 +9,8 @@ for which a new license (GPL+exception) is in place.
 #include <QClipboard>
 #include <QCursor>
 #include <QDateTime>
+#include <QDir>
+#include <QFileDialog>
 #include <QtDebug> //qDebug
 #include <QHeaderView>
 #include <QInputDialog>
@@ -21,6 +23,9 @@ for which a new license (GPL+exception) is in place.
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlError>
+#include <QTabBar>
+#include <QTemporaryFile>
+#include <QTimer>
 
 #include "blobpreviewwidget.h"
 #include "database.h"
@@ -34,6 +39,11 @@ for which a new license (GPL+exception) is in place.
 #include "ui_finddialog.h"
 #include "utils.h"
 
+// milliseconds between updates of the script output
+#define SCRIPT_FLUSH_INTERVAL 100
+// lines of script output kept in the widget
+#define SCRIPT_LOG_LINES 10000
+
 // private methods
 
 void DataViewer::updateButtons()
@@ -132,7 +142,7 @@ void DataViewer::updateButtons()
 		ui.actionBLOB_Preview->setEnabled(false);
 		ui.blobPreviewBox->setVisible(false);
 	}
-	ui.actionExport_Data->setEnabled(haveRows);
+	ui.actionExport_Data->setEnabled(haveRows || (tab == 2));
 	ui.action_Goto_Line->setEnabled(haveRows && (tab != 2));
 	ui.actionRipOut->setEnabled(haveRows && isTopLevel);
 	ui.tabWidget->setTabEnabled(1, rowSelected);
@@ -429,6 +439,11 @@ void DataViewer::deletingRow(int row)
 void DataViewer::exportData()
 {
 	removeErrorMessage();
+	if (ui.tabWidget->currentIndex() == 2)
+	{
+		saveScriptLog();
+		return;
+	}
 	nonColumnClicked();
 	QString tmpTableName("<any_table>");
 	SqlTableModel * m = qobject_cast<SqlTableModel*>(ui.tableView->model());
@@ -806,6 +821,22 @@ DataViewer::DataViewer(QWidget * parent)
 	// force the status window to have a document
 	ui.statusText->setDocument(new QTextDocument());
 
+	m_resultTabs = new QTabBar(ui.tab_3);
+	m_resultTabs->hide();
+	QGridLayout * scriptLayout =
+		qobject_cast<QGridLayout *>(ui.tab_3->layout());
+	scriptLayout->removeWidget(ui.scriptEdit);
+	scriptLayout->addWidget(m_resultTabs, 0, 0);
+	scriptLayout->addWidget(ui.scriptEdit, 1, 0);
+	connect(m_resultTabs, SIGNAL(currentChanged(int)),
+			this, SLOT(resultTabs_currentChanged(int)));
+
+	m_scriptSpill = 0;
+	m_scriptTimer = new QTimer(this);
+	m_scriptTimer->setSingleShot(true);
+	m_scriptTimer->setInterval(SCRIPT_FLUSH_INTERVAL);
+	connect(m_scriptTimer, SIGNAL(timeout()), this, SLOT(flushScriptLog()));
+
 #ifdef Q_WS_MAC
     ui.mainToolBar->setIconSize(QSize(16, 16));
     ui.exportToolBar->setIconSize(QSize(16, 16));
@@ -932,6 +963,7 @@ DataViewer::~DataViewer()
 	}
 	freeResources( ui.tableView->model()); // avoid memory leak of model
 	delete ui.statusText->document();
+	delete m_scriptSpill;
 }
 
 void DataViewer::setNotPending()
@@ -1193,10 +1225,44 @@ bool DataViewer::incrementalSearch(QKeyEvent *keyEvent)
 
 void DataViewer::showSqlScriptResult(QString line)
 {
-	removeErrorMessage();
 	if (line.isEmpty()) { return; }
-	ui.scriptEdit->append(line);
-	ui.scriptEdit->append("\n");
+	m_scriptPending.append(line);
+	// a ring buffer: what would not fit in the widget goes to the file
+	if (m_scriptPending.count() > SCRIPT_LOG_LINES)
+	{
+		// keep the file in order: the widget's lines are older
+		if (ui.scriptEdit->lines() > 1)
+		{
+			spillScriptLog(ui.scriptEdit->text());
+			ui.scriptEdit->clear();
+		}
+		spillScriptLog(m_scriptPending.takeFirst() + "\n");
+	}
+	if (!m_scriptTimer->isActive())
+		m_scriptTimer->start();
+}
+
+void DataViewer::flushScriptLog()
+{
+	if (m_scriptPending.isEmpty()) { return; }
+	removeErrorMessage();
+	ui.scriptEdit->append(m_scriptPending.join("\n") + "\n");
+	m_scriptPending.clear();
+
+	// trim in chunks, so it does not happen on every flush
+	int excess = ui.scriptEdit->lines() - SCRIPT_LOG_LINES;
+	if (excess > SCRIPT_LOG_LINES / 10)
+	{
+		int length = ui.scriptEdit->SendScintilla(
+			QsciScintillaBase::SCI_POSITIONFROMLINE, excess);
+		QString text;
+		for (int i = 0; i < excess; ++i)
+			text += ui.scriptEdit->text(i);
+		spillScriptLog(text);
+		ui.scriptEdit->SendScintilla(
+			QsciScintillaBase::SCI_DELETERANGE, (unsigned long)0, length);
+	}
+
 	ui.scriptEdit->ensureLineVisible(ui.scriptEdit->lines());
 	ui.tabWidget->setCurrentIndex(2);
 	haveBuiltQuery = false;
@@ -1204,9 +1270,96 @@ void DataViewer::showSqlScriptResult(QString line)
 	emit tableUpdated();
 }
 
+void DataViewer::spillScriptLog(const QString & text)
+{
+	if (!m_scriptSpill)
+	{
+		m_scriptSpill = new QTemporaryFile();
+		if (!m_scriptSpill->open())
+		{
+			delete m_scriptSpill;
+			m_scriptSpill = 0;
+			return; // the text is lost, as it was always before
+		}
+		ui.tabWidget->setTabToolTip(2,
+			tr("Only the latest output is shown. "
+			   "Use Export Data to save all of it."));
+	}
+	m_scriptSpill->write(text.toUtf8());
+}
+
+void DataViewer::saveScriptLog()
+{
+	QString fileName = QFileDialog::getSaveFileName(this,
+						tr("Save Script Output"),
+						QDir::currentPath(),
+						tr("Text File (*.txt);;All Files (*)"));
+	if (fileName.isNull())
+		return;
+
+	flushScriptLog();
+	QFile file(fileName);
+	bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+	if (ok && m_scriptSpill)
+	{
+		m_scriptSpill->seek(0);
+		while (ok && !m_scriptSpill->atEnd())
+			ok = file.write(m_scriptSpill->read(1 << 20)) >= 0;
+		m_scriptSpill->seek(m_scriptSpill->size());
+	}
+	if (ok)
+		ok = file.write(ui.scriptEdit->text().toUtf8()) >= 0;
+	if (!ok)
+	{
+		QMessageBox::warning(this, tr("Export Error"),
+			tr("Cannot write %1: %2").arg(fileName).arg(file.errorString()));
+	}
+}
+
 void DataViewer::sqlScriptStart()
 {
+	m_scriptTimer->stop();
+	m_scriptPending.clear();
+	delete m_scriptSpill;
+	m_scriptSpill = 0;
+	ui.tabWidget->setTabToolTip(2, QString());
 	ui.scriptEdit->clear();
+	m_resultTabs->blockSignals(true);
+	while (m_resultTabs->count() > 0)
+		m_resultTabs->removeTab(0);
+	m_resultTabs->blockSignals(false);
+	m_resultTabs->hide();
+	foreach (SqlQueryModel * model, m_scriptResults)
+		SqlQueryModel::detach(model);
+	m_scriptResults.clear();
+}
+
+void DataViewer::addScriptResult(SqlQueryModel * model)
+{
+	// not opened yet, see selectScriptResult()
+	m_scriptResults.append(model);
+	m_resultTabs->blockSignals(true);
+	int i = m_resultTabs->addTab(tr("Result %1").arg(m_resultTabs->count() + 1));
+	m_resultTabs->blockSignals(false);
+	m_resultTabs->setTabToolTip(i, model->query().lastQuery());
+	m_resultTabs->show();
+}
+
+void DataViewer::selectScriptResult(int index)
+{
+	if (m_resultTabs->count() == 0) { return; }
+	if ((index < 0) || (index >= m_resultTabs->count()))
+		index = m_resultTabs->count() - 1;
+	if (index == m_resultTabs->currentIndex())
+		resultTabs_currentChanged(index);
+	else
+		m_resultTabs->setCurrentIndex(index);
+}
+
+void DataViewer::resultTabs_currentChanged(int index)
+{
+	if (index < 0) { return; }
+	emit scriptResultSelected(m_scriptResults.at(index));
 }
 
 void DataViewer::rowCountChanged()
@@ -20,6 +20,9 @@ class QModelIndex;
 class QSplitter;
 class QSqlQueryModel;
 class QResizeEvent;
+class QTabBar;
+class QTemporaryFile;
+class QTimer;
 class QTableView;
 class QTextEdit;
 class QToolBar;
@@ -41,6 +44,20 @@ class DataViewer : public QMainWindow
 		int topRow;
 		FindDialog * m_finder;
 		bool m_doneFindAll;
+		//! \brief Results of Run as Script, one tab per m_scriptResults
+		QTabBar * m_resultTabs;
+		//! \brief models of the result tabs, each attached once for its tab
+		QList<SqlQueryModel*> m_scriptResults;
+		//! \brief script output lines not shown yet, see flushScriptLog()
+		QStringList m_scriptPending;
+		QTimer * m_scriptTimer;
+		//! \brief script output lines which no longer fit in scriptEdit
+		QTemporaryFile * m_scriptSpill;
+
+		//! \brief Move text which no longer fits in scriptEdit to m_scriptSpill.
+		void spillScriptLog(const QString & text);
+		//! \brief Save the whole script output, including the spilled part.
+		void saveScriptLog();
 
         QAction * actCopyWhole;
         QAction * actPasteOver;
@@ -112,6 +129,9 @@ class DataViewer : public QMainWindow
 		void itemView_indexChanged();
 
 		void gotoLine();
+		void resultTabs_currentChanged(int index);
+		//! \brief Show the pending script output lines.
+		void flushScriptLog();
 
         void actOpenEditor_triggered();
         void actOpenMultiEditor_triggered();
@@ -156,15 +176,32 @@ class DataViewer : public QMainWindow
 		QByteArray saveSplitter() { return ui.splitter->saveState(); };
 		void restoreSplitter(QByteArray state) { ui.splitter->restoreState(state); };
 
+		/*! \brief Open a result of the script.
+		\param index tab index, the last one if negative
+		*/
+		void selectScriptResult(int index = -1);
+
 	signals:
 		void tableUpdated();
 		void deleteMultiple();
+		//! \brief A script result tab was selected, model has to be shown.
+		void scriptResultSelected(SqlQueryModel * model);
 
 	public slots:
-		//! \brief Append the line to the "Script Result" tab.
+		/*! \brief Append the line to the "Script Result" tab.
+		The lines are collected and shown at most every 100 ms, so a
+		long script is not slowed down by redrawing the widget. Only the
+		last lines stay in the widget; older ones are kept in a temporary
+		file and saved with the rest by Export Data.
+		*/
 		void showSqlScriptResult(QString line);
 		//! \brief Clean the "Script Result" report
 		void sqlScriptStart();
+		/*! \brief Add a result tab for a script statement.
+		The tab keeps the model until the next script starts, so the
+		rows stay as they were when the statement ran.
+		*/
+		void addScriptResult(SqlQueryModel * model);
 		void rowCountChanged();
 };
 
@@ -0,0 +1,166 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QPushButton>
+#include <QSettings>
+#include <QThread>
+
+#include "database.h"
+#include "fingerprintdialog.h"
+#include "tablefingerprint.h"
+
+// columns of the result tree
+#define COLUMN_TABLE 0
+#define COLUMN_ROWS 1
+#define COLUMN_FINGERPRINT 2
+#define COLUMN_TIME 3
+
+
+FingerprintDialog::FingerprintDialog(QWidget * parent, const QString & schema,
+									 const QString & table)
+	: QDialog(parent)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("fingerprint/height", QVariant(500)).toInt();
+	int ww = settings.value("fingerprint/width", QVariant(600)).toInt();
+	resize(ww, hh);
+	int connections = qBound(1, QThread::idealThreadCount(),
+							 ui.connectionsSpinBox->maximum());
+	ui.connectionsSpinBox->setValue(
+		settings.value("fingerprint/connections", connections).toInt());
+
+	m_fingerprintButton =
+		ui.buttonBox->addButton(tr("&Fingerprint"),
+								QDialogButtonBox::ApplyRole);
+	m_copyButton =
+		ui.buttonBox->addButton(tr("Cop&y"), QDialogButtonBox::ActionRole);
+	m_copyButton->setEnabled(false);
+	ui.resultTree->setColumnCount(4);
+	ui.resultTree->setHeaderLabels(QStringList() << tr("Table") << tr("Rows")
+									<< tr("Fingerprint") << tr("Time"));
+	ui.resultTree->setRootIsDecorated(false);
+
+	connect(ui.schemaCombo, SIGNAL(currentIndexChanged(const QString &)),
+			this, SLOT(schemaCombo_currentIndexChanged(const QString &)));
+	connect(m_fingerprintButton, SIGNAL(clicked()),
+			this, SLOT(fingerprintButton_clicked()));
+	connect(m_copyButton, SIGNAL(clicked()), this, SLOT(copyButton_clicked()));
+
+	ui.schemaCombo->addItems(Database::getDatabases().keys());
+	ui.schemaCombo->setCurrentIndex(
+		ui.schemaCombo->findText(schema.isEmpty() ? QString("main") : schema));
+	QList<QListWidgetItem *> items(
+		ui.tableList->findItems(table, Qt::MatchExactly));
+	if (!table.isEmpty() && !items.isEmpty())
+	{
+		items.first()->setSelected(true);
+		ui.tableList->scrollToItem(items.first());
+	}
+}
+
+FingerprintDialog::~FingerprintDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("fingerprint/height", QVariant(height()));
+	settings.setValue("fingerprint/width", QVariant(width()));
+	settings.setValue("fingerprint/connections",
+					  ui.connectionsSpinBox->value());
+}
+
+void FingerprintDialog::schemaCombo_currentIndexChanged(const QString & schema)
+{
+	ui.tableList->clear();
+	if (!schema.isEmpty())
+		ui.tableList->addItems(Database::getObjects("table", schema).keys());
+	// see DatabaseWorker::useOwnConnection()
+	bool parallel =    Database::canOpenConnection(schema)
+					&& Database::isAutoCommit();
+	ui.connectionsSpinBox->setEnabled(parallel);
+	ui.connectionsLabel->setEnabled(parallel);
+}
+
+void FingerprintDialog::fingerprinted(QString table, QString fingerprint,
+									  qlonglong rows, qlonglong ms)
+{
+	QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultTree);
+	item->setText(COLUMN_TABLE, table);
+	item->setText(COLUMN_ROWS, QString::number(rows));
+	item->setTextAlignment(COLUMN_ROWS, Qt::AlignRight | Qt::AlignVCenter);
+	item->setText(COLUMN_FINGERPRINT, fingerprint);
+	item->setText(COLUMN_TIME, tr("%1 s").arg(ms / 1000.0, 0, 'f', 2));
+	item->setTextAlignment(COLUMN_TIME, Qt::AlignRight | Qt::AlignVCenter);
+}
+
+void FingerprintDialog::failed(QString table, QString message)
+{
+	QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultTree);
+	item->setText(COLUMN_TABLE, table);
+	item->setText(COLUMN_FINGERPRINT, message);
+	item->setToolTip(COLUMN_FINGERPRINT, message);
+	item->setForeground(COLUMN_FINGERPRINT, Qt::red);
+}
+
+void FingerprintDialog::fingerprintButton_clicked()
+{
+	QString schema(ui.schemaCombo->currentText());
+	ui.resultTree->clear();
+	ui.resultLabel->clear();
+
+	TableFingerprint worker(schema, ui.connectionsSpinBox->value(), this);
+	QList<QListWidgetItem *> selected(ui.tableList->selectedItems());
+	for (int i = 0; i < ui.tableList->count(); ++i)
+	{
+		QListWidgetItem * item = ui.tableList->item(i);
+		if (selected.isEmpty() || item->isSelected())
+			worker.addTable(item->text());
+	}
+	connect(&worker,
+			SIGNAL(fingerprinted(QString, QString, qlonglong, qlonglong)),
+			this, SLOT(fingerprinted(QString, QString, qlonglong, qlonglong)));
+	connect(&worker, SIGNAL(failed(QString, QString)),
+			this, SLOT(failed(QString, QString)));
+	QElapsedTimer timer;
+	timer.start();
+	worker.runWithProgress(tr("Fingerprinting %1").arg(schema), this);
+
+	for (int i = 0; i < ui.resultTree->columnCount(); ++i)
+		ui.resultTree->resizeColumnToContents(i);
+	m_copyButton->setEnabled(ui.resultTree->topLevelItemCount() > 0);
+	QString result(tr("%1 tables in %2 s on %3 connections.")
+				   .arg(ui.resultTree->topLevelItemCount())
+				   .arg(timer.elapsed() / 1000.0, 0, 'f', 1)
+				   .arg(worker.connections()));
+	// the connections take their snapshots one after the other
+	if (worker.connections() > 1)
+	{
+		result += "<br/>" + tr("The fingerprints are exact if nothing "
+							   "was written to %1 meanwhile.").arg(schema);
+	}
+	if (!worker.errorMessage().isEmpty())
+	{
+		result += "<br/><span style=\" color:#ff0000;\">"
+				  + worker.errorMessage() + "<br/></span>";
+	}
+	ui.resultLabel->setText(result);
+}
+
+void FingerprintDialog::copyButton_clicked()
+{
+	// tab separated, so two copies can be diffed as they are
+	QString text;
+	for (int i = 0; i < ui.resultTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.resultTree->topLevelItem(i);
+		text += item->text(COLUMN_TABLE) + "\t" + item->text(COLUMN_ROWS)
+				+ "\t" + item->text(COLUMN_FINGERPRINT) + "\n";
+	}
+	QApplication::clipboard()->setText(text);
+}
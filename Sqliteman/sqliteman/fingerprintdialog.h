@@ -0,0 +1,48 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef FINGERPRINTDIALOG_H
+#define FINGERPRINTDIALOG_H
+
+#include <qdialog.h>
+
+#include "ui_fingerprintdialog.h"
+
+class QPushButton;
+
+
+/*! \brief Lists the TableFingerprint of the chosen tables.
+Each table gets its row count, fingerprint and the time taken; Copy
+puts them on the clipboard as text, to be compared with the list made
+on a replica.
+*/
+class FingerprintDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		//! \param table preselected table of schema, if any
+		FingerprintDialog(QWidget * parent = 0,
+						  const QString & schema = QString(),
+						  const QString & table = QString());
+		~FingerprintDialog();
+
+	private:
+		Ui::FingerprintDialog ui;
+		QPushButton * m_fingerprintButton;
+		QPushButton * m_copyButton;
+
+	private slots:
+		void schemaCombo_currentIndexChanged(const QString & schema);
+		void fingerprintButton_clicked();
+		void copyButton_clicked();
+		void fingerprinted(QString table, QString fingerprint, qlonglong rows,
+						   qlonglong ms);
+		void failed(QString table, QString message);
+};
+
+#endif
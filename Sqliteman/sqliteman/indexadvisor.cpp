@@ -0,0 +1,354 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QCursor>
+#include <QRegExp>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#ifdef HAVE_SQLITE3EXPERT
+extern "C" {
+#include "sqlite3expert.h"
+}
+#endif
+
+#include "database.h"
+#include "indexadvisor.h"
+#include "litemanwindow.h"
+#include "utils.h"
+
+
+bool IndexAdvisor::haveExpert()
+{
+#ifdef HAVE_SQLITE3EXPERT
+	return true;
+#else
+	return false;
+#endif
+}
+
+QString IndexAdvisor::createStatement(const IndexCandidate & candidate)
+{
+	return QString("CREATE INDEX %1.%2 ON %3 (%4);")
+		   .arg(Utils::q(candidate.schema), Utils::q(candidate.name),
+				Utils::q(candidate.table), candidate.columns);
+}
+
+QString IndexAdvisor::findSchema(const QString & table)
+{
+	QStringList schemas(Database::getDatabases().keys());
+	// unqualified names are resolved in this order by sqlite
+	schemas.removeAll("main");
+	schemas.removeAll("temp");
+	schemas.prepend("main");
+	schemas.prepend("temp");
+	foreach (QString schema, schemas)
+	{
+		foreach (QString name, Database::getObjects("table", schema).keys())
+		{
+			if (name.compare(table, Qt::CaseInsensitive) == 0)
+			{
+				return schema;
+			}
+		}
+	}
+	return QString();
+}
+
+QList<IndexCandidate> IndexAdvisor::advise(const QString & sql,
+										   QList<QueryPlanNode> * before,
+										   QString * error)
+{
+	QList<IndexCandidate> candidates;
+	*before = QueryPlan::explain(sql, error);
+	if (!error->isEmpty()) { return candidates; }
+
+#ifdef HAVE_SQLITE3EXPERT
+	QString expertError;
+	candidates = expertCandidates(sql, &expertError);
+	// expert works on main only; fall back for anything it can't handle
+	if (!expertError.isEmpty())
+	{
+		candidates = guessCandidates(sql, *before);
+	}
+#else
+	candidates = guessCandidates(sql, *before);
+#endif
+	whatIf(sql, candidates);
+	return candidates;
+}
+
+QList<IndexCandidate> IndexAdvisor::expertCandidates(const QString & sql,
+													 QString * error)
+{
+	QList<IndexCandidate> candidates;
+#ifdef HAVE_SQLITE3EXPERT
+	char * zErr = 0;
+	sqlite3expert * expert = sqlite3_expert_new(Database::sqlite3handle(),
+												&zErr);
+	if (expert
+		&& (sqlite3_expert_sql(expert, sql.toUtf8().data(), &zErr) == SQLITE_OK)
+		&& (sqlite3_expert_analyze(expert, &zErr) == SQLITE_OK))
+	{
+		QString report(QString::fromUtf8(
+			sqlite3_expert_report(expert, 0, EXPERT_REPORT_INDEXES)));
+		QRegExp re("CREATE INDEX (\\S+) ON (\\S+)\\((.*)\\);");
+		re.setMinimal(true);
+		int pos = 0;
+		while ((pos = re.indexIn(report, pos)) >= 0)
+		{
+			IndexCandidate c;
+			c.schema = "main";
+			c.name = re.cap(1).remove('\'').remove('"');
+			c.table = re.cap(2).remove('\'').remove('"');
+			c.columns = re.cap(3);
+			c.verified = false;
+			candidates.append(c);
+			pos += re.matchedLength();
+		}
+	}
+	else
+	{
+		*error = zErr ? QString::fromUtf8(zErr)
+					  : tr("Cannot start the sqlite3 expert");
+	}
+	sqlite3_free(zErr);
+	if (expert) { sqlite3_expert_destroy(expert); }
+#else
+	Q_UNUSED(sql);
+	*error = tr("Sqliteman was built without the sqlite3 expert extension");
+#endif
+	return candidates;
+}
+
+QList<IndexCandidate> IndexAdvisor::guessCandidates(const QString & sql,
+	const QList<QueryPlanNode> & plan)
+{
+	QList<IndexCandidate> candidates;
+	QStringList done;
+	foreach (QueryPlanNode node, plan)
+	{
+		if (   (QueryPlan::kind(node.detail) != QueryPlan::Scan)
+			|| node.table.isEmpty()
+			|| done.contains(node.table, Qt::CaseInsensitive))
+		{
+			continue;
+		}
+		done.append(node.table);
+		QString schema(findSchema(node.table));
+		if (schema.isEmpty()) { continue; }
+
+		// Columns compared with "=", "IN" or "IS" can all go in the
+		// index; only the first range column is useful after them.
+		QStringList eq;
+		QStringList range;
+		foreach (FieldInfo f, Database::tableFields(node.table, schema))
+		{
+			QString ident(QString("(?:^|[^\\w\"`\\]])[\"`\\[]?%1[\"`\\]]?\\s*")
+						  .arg(QRegExp::escape(f.name)));
+			QRegExp eqRe(ident + "(?:=|IN\\b|IS\\b)", Qt::CaseInsensitive);
+			QRegExp rangeRe(ident + "(?:<(?!>)|>|BETWEEN\\b|LIKE\\b|GLOB\\b)",
+							Qt::CaseInsensitive);
+			if (eqRe.indexIn(sql) >= 0) { eq.append(f.name); }
+			else if (rangeRe.indexIn(sql) >= 0) { range.append(f.name); }
+		}
+		if (eq.isEmpty() && range.isEmpty()) { continue; }
+		QStringList cols(eq);
+		if (!range.isEmpty()) { cols.append(range.first()); }
+
+		IndexCandidate c;
+		c.schema = schema;
+		c.table = node.table;
+		c.columns = Utils::q(cols, "\"");
+		c.verified = false;
+		QString base(QString("idx_%1_%2").arg(node.table).arg(cols.join("_"))
+					 .replace(QRegExp("\\W"), "_"));
+		QStringList existing(Database::getObjects(QString(), schema).values());
+		c.name = base;
+		for (int i = 1; existing.contains(c.name, Qt::CaseInsensitive); ++i)
+		{
+			c.name = QString("%1_%2").arg(base).arg(i);
+		}
+		candidates.append(c);
+	}
+	return candidates;
+}
+
+void IndexAdvisor::whatIf(const QString & sql,
+						  QList<IndexCandidate> & candidates)
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	QSqlQuery query(db);
+	if (!query.exec("SAVEPOINT INDEX_ADVISOR;")) { return; }
+
+	// Empty copies of the tables (with their existing indexes) in temp
+	// hide the real ones, so building a candidate costs nothing.
+	QStringList shadowed;
+	QStringList failed;
+	foreach (IndexCandidate c, candidates)
+	{
+		if (   shadowed.contains(c.table, Qt::CaseInsensitive)
+			|| failed.contains(c.table, Qt::CaseInsensitive))
+		{
+			continue;
+		}
+		bool ok = (c.schema != "temp");
+		QSqlQuery master(db);
+		master.prepare(QString("SELECT type, sql FROM %1"
+							   " WHERE lower(tbl_name) = lower(?)"
+							   " AND sql NOT NULL AND type IN ('table', 'index')"
+							   " ORDER BY type = 'index';")
+					   .arg(Database::getMaster(c.schema)));
+		master.addBindValue(c.table);
+		ok = ok && master.exec();
+		while (ok && master.next())
+		{
+			QString create(master.value(1).toString());
+			QRegExp re(master.value(0).toString() == "table"
+					   ? "^CREATE\\s+TABLE\\s+"
+					   : "^CREATE\\s+(UNIQUE\\s+)?INDEX\\s+",
+					   Qt::CaseInsensitive);
+			if (re.indexIn(create) != 0) { ok = false; break; }
+			create.replace(0, re.matchedLength(),
+						   master.value(0).toString() == "table"
+						   ? QString("CREATE TEMP TABLE ")
+						   : QString("CREATE %1INDEX temp.").arg(re.cap(1)));
+			ok = query.exec(create);
+		}
+		if (ok) { shadowed.append(c.table); }
+		else { failed.append(c.table); }
+	}
+
+	QString baseline(QueryPlan::fingerprint(QueryPlan::explain(sql)));
+	for (int i = 0; i < candidates.count(); )
+	{
+		IndexCandidate & c = candidates[i];
+		if (   shadowed.contains(c.table, Qt::CaseInsensitive)
+			&& query.exec(QString("CREATE INDEX temp.%1 ON %2 (%3);")
+						  .arg(Utils::q(c.name), Utils::q(c.table), c.columns)))
+		{
+			c.plan = QueryPlan::explain(sql);
+			c.verified = true;
+			query.exec(QString("DROP INDEX temp.%1;").arg(Utils::q(c.name)));
+			// sqlite wouldn't use it
+			if (QueryPlan::fingerprint(c.plan) == baseline)
+			{
+				candidates.removeAt(i);
+				continue;
+			}
+		}
+		++i;
+	}
+
+	query.exec("ROLLBACK TO INDEX_ADVISOR;");
+	query.exec("RELEASE INDEX_ADVISOR;");
+}
+
+
+IndexAdvisorDialog::IndexAdvisorDialog(const QString & sql,
+									   LiteManWindow * parent)
+	: QDialog(parent),
+	  m_schemaChanged(false)
+{
+	creator = parent;
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("indexadvisor/height", QVariant(500)).toInt();
+	int ww = settings.value("indexadvisor/width", QVariant(700)).toInt();
+	resize(ww, hh);
+
+	ui.sqlLabel->setText(sql.simplified());
+	ui.sourceLabel->setText(IndexAdvisor::haveExpert()
+		? tr("Candidates are proposed by the sqlite3 expert extension.")
+		: tr("Candidates are guessed from the full scans in the plan."));
+	ui.applyButton->setEnabled(false);
+
+	QString error;
+	QList<QueryPlanNode> before;
+	QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+	m_candidates = IndexAdvisor::advise(sql, &before, &error);
+	QApplication::restoreOverrideCursor();
+	if (!error.isEmpty())
+	{
+		ui.resultEdit->setHtml(tr("Cannot explain the statement")
+			+ ":<br/><span style=\" color:#ff0000;\">" + error
+			+ "<br/></span>");
+		return;
+	}
+	QueryPlan::fillTree(ui.beforeTree, before);
+	if (m_candidates.isEmpty())
+	{
+		ui.resultEdit->setHtml(tr("No index would change the plan of this statement."));
+	}
+
+	int scans = QueryPlan::fullScans(before);
+	ui.candidateTable->setRowCount(m_candidates.count());
+	for (int i = 0; i < m_candidates.count(); ++i)
+	{
+		const IndexCandidate & c = m_candidates.at(i);
+		QTableWidgetItem * item = new QTableWidgetItem(
+			IndexAdvisor::createStatement(c));
+		item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+		ui.candidateTable->setItem(i, 0, item);
+		item = new QTableWidgetItem(c.verified
+			? tr("%1 (was %2)").arg(QueryPlan::fullScans(c.plan)).arg(scans)
+			: tr("not checked"));
+		item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+		ui.candidateTable->setItem(i, 1, item);
+	}
+	ui.candidateTable->resizeColumnsToContents();
+
+	connect(ui.candidateTable, SIGNAL(currentCellChanged(int, int, int, int)),
+			this, SLOT(candidateTable_currentCellChanged(int, int, int, int)));
+	connect(ui.applyButton, SIGNAL(clicked()),
+			this, SLOT(applyButton_clicked()));
+	if (!m_candidates.isEmpty()) { ui.candidateTable->selectRow(0); }
+}
+
+IndexAdvisorDialog::~IndexAdvisorDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("indexadvisor/height", QVariant(height()));
+	settings.setValue("indexadvisor/width", QVariant(width()));
+}
+
+void IndexAdvisorDialog::candidateTable_currentCellChanged(int row,
+														   int, int, int)
+{
+	ui.afterTree->clear();
+	ui.applyButton->setEnabled((row >= 0) && (row < m_candidates.count()));
+	if (!ui.applyButton->isEnabled()) { return; }
+	QueryPlan::fillTree(ui.afterTree, m_candidates.at(row).plan);
+}
+
+void IndexAdvisorDialog::applyButton_clicked()
+{
+	int row = ui.candidateTable->currentRow();
+	if ((row < 0) || (row >= m_candidates.count())) { return; }
+	if (creator && !creator->checkForPending()) { return; }
+
+	QString sql(IndexAdvisor::createStatement(m_candidates.at(row)));
+	QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	QApplication::restoreOverrideCursor();
+	if (query.lastError().isValid())
+	{
+		ui.resultEdit->setHtml(tr("Error while creating index ")
+							   + m_candidates.at(row).name
+							   + ":<br/><span style=\" color:#ff0000;\">"
+							   + query.lastError().text()
+							   + "<br/></span>" + tr("using sql statement:")
+							   + "<br/><tt>" + sql);
+		return;
+	}
+	ui.resultEdit->setHtml(tr("Index created successfully."));
+	if (Utils::updateObjectTree(sql)) { m_schemaChanged = true; }
+	m_candidates.removeAt(row);
+	ui.candidateTable->removeRow(row);
+}
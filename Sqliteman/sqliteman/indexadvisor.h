@@ -0,0 +1,106 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef INDEXADVISOR_H
+#define INDEXADVISOR_H
+
+#include <QDialog>
+
+#include "queryplan.h"
+#include "ui_indexadvisordialog.h"
+
+class LiteManWindow;
+
+
+/*! \brief One proposed index with the plan the statement would get.
+*/
+typedef struct
+{
+	QString schema;
+	QString table;
+	QString name;
+	//! \brief SQL text of the indexed column list (without parentheses)
+	QString columns;
+	//! \brief false when the what-if check could not be done
+	bool verified;
+	QList<QueryPlanNode> plan;
+}
+IndexCandidate;
+
+
+/*! \brief Index advisor for a single statement.
+When Sqliteman is built with the sqlite3 expert extension
+(-DSQLITE_EXPERT_DIR=...) the candidates come from sqlite3_expert_*,
+the engine behind the shell's .expert command. Otherwise they are
+guessed from the full scans in the plan and the columns compared in
+the statement.
+Each candidate is checked by creating it on empty copies of its table
+in the temp schema inside a savepoint which is rolled back afterwards,
+so the real data is never touched.
+*/
+class IndexAdvisor
+{
+		Q_DECLARE_TR_FUNCTIONS(IndexAdvisor)
+
+	public:
+		/*! \brief Collect index candidates for sql.
+		\param sql a single statement
+		\param before set to the current plan of sql
+		\param error set on failure
+		*/
+		static QList<IndexCandidate> advise(const QString & sql,
+											QList<QueryPlanNode> * before,
+											QString * error);
+
+		//! \brief CREATE INDEX statement for the real schema.
+		static QString createStatement(const IndexCandidate & candidate);
+
+		//! \brief true when candidates are produced by sqlite3_expert.
+		static bool haveExpert();
+
+	private:
+		static QString findSchema(const QString & table);
+		static QList<IndexCandidate> expertCandidates(const QString & sql,
+													  QString * error);
+		static QList<IndexCandidate> guessCandidates(const QString & sql,
+			const QList<QueryPlanNode> & plan);
+		static void whatIf(const QString & sql,
+						   QList<IndexCandidate> & candidates);
+};
+
+
+/*! \brief Show index advice for the statement under the cursor.
+The candidate CREATE INDEX statements are listed with the plan before
+and after; the selected one can be applied to the schema.
+*/
+class IndexAdvisorDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		IndexAdvisorDialog(const QString & sql, LiteManWindow * parent = 0);
+		~IndexAdvisorDialog();
+
+		//! \brief true if any index was created in the schema.
+		bool schemaChanged() { return m_schemaChanged; }
+
+	private:
+		Ui::IndexAdvisorDialog ui;
+
+		QList<IndexCandidate> m_candidates;
+		bool m_schemaChanged;
+
+		// We ought to be able use use parent() for this, but for some reason
+		// qobject_cast<LiteManWindow*>(parent()) doesn't work
+		LiteManWindow * creator;
+
+	private slots:
+		void candidateTable_currentCellChanged(int row, int, int, int);
+		void applyButton_clicked();
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "database.h"
+#include "indexbuilder.h"
+
+
+IndexBuilder::IndexBuilder(const QString & sql, const QString & schema,
+						   qlonglong pages, QObject * parent)
+	: DatabaseWorker(Database::sqlite3handle(), parent),
+	  m_sql(sql),
+	  m_pages(pages),
+	  m_startPages(0)
+{
+	useOwnConnection(schema, true);
+}
+
+int IndexBuilder::progressHandler(void * worker)
+{
+	IndexBuilder * self = (IndexBuilder *)worker;
+	if (self->m_pages > 0)
+	{
+		qlonglong done = self->pagesRead() - self->m_startPages;
+		self->reportProgress(qMin(done, self->m_pages), self->m_pages);
+	}
+	return self->isCancelled() ? 1 : 0;
+}
+
+void IndexBuilder::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	m_startPages = pagesRead();
+	sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+	if (!exec(m_sql) && isCancelled())
+		m_error = tr("Cancelled");
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+}
@@ -0,0 +1,43 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef INDEXBUILDER_H
+#define INDEXBUILDER_H
+
+#include "databaseworker.h"
+
+
+/*! \brief Runs a CREATE INDEX statement on a worker thread.
+In WAL mode it uses a connection of its own, so the main one stays
+free; otherwise the main connection (see
+DatabaseWorker::useOwnConnection()).
+Progress is the number of pages the connection has fetched (page cache
+hits and misses) against the pages of the table, polled by a
+sqlite3_progress_handler() which also stops the statement on cancel.
+Writing the index fetches pages too, so it is only an estimate.
+*/
+class IndexBuilder : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		//! \param pages expected pages of the table, 0 if unknown
+		IndexBuilder(const QString & sql, const QString & schema,
+					 qlonglong pages, QObject * parent = 0);
+
+	protected:
+		void run();
+
+	private:
+		QString m_sql;
+		qlonglong m_pages;
+		int m_startPages;
+
+		static int progressHandler(void * worker);
+};
+
+#endif
@@ -34,14 +34,18 @@ for which a new license (GPL+exception) is in place.
 #include "altertriggerdialog.h"
 #include "alterviewdialog.h"
 #include "analyzedialog.h"
+#include "backupdialog.h"
 #include "buildtime.h"
+#include "checkdialog.h"
 #include "constraintsdialog.h"
 #include "createindexdialog.h"
 #include "createtabledialog.h"
 #include "createtriggerdialog.h"
 #include "createviewdialog.h"
 #include "database.h"
+#include "databaseworker.h"
 #include "dataviewer.h"
+#include "fingerprintdialog.h"
 #include "helpbrowser.h"
 #include "importtabledialog.h"
 #include "litemanwindow.h"
@@ -49,10 +53,14 @@ for which a new license (GPL+exception) is in place.
 #include "preferences.h"
 #include "preferencesdialog.h"
 #include "queryeditordialog.h"
+#include "queryhistory.h"
 #include "schemabrowser.h"
+#include "schemacatalog.h"
+#include "scriptrunner.h"
 #include "sqleditor.h"
 #include "sqliteprocess.h"
 #include "sqlmodels.h"
+#include "tablediffdialog.h"
 #include "utils.h"
 #include "vacuumdialog.h"
 
@@ -110,6 +118,9 @@ LiteManWindow::LiteManWindow(const QString & fileToOpen)
 
 LiteManWindow::~LiteManWindow()
 {
+	QueryHistory::deleteInstance();
+	SchemaCatalog::deleteInstance();
+	MainConnectionMonitor::deleteInstance();
 	Preferences::deleteInstance();
 }
 
@@ -170,7 +181,9 @@ void LiteManWindow::closeEvent(QCloseEvent * e)
 	dataViewer->setTableModel(new QSqlQueryModel(), false);
 	if (QSqlDatabase::contains(SESSION_NAME))
 	{
+		SchemaCatalog::instance()->reset();
 		QSqlDatabase::database(SESSION_NAME).rollback();
+		Database::optimize();
 		QSqlDatabase::database(SESSION_NAME).close();
 		QSqlDatabase::removeDatabase(SESSION_NAME);
 	}
@@ -225,8 +238,12 @@ void LiteManWindow::initUI()
 			dataViewer, SLOT(sqlScriptStart()));
 	connect(sqlEditor, SIGNAL(showSqlScriptResult(QString)),
 			dataViewer, SLOT(showSqlScriptResult(QString)));
+	connect(sqlEditor, SIGNAL(scriptResult(SqlQueryModel *)),
+			dataViewer, SLOT(addScriptResult(SqlQueryModel *)));
+	connect(dataViewer, SIGNAL(scriptResultSelected(SqlQueryModel *)),
+			this, SLOT(openScriptResult(SqlQueryModel *)));
 	connect(sqlEditor, SIGNAL(buildTree()),
-			schemaBrowser->tableTree, SLOT(buildTree()));
+			schemaBrowser->tableTree, SLOT(updateTree()));
 	connect(sqlEditor, SIGNAL(refreshTable()),
 			this, SLOT(refreshTable()));
 
@@ -299,6 +316,12 @@ void LiteManWindow::initActions()
 	connect(dumpDatabaseAct, SIGNAL(triggered()), this, SLOT(dumpDatabase()));
 // 	dumpDatabaseAct->setEnabled(m_sqliteBinAvailable);
 
+	backupAct = new QAction(tr("&Back Up Database..."), this);
+	connect(backupAct, SIGNAL(triggered()), this, SLOT(backupDialog()));
+
+	executeFileAct = new QAction(tr("E&xecute SQL File..."), this);
+	connect(executeFileAct, SIGNAL(triggered()), this, SLOT(executeFile()));
+
 	createTableAct = new QAction(Utils::getIcon("table.png"),
 								 tr("&Create Table..."), this);
 	createTableAct->setShortcut(tr("Ctrl+T"));
@@ -369,12 +392,26 @@ void LiteManWindow::initActions()
 	vacuumAct = new QAction(tr("&Vacuum..."), this);
 	connect(vacuumAct, SIGNAL(triggered()), this, SLOT(vacuumDialog()));
 
+	checkAct = new QAction(tr("&Check Database..."), this);
+	connect(checkAct, SIGNAL(triggered()), this, SLOT(checkDialog()));
+
+	fingerprintAct = new QAction(tr("&Fingerprint Tables..."), this);
+	connect(fingerprintAct, SIGNAL(triggered()),
+			this, SLOT(fingerprintTables()));
+
+	contextFingerprintAct = new QAction(tr("&Fingerprint Table..."), this);
+	connect(contextFingerprintAct, SIGNAL(triggered()),
+			this, SLOT(contextFingerprintTable()));
+
 	attachAct = new QAction(tr("A&ttach Database..."), this);
 	connect(attachAct, SIGNAL(triggered()), this, SLOT(attachDatabase()));
 
 	detachAct = new QAction(tr("&Detach Database"), this);
 	connect(detachAct, SIGNAL(triggered()), this, SLOT(detachDatabase()));
 
+	compareAct = new QAction(tr("Com&pare Tables..."), this);
+	connect(compareAct, SIGNAL(triggered()), this, SLOT(compareTables()));
+
 #ifdef ENABLE_EXTENSIONS
 	loadExtensionAct = new QAction(tr("&Load Extensions..."), this);
 	connect(loadExtensionAct, SIGNAL(triggered()), this, SLOT(loadExtension()));
@@ -412,13 +449,18 @@ void LiteManWindow::initMenus()
 	databaseMenu->addSeparator();
 	databaseMenu->addAction(exportSchemaAct);
 	databaseMenu->addAction(dumpDatabaseAct);
+	databaseMenu->addAction(backupAct);
+	databaseMenu->addAction(executeFileAct);
 	databaseMenu->addAction(importTableAct);
 
 	adminMenu = menuBar()->addMenu(tr("&System"));
 	adminMenu->addAction(analyzeAct);
 	adminMenu->addAction(vacuumAct);
+	adminMenu->addAction(checkAct);
+	adminMenu->addAction(fingerprintAct);
 	adminMenu->addSeparator();
 	adminMenu->addAction(attachAct);
+	adminMenu->addAction(compareAct);
 #ifdef ENABLE_EXTENSIONS
 	adminMenu->addSeparator();
 	adminMenu->addAction(loadExtensionAct);
@@ -580,6 +622,8 @@ void LiteManWindow::openDatabase(const QString & fileName)
 	 * scope by the time removeDatabase() gets called, otherwise it thinks that
 	 * there is an outstanding reference and prints a warning message.
 	 */
+	// the cached schema belongs to the old connection
+	SchemaCatalog::instance()->reset();
 	bool isValid = false;
 	{
 		QSqlDatabase old = QSqlDatabase::database(SESSION_NAME);
@@ -588,6 +632,7 @@ void LiteManWindow::openDatabase(const QString & fileName)
 			isValid = true;
 			removeRef("temp");
 			removeRef("main");
+			Database::optimize();
 			old.close();
 		}
 	}
@@ -851,12 +896,16 @@ void LiteManWindow::execSql(QString query, bool isBuilt)
 
 	sqlEditor->setStatusMessage();
 
+	// The plan is taken before running so DDL can still be explained.
+	QList<QueryPlanNode> plan(QueryPlan::explain(query));
+
 	QTime time;
 	time.start();
 
 	// Run query
 	SqlQueryModel * model = new SqlQueryModel(this);
 	model->setQuery(query, QSqlDatabase::database(SESSION_NAME));
+	int duration = time.elapsed();
 
 	if (!dataViewer->setTableModel(model, false))
 		return;
@@ -877,11 +926,18 @@ void LiteManWindow::execSql(QString query, bool isBuilt)
 	}
 	else
 	{
+		QueryHistory::instance()->record(query, duration,
+			model->columnCount() > 0 ? model->rowCount()
+									 : model->query().numRowsAffected(),
+			plan);
+		QString historyError(QueryHistory::instance()->takeError());
+		if (!historyError.isEmpty())
+			statusBar()->showMessage(historyError);
 		dataViewer->setBuiltQuery(isBuilt && (model->rowCount() != 0));
 		dataViewer->rowCountChanged();
 		if (Utils::updateObjectTree(query))
 		{
-			schemaBrowser->tableTree->buildTree();
+			schemaBrowser->tableTree->updateTree();
 			queryEditor->treeChanged();
 		}
 	}
@@ -892,6 +948,23 @@ void LiteManWindow::execSqlFalse(QString query)
 	execSql(query, false);
 }
 
+void LiteManWindow::openScriptResult(SqlQueryModel * model)
+{
+	dataViewer->setStatusText("");
+	if (!checkForPending()) { return; }
+	m_activeItem = 0;
+
+	// the result tab keeps its own reference
+	model->attach();
+	if (!dataViewer->setTableModel(model, false))
+		SqlQueryModel::detach(model);
+}
+
+void LiteManWindow::selectScriptResult()
+{
+	dataViewer->selectScriptResult();
+}
+
 void LiteManWindow::exportSchema()
 {
 	dataViewer->removeErrorMessage();
@@ -922,6 +995,49 @@ void LiteManWindow::dumpDatabase()
 	}
 }
 
+void LiteManWindow::backupDialog()
+{
+	dataViewer->removeErrorMessage();
+	BackupDialog *dia = new BackupDialog(this);
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::executeFile()
+{
+	dataViewer->removeErrorMessage();
+	if (!checkForPending()) { return; }
+	QString fileName = QFileDialog::getOpenFileName(this,
+						tr("Execute SQL File"),
+						QDir::currentPath(),
+						tr("SQL File (*.sql);;All Files (*)"));
+	if (fileName.isNull())
+		return;
+
+	int ret = QMessageBox::question(this, m_appName,
+		tr("Run the whole file as a single transaction?\n\n"
+		   "An error then rolls back all of its changes. "
+		   "BEGIN and COMMIT statements in the file are skipped."),
+		QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel,
+		QMessageBox::Yes);
+	if (ret == QMessageBox::Cancel)
+		return;
+
+	ScriptRunner runner(Database::sqlite3handle(), fileName,
+						ret == QMessageBox::Yes);
+	connect(&runner, SIGNAL(message(QString)),
+			dataViewer, SLOT(showSqlScriptResult(QString)));
+	dataViewer->sqlScriptStart();
+	runner.runWithProgress(tr("Executing %1").arg(fileName), this);
+
+	if (runner.executed())
+	{
+		schemaBrowser->tableTree->updateTree();
+		refreshTable();
+		buildPragmasTree();
+	}
+}
+
 // FIXME allow create temporary table here
 void LiteManWindow::createTable()
 {
@@ -1183,6 +1299,7 @@ void LiteManWindow::alterView()
 	dia.exec();
 	if (dia.update)
 	{
+		schemaBrowser->tableTree->ensurePopulated(item);
 		QTreeWidgetItem * triggers = item->child(0);
 		if (triggers)
 		{
@@ -1414,6 +1531,7 @@ void LiteManWindow::updateContextMenu(QTreeWidgetItem * cur)
 			contextMenu->addAction(contextBuildQueryAct);
 			contextMenu->addAction(createIndexAct);
 			contextMenu->addAction(reindexAct);
+			contextMenu->addAction(contextFingerprintAct);
 			contextMenu->addSeparator();
 			contextMenu->addAction(importTableAct);
 			contextMenu->addAction(populateTableAct);
@@ -1481,6 +1599,42 @@ void LiteManWindow::vacuumDialog()
 	delete dia;
 }
 
+void LiteManWindow::checkDialog()
+{
+	dataViewer->removeErrorMessage();
+	CheckDialog *dia = new CheckDialog(this);
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::fingerprintTables()
+{
+	dataViewer->removeErrorMessage();
+	FingerprintDialog *dia = new FingerprintDialog(this);
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::contextFingerprintTable()
+{
+	dataViewer->removeErrorMessage();
+	QTreeWidgetItem * item = schemaBrowser->tableTree->currentItem();
+	if (!item) { return; }
+
+	FingerprintDialog *dia =
+		new FingerprintDialog(this, item->text(1), item->text(0));
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::compareTables()
+{
+	dataViewer->removeErrorMessage();
+	TableDiffDialog *dia = new TableDiffDialog(this);
+	dia->exec();
+	delete dia;
+}
+
 void LiteManWindow::attachDatabase()
 {
 	dataViewer->removeErrorMessage();
@@ -1635,6 +1789,7 @@ void LiteManWindow::createTrigger()
 	}
 	else
 	{
+		schemaBrowser->tableTree->ensurePopulated(item);
 		for (int i = 0; i < item->childCount(); ++i)
 		{
 			if (item->child(i)->type() == TableTree::TriggersItemType)
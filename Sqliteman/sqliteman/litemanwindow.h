@@ -51,6 +51,8 @@ class LiteManWindow : public QMainWindow
 		void checkForCatalogue();
 		void createViewFromSql(QString query);
 		void setTableModel(SqlQueryModel * model);
+		//! \brief Open the last result of Run as Script.
+		void selectScriptResult();
 
 		QueryEditorDialog * queryEditor;
 
@@ -121,8 +123,14 @@ class LiteManWindow : public QMainWindow
 		void contextBuildQuery();
 		void execSql(QString query, bool isBuilt);
 		void execSqlFalse(QString query);
+		//! \brief Show a result read by Run as Script.
+		void openScriptResult(SqlQueryModel * model);
 		void exportSchema();
 		void dumpDatabase();
+		//! \brief Copy a database into a file, see BackupDialog.
+		void backupDialog();
+		//! \brief Run an SQL file from the disk, see ScriptRunner.
+		void executeFile();
 
 		void createTable();
 		void dropTable();
@@ -155,8 +163,15 @@ class LiteManWindow : public QMainWindow
 
 		void analyzeDialog();
 		void vacuumDialog();
+		//! \brief Integrity and foreign key checks, see CheckDialog.
+		void checkDialog();
+		//! \brief Table checksums, see FingerprintDialog.
+		void fingerprintTables();
+		void contextFingerprintTable();
 		void attachDatabase();
 		void detachDatabase();
+		//! \brief Diff of a table in two databases, see TableDiffDialog.
+		void compareTables();
 		void loadExtension();
 
 		void createTrigger();
@@ -232,11 +247,17 @@ class LiteManWindow : public QMainWindow
 		QAction * contextBuildQueryAct;
 		QAction * exportSchemaAct;
 		QAction * dumpDatabaseAct;
+		QAction * backupAct;
+		QAction * executeFileAct;
 
 		QAction * analyzeAct;
 		QAction * vacuumAct;
+		QAction * checkAct;
+		QAction * fingerprintAct;
+		QAction * contextFingerprintAct;
 		QAction * attachAct;
 		QAction * detachAct;
+		QAction * compareAct;
 #ifdef ENABLE_EXTENSIONS
 		QAction * loadExtensionAct;
 #endif
@@ -23,6 +23,7 @@ for which a new license (GPL+exception) is in place.
 #include <QTextStream>
 #include <QtDebug> //qDebug
 
+#include "batchmode.h"
 #include "litemanwindow.h"
 #include "preferences.h"
 #include "utils.h"
@@ -150,6 +151,16 @@ bool ArgsParser::parseArgs()
 			cout << QString("  --lang    -l  set a GUI language. E.g. --lang cs for Czech") << endl;
 			cout << QString("  --langs   -la lists available languages") << endl;
 			cout << QString("  + various Qt options") << endl << endl;
+			cout << QString("batch mode, without GUI:") << endl;
+			cout << QString("sqliteman --db databasefile [batch options]") << endl;
+			cout << QString("  --import file     import CSV file (- for stdin) into --table") << endl;
+			cout << QString("  --table name      target table of --import") << endl;
+			cout << QString("  --separator sep   CSV column separator, \",\" by default") << endl;
+			cout << QString("  --skip-header     skip the first line of the CSV file") << endl;
+			cout << QString("  --exec file       run SQL script (- for stdin)") << endl;
+			cout << QString("  --export csv      write result rows of --exec as CSV") << endl;
+			cout << QString("  --out file        output of --export, stdout by default") << endl;
+			cout << QString("  --dump file       dump schema and data (- for stdout)") << endl << endl;
 			return false;
 		}
 		else if (arg == ARG_AVAILLANG || arg == ARG_AVAILLANG_SHORT)
@@ -176,6 +187,14 @@ bool ArgsParser::parseArgs()
 
 int main(int argc, char ** argv)
 {
+	if (BatchMode::requested(argc, argv))
+	{
+		// no widgets at all, so it runs without a display (cron etc.)
+		QCoreApplication app(argc, argv);
+		BatchMode batch(argc, argv);
+		return batch.run();
+	}
+
 	QApplication app(argc, argv);
 #ifndef  WIN32
 	initCrashHandler();
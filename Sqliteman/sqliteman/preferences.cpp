@@ -35,6 +35,7 @@ Preferences::Preferences(QObject *parent)
 	m_readRows = s.value("prefs/readRowsComboBox", 0).toInt();
 	m_lastDB = s.value("lastDatabase", QString()).toString();
 	m_newInItemView = s.value("prefs/openNewInItemView", false).toBool();
+	m_optimizeOnClose = s.value("prefs/optimizeOnClose", true).toBool();
 	m_GUItranslator = s.value("prefs/languageComboBox", 0).toInt();
 	m_GUIstyle = s.value("prefs/styleComboBox", 0).toInt();
 	m_GUIfont = s.value("prefs/applicationFont", f).value<QFont>();
@@ -87,6 +88,7 @@ Preferences::~Preferences()
 	settings.setValue("prefs/openLastDB", m_openLastDB);
 	settings.setValue("prefs/openLastSqlFile", m_openLastSqlFile);
 	settings.setValue("prefs/openNewInItemView", m_newInItemView);
+	settings.setValue("prefs/optimizeOnClose", m_optimizeOnClose);
 	settings.setValue("prefs/readRowsComboBox", m_readRows);
 	// data results
 	settings.setValue("prefs/nullCheckBox", m_nullHighlight);
@@ -64,6 +64,10 @@ class Preferences : public QObject
 		bool openNewInItemView() { return m_newInItemView; }
 		void setOpenNewInItemView(bool v) { m_newInItemView = v; }
 
+		//! \brief Run PRAGMA optimize before a database is closed.
+		bool optimizeOnClose() { return m_optimizeOnClose; }
+		void setOptimizeOnClose(bool v) { m_optimizeOnClose = v; }
+
 		int GUItranslator() { return m_GUItranslator; };
 		void setGUItranslator(int v) { m_GUItranslator = v; };
 
@@ -171,6 +175,7 @@ class Preferences : public QObject
 		int m_readRows;
 		QString m_lastDB;
 		bool m_newInItemView;
+		bool m_optimizeOnClose;
 		int m_GUItranslator;
 		int m_GUIstyle;
 		QFont m_GUIfont;
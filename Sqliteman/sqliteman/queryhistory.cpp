@@ -0,0 +1,214 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#ifdef INTERNAL_SQLDRIVER
+#include "driver/qsql_sqlite.h"
+#endif
+
+#include "database.h"
+#include "queryhistory.h"
+#include "utils.h"
+
+// runs kept in the history database
+#define HISTORY_LIMIT 10000
+// previous runs used for the median
+#define HISTORY_MEDIAN_RUNS 20
+// a run is "slower" when it takes more than FACTOR * median and at
+// least MIN_DELTA ms more, so very fast statements don't flap
+#define HISTORY_SLOWER_FACTOR 2
+#define HISTORY_SLOWER_MIN_DELTA 50
+
+
+QueryHistory * QueryHistory::_instance = 0;
+
+QueryHistory * QueryHistory::instance()
+{
+	if (_instance == 0)
+		_instance = new QueryHistory();
+
+	return _instance;
+}
+
+void QueryHistory::deleteInstance()
+{
+	if (_instance)
+		delete _instance;
+	_instance = 0;
+}
+
+QueryHistory::QueryHistory()
+	: m_ok(false)
+{
+	m_last.durationMs = -1;
+
+#ifdef INTERNAL_SQLDRIVER
+	QSqlDatabase db =
+		QSqlDatabase::addDatabase(new QSQLiteDriver(), HISTORY_SESSION_NAME);
+#else
+	QSqlDatabase db =
+		QSqlDatabase::addDatabase("QSQLITE", HISTORY_SESSION_NAME);
+#endif
+	db.setDatabaseName(QDir::home().filePath(".sqliteman-history.db"));
+	if (!db.open())
+	{
+		m_error = tr("Cannot open query history: %1")
+				  .arg(db.lastError().text());
+		return;
+	}
+
+	QSqlQuery query(db);
+	// losing the last runs in a crash is fine, an fsync per statement
+	// executed in Sqliteman is not
+	query.exec("PRAGMA synchronous = OFF;");
+	m_ok = query.exec("CREATE TABLE IF NOT EXISTS history ("
+					  "id INTEGER PRIMARY KEY,"
+					  " sql TEXT NOT NULL,"
+					  " sql_hash TEXT NOT NULL,"
+					  " run_at INTEGER NOT NULL,"
+					  " duration_ms INTEGER,"
+					  " rows INTEGER,"
+					  " full_scans INTEGER,"
+					  " plan TEXT,"
+					  " slower INTEGER DEFAULT 0,"
+					  " plan_changed INTEGER DEFAULT 0);")
+		   && query.exec("CREATE INDEX IF NOT EXISTS history_hash"
+						 " ON history (sql_hash, run_at);")
+		   && query.exec("CREATE INDEX IF NOT EXISTS history_run_at"
+						 " ON history (run_at);");
+	if (!m_ok)
+	{
+		m_error = tr("Cannot create query history: %1")
+				  .arg(query.lastError().text());
+	}
+}
+
+QueryHistory::~QueryHistory()
+{
+	QSqlDatabase::database(HISTORY_SESSION_NAME).close();
+	QSqlDatabase::removeDatabase(HISTORY_SESSION_NAME);
+}
+
+QString QueryHistory::hash(const QString & sql)
+{
+	QString key(QSqlDatabase::database(SESSION_NAME).databaseName()
+				+ "\n" + sql.simplified());
+	return QCryptographicHash::hash(key.toUtf8(),
+									QCryptographicHash::Md5).toHex();
+}
+
+QueryProfile QueryHistory::record(const QString & sql, int durationMs,
+								  int rows, const QList<QueryPlanNode> & plan)
+{
+	QueryProfile p;
+	p.sql = sql;
+	p.runAt = QDateTime::currentDateTime();
+	p.durationMs = durationMs;
+	p.rows = rows;
+	p.fullScans = QueryPlan::fullScans(plan);
+	p.plan = plan.isEmpty() ? QString() : QueryPlan::fingerprint(plan);
+	p.previousMedian = -1;
+	p.slower = false;
+	p.planChanged = false;
+	m_last = p;
+	if (!m_ok) { return p; }
+
+	QSqlDatabase db(QSqlDatabase::database(HISTORY_SESSION_NAME));
+	QString h(hash(sql));
+	QSqlQuery query(db);
+	query.prepare(QString("SELECT duration_ms, plan FROM history"
+						  " WHERE sql_hash = ? ORDER BY run_at DESC LIMIT %1;")
+				  .arg(HISTORY_MEDIAN_RUNS));
+	query.addBindValue(h);
+	QList<int> durations;
+	QString lastPlan;
+	if (query.exec())
+	{
+		while (query.next())
+		{
+			if (durations.isEmpty()) { lastPlan = query.value(1).toString(); }
+			durations.append(query.value(0).toInt());
+		}
+	}
+	if (!durations.isEmpty())
+	{
+		qSort(durations);
+		p.previousMedian = durations.at(durations.count() / 2);
+		p.slower = (p.durationMs > HISTORY_SLOWER_FACTOR * p.previousMedian)
+				   && (p.durationMs - p.previousMedian
+					   >= HISTORY_SLOWER_MIN_DELTA);
+		p.planChanged = !p.plan.isEmpty() && !lastPlan.isEmpty()
+						&& (p.plan != lastPlan);
+	}
+
+	query.prepare("INSERT INTO history (sql, sql_hash, run_at, duration_ms,"
+				  " rows, full_scans, plan, slower, plan_changed)"
+				  " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);");
+	query.addBindValue(sql);
+	query.addBindValue(h);
+	query.addBindValue(p.runAt.toTime_t());
+	query.addBindValue(p.durationMs);
+	query.addBindValue(p.rows);
+	query.addBindValue(p.fullScans);
+	query.addBindValue(p.plan);
+	query.addBindValue(p.slower ? 1 : 0);
+	query.addBindValue(p.planChanged ? 1 : 0);
+	if (!query.exec())
+	{
+		m_error = tr("Cannot store query history: %1")
+				  .arg(query.lastError().text());
+	}
+	else
+	{
+		// ids grow by one per run, so this drops the oldest ones
+		query.exec(QString("DELETE FROM history WHERE id <= %1;")
+				   .arg(query.lastInsertId().toLongLong() - HISTORY_LIMIT));
+	}
+	m_last = p;
+	return p;
+}
+
+QString QueryHistory::takeError()
+{
+	QString error(m_error);
+	m_error.clear();
+	return error;
+}
+
+QList<QueryProfile> QueryHistory::recent(int limit, const QString & filter)
+{
+	QList<QueryProfile> list;
+	if (!m_ok) { return list; }
+
+	QString sql("SELECT sql, run_at, duration_ms, rows, full_scans, plan,"
+				" slower, plan_changed FROM history");
+	if (!filter.isEmpty())
+	{
+		sql += " WHERE sql LIKE " + Utils::like(filter);
+	}
+	sql += QString(" ORDER BY run_at DESC LIMIT %1;").arg(limit);
+	QSqlQuery query(sql, QSqlDatabase::database(HISTORY_SESSION_NAME));
+	while (query.next())
+	{
+		QueryProfile p;
+		p.sql = query.value(0).toString();
+		p.runAt = QDateTime::fromTime_t(query.value(1).toUInt());
+		p.durationMs = query.value(2).toInt();
+		p.rows = query.value(3).toInt();
+		p.fullScans = query.value(4).toInt();
+		p.plan = query.value(5).toString();
+		p.previousMedian = -1;
+		p.slower = query.value(6).toBool();
+		p.planChanged = query.value(7).toBool();
+		list.append(p);
+	}
+	return list;
+}
@@ -0,0 +1,99 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef QUERYHISTORY_H
+#define QUERYHISTORY_H
+
+#include <QCoreApplication>
+#include <QDateTime>
+
+#include "queryplan.h"
+
+#define HISTORY_SESSION_NAME "sqliteman-history"
+
+
+/*! \brief Execution profile of one run of a statement.
+*/
+typedef struct
+{
+	QString sql;
+	QDateTime runAt;
+	int durationMs;
+	//! \brief rows fetched (SELECT) or affected (DML)
+	int rows;
+	//! \brief number of SCAN steps in the query plan
+	int fullScans;
+	//! \brief QueryPlan::fingerprint() of the plan, empty if unknown
+	QString plan;
+	//! \brief median duration of the previous runs, -1 for a first run
+	int previousMedian;
+	//! \brief significantly slower than the previous median
+	bool slower;
+	//! \brief the plan differs from the previous run
+	bool planChanged;
+}
+QueryProfile;
+
+
+/*! \brief Persistent history of executed statements.
+Every run is stored with its timing, row count and plan fingerprint
+in a small sqlite database in the user's home directory, using its own
+connection (HISTORY_SESSION_NAME) so it never interferes with the
+user's database or transactions.
+Runs of the same statement on the same database file are matched by a
+hash of the database path and the simplified statement text.
+The history keeps the latest HISTORY_LIMIT runs; older ones are dropped
+as new ones are stored.
+QueryHistory is a singleton like Preferences.
+*/
+class QueryHistory
+{
+		Q_DECLARE_TR_FUNCTIONS(QueryHistory)
+
+	public:
+		static QueryHistory * instance();
+		static void deleteInstance();
+
+		/*! \brief Store a run and compare it with the previous ones.
+		\param sql the statement as executed
+		\param durationMs wall time of the execution
+		\param rows rows returned or affected
+		\param plan the plan the statement was executed with
+		\retval QueryProfile with the regression flags set
+		*/
+		QueryProfile record(const QString & sql, int durationMs, int rows,
+							const QList<QueryPlanNode> & plan);
+
+		//! \brief The profile returned by the latest record() call.
+		QueryProfile last() { return m_last; }
+
+		/*! \brief Latest runs, newest first.
+		\param limit maximum number of runs returned
+		\param filter only statements containing this text
+		*/
+		QList<QueryProfile> recent(int limit, const QString & filter = QString());
+
+		/*! \brief The error not reported yet, if any, and forget it.
+		History errors never stop the statement, they are only shown.
+		*/
+		QString takeError();
+
+	private:
+		QueryHistory();
+		~QueryHistory();
+
+		static QueryHistory * _instance;
+
+		//! \brief false when the history database cannot be used
+		bool m_ok;
+		QueryProfile m_last;
+		QString m_error;
+
+		QString hash(const QString & sql);
+};
+
+#endif
@@ -0,0 +1,420 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QCryptographicHash>
+#include <QRegExp>
+#include <QSet>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QTreeWidget>
+
+#include "database.h"
+#include "queryplan.h"
+#include "utils.h"
+
+
+QList<QueryPlanNode> QueryPlan::explain(const QString & sql, QString * error)
+{
+	QList<QueryPlanNode> nodes;
+	QSqlQuery query(QSqlDatabase::database(SESSION_NAME));
+	if (!query.exec(QString("EXPLAIN QUERY PLAN %1").arg(sql)))
+	{
+		if (error) { *error = query.lastError().text(); }
+		return nodes;
+	}
+	// sqlite < 3.24 returns selectid, order, from, detail
+	bool oldFormat = (query.record().fieldName(0) == "selectid");
+	while (query.next())
+	{
+		QueryPlanNode node;
+		if (oldFormat)
+		{
+			node.id = nodes.count() + 1;
+			node.parent = 0;
+		}
+		else
+		{
+			node.id = query.value(0).toInt();
+			node.parent = query.value(1).toInt();
+		}
+		node.detail = query.value(3).toString();
+		parseDetail(node);
+		nodes.append(node);
+	}
+	if (error) { *error = QString(); }
+	return nodes;
+}
+
+void QueryPlan::parseDetail(QueryPlanNode & node)
+{
+	node.equalities = 0;
+	// "SCAN TABLE t AS a" before 3.36, "SCAN t" since
+	QRegExp tableRe("^(?:SCAN|SEARCH)(?: TABLE)? (\\S+)");
+	if (   (tableRe.indexIn(node.detail) == 0)
+		&& (tableRe.cap(1) != "SUBQUERY")
+		&& (tableRe.cap(1) != "CONSTANT"))
+	{
+		node.table = tableRe.cap(1);
+	}
+	QRegExp indexRe("USING (?:COVERING )?INDEX (\\S+)");
+	if (indexRe.indexIn(node.detail) >= 0)
+	{
+		node.index = indexRe.cap(1);
+	}
+	QRegExp termsRe("\\((.*)\\)$");
+	if (termsRe.indexIn(node.detail) >= 0)
+	{
+		QString terms(termsRe.cap(1));
+		QRegExp eqRe("[^<>!]=\\?");
+		int pos = 0;
+		while ((pos = eqRe.indexIn(terms, pos)) >= 0)
+		{
+			++node.equalities;
+			pos += eqRe.matchedLength();
+		}
+	}
+}
+
+QueryPlan::StepKind QueryPlan::kind(const QString & detail)
+{
+	if (detail.contains("TEMP B-TREE")) { return TempBTree; }
+	if (detail.startsWith("SEARCH")) { return Search; }
+	if (detail.startsWith("SCAN") && !detail.startsWith("SCAN CONSTANT"))
+	{
+		return Scan;
+	}
+	return Other;
+}
+
+QColor QueryPlan::colour(const QString & detail)
+{
+	switch (kind(detail))
+	{
+		case Scan: return QColor(255, 210, 210);
+		case Search: return QColor(210, 255, 210);
+		case TempBTree: return QColor(255, 240, 190);
+		default: return QColor();
+	}
+}
+
+QMap<int, QTreeWidgetItem *> QueryPlan::fillTree(QTreeWidget * tree,
+	const QList<QueryPlanNode> & nodes)
+{
+	QMap<int, QTreeWidgetItem *> items;
+	foreach (QueryPlanNode node, nodes)
+	{
+		QTreeWidgetItem * parent = items.value(node.parent, 0);
+		QTreeWidgetItem * item = parent ? new QTreeWidgetItem(parent)
+										: new QTreeWidgetItem(tree);
+		items[node.id] = item;
+		item->setText(0, node.detail);
+		QColor c(colour(node.detail));
+		if (c.isValid())
+		{
+			for (int i = 0; i < tree->columnCount(); ++i)
+			{
+				item->setBackground(i, c);
+			}
+		}
+		switch (kind(node.detail))
+		{
+			case Scan:
+				item->setToolTip(0, tr("Full scan: every row is visited"));
+				break;
+			case Search:
+				item->setToolTip(0, tr("Index search"));
+				break;
+			case TempBTree:
+				item->setToolTip(0,
+					tr("Temporary b-tree: rows are sorted in a separate pass"));
+				break;
+			default:
+				break;
+		}
+	}
+	tree->expandAll();
+	tree->resizeColumnToContents(0);
+	return items;
+}
+
+QString QueryPlan::fingerprint(const QList<QueryPlanNode> & nodes)
+{
+	QMap<int, int> depth;
+	QStringList lines;
+	foreach (QueryPlanNode node, nodes)
+	{
+		int d = depth.value(node.parent, -1) + 1;
+		depth[node.id] = d;
+		lines.append(QString("%1:%2").arg(d).arg(node.detail));
+	}
+	return QCryptographicHash::hash(lines.join("\n").toUtf8(),
+									QCryptographicHash::Md5).toHex().left(16);
+}
+
+int QueryPlan::fullScans(const QList<QueryPlanNode> & nodes)
+{
+	int n = 0;
+	foreach (QueryPlanNode node, nodes)
+	{
+		if (kind(node.detail) == Scan) { ++n; }
+	}
+	return n;
+}
+
+
+QueryPlanDialog::QueryPlanDialog(QWidget * parent)
+	: QDialog(parent),
+	  m_haveDbstat(true)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("queryplan/height", QVariant(420)).toInt();
+	int ww = settings.value("queryplan/width", QVariant(760)).toInt();
+	resize(ww, hh);
+
+	ui.baselineBox->hide();
+	ui.clearButton->setEnabled(false);
+	ui.pinButton->setEnabled(false);
+
+	connect(ui.pinButton, SIGNAL(clicked()), this, SLOT(pinButton_clicked()));
+	connect(ui.clearButton, SIGNAL(clicked()),
+			this, SLOT(clearButton_clicked()));
+}
+
+QueryPlanDialog::~QueryPlanDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("queryplan/height", QVariant(height()));
+	settings.setValue("queryplan/width", QVariant(width()));
+}
+
+void QueryPlanDialog::setQuery(const QString & sql)
+{
+	QString error;
+	m_sql = sql;
+	m_nodes = QueryPlan::explain(sql, &error);
+	ui.currentSqlLabel->setText(sql.simplified());
+	if (!error.isEmpty())
+	{
+		m_nodes.clear();
+		ui.currentTree->clear();
+		ui.pinButton->setEnabled(false);
+		ui.summaryLabel->setText(tr("Cannot explain the statement")
+			+ ":<br/><span style=\" color:#ff0000;\">" + error
+			+ "<br/></span>");
+		return;
+	}
+	loadStatistics(m_nodes + m_baseline);
+	fillTree(ui.currentTree, m_nodes, m_baseline);
+	if (!m_baseline.isEmpty())
+	{
+		fillTree(ui.baselineTree, m_baseline, m_nodes);
+	}
+	ui.pinButton->setEnabled(!m_nodes.isEmpty());
+	updateSummary();
+}
+
+void QueryPlanDialog::loadStatistics(const QList<QueryPlanNode> & nodes)
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	m_stats.clear();
+	m_pages.clear();
+
+	// sqlite_stat1 exists only after ANALYZE. Failures are ignored.
+	foreach (QString schema, Database::getDatabases().keys())
+	{
+		QSqlQuery query(QString("SELECT tbl, idx, stat FROM %1.sqlite_stat1;")
+						.arg(Utils::q(schema)), db);
+		while (query.next())
+		{
+			QString key(query.value(0).toString() + "\n"
+						+ query.value(1).toString());
+			if (!m_stats.contains(key))
+			{
+				m_stats[key] = query.value(2).toString().split(" ");
+			}
+		}
+	}
+
+	// dbstat is optional (SQLITE_ENABLE_DBSTAT_VTAB). The aggregate
+	// form (3.31+) is used so we don't walk every page of the file.
+	if (!m_haveDbstat) { return; }
+	QSet<QString> names;
+	foreach (QueryPlanNode node, nodes)
+	{
+		if (!node.table.isEmpty()) { names.insert(node.table); }
+	}
+	// plan details name the table only, so resolve its schema the way
+	// sqlite does: temp first, then main, then the attached ones
+	QStringList schemas(Database::getDatabases().keys());
+	schemas.removeAll("main");
+	schemas.prepend("main");
+	if (schemas.removeAll("temp")) { schemas.prepend("temp"); }
+	QMap<QString, QString> owners;
+	foreach (QString schema, schemas)
+	{
+		DbObjects tables(Database::getObjects("table", schema));
+		foreach (QString name, names)
+		{
+			if (!owners.contains(name) && tables.contains(name))
+			{
+				owners.insert(name, schema);
+			}
+		}
+	}
+	QSqlQuery query(db);
+	if (!query.prepare("SELECT pageno FROM dbstat"
+					   " WHERE name = ? AND schema = ? AND aggregate = 1;"))
+	{
+		m_haveDbstat = false;
+		return;
+	}
+	foreach (QString name, names)
+	{
+		query.bindValue(0, name);
+		query.bindValue(1, owners.value(name, "main"));
+		if (!query.exec())
+		{
+			m_haveDbstat = false;
+			return;
+		}
+		if (query.next()) { m_pages[name] = query.value(0).toInt(); }
+	}
+}
+
+QString QueryPlanDialog::rowEstimate(const QueryPlanNode & node)
+{
+	if (node.table.isEmpty()) { return QString(); }
+	if (node.detail.contains("INTEGER PRIMARY KEY")
+		&& (node.equalities > 0))
+	{
+		return "1";
+	}
+	QStringList stat;
+	if (!node.index.isEmpty())
+	{
+		stat = m_stats.value(node.table + "\n" + node.index);
+	}
+	if (stat.isEmpty())
+	{
+		// any row for the table carries the table's row count
+		QMapIterator<QString, QStringList> it(m_stats);
+		while (it.hasNext())
+		{
+			it.next();
+			if (it.key().startsWith(node.table + "\n"))
+			{
+				stat = it.value();
+				break;
+			}
+		}
+		if (stat.isEmpty()) { return QString(); }
+		return "~" + stat.at(0);
+	}
+	if (   (QueryPlan::kind(node.detail) == QueryPlan::Search)
+		&& (node.equalities > 0)
+		&& (node.equalities < stat.count()))
+	{
+		return "~" + stat.at(node.equalities);
+	}
+	return "~" + stat.at(0);
+}
+
+QString QueryPlanDialog::pageCount(const QueryPlanNode & node)
+{
+	if (!m_pages.contains(node.table)) { return QString(); }
+	return QString::number(m_pages.value(node.table));
+}
+
+void QueryPlanDialog::fillTree(QTreeWidget * tree,
+							   const QList<QueryPlanNode> & nodes,
+							   const QList<QueryPlanNode> & other)
+{
+	QSet<QString> otherSteps;
+	foreach (QueryPlanNode node, other) { otherSteps.insert(node.detail); }
+
+	tree->clear();
+	QMap<int, QTreeWidgetItem *> items(QueryPlan::fillTree(tree, nodes));
+	foreach (QueryPlanNode node, nodes)
+	{
+		QTreeWidgetItem * item = items.value(node.id);
+		item->setText(1, rowEstimate(node));
+		item->setText(2, pageCount(node));
+		item->setTextAlignment(1, Qt::AlignRight);
+		item->setTextAlignment(2, Qt::AlignRight);
+		if (!other.isEmpty() && !otherSteps.contains(node.detail))
+		{
+			QFont font(item->font(0));
+			font.setBold(true);
+			item->setFont(0, font);
+			item->setToolTip(0, item->toolTip(0) + "\n"
+							 + tr("This step is not in the other plan"));
+		}
+	}
+	tree->resizeColumnToContents(0);
+}
+
+void QueryPlanDialog::updateSummary()
+{
+	int scans = 0;
+	int searches = 0;
+	int sorts = 0;
+	foreach (QueryPlanNode node, m_nodes)
+	{
+		switch (QueryPlan::kind(node.detail))
+		{
+			case QueryPlan::Scan: ++scans; break;
+			case QueryPlan::Search: ++searches; break;
+			case QueryPlan::TempBTree: ++sorts; break;
+			default: break;
+		}
+	}
+	QString text(tr("Full scans: %1, index searches: %2, temporary b-trees: %3.")
+				 .arg(scans).arg(searches).arg(sorts));
+	if (!m_baseline.isEmpty())
+	{
+		if (QueryPlan::fingerprint(m_baseline) == QueryPlan::fingerprint(m_nodes))
+		{
+			text += " " + tr("The plan is the same as the baseline.");
+		}
+		else
+		{
+			text += " " + tr("The plan differs from the baseline"
+							 " (differing steps are shown in bold).");
+		}
+	}
+	if (m_stats.isEmpty())
+	{
+		text += "<br/>" + tr("No sqlite_stat1 data: run Analyze to get row estimates.");
+	}
+	ui.summaryLabel->setText(text);
+}
+
+void QueryPlanDialog::pinButton_clicked()
+{
+	m_baseline = m_nodes;
+	m_baselineSql = m_sql;
+	ui.baselineSqlLabel->setText(m_baselineSql.simplified());
+	ui.baselineBox->show();
+	ui.clearButton->setEnabled(true);
+	fillTree(ui.baselineTree, m_baseline, m_nodes);
+	fillTree(ui.currentTree, m_nodes, m_baseline);
+	updateSummary();
+}
+
+void QueryPlanDialog::clearButton_clicked()
+{
+	m_baseline.clear();
+	m_baselineSql = QString();
+	ui.baselineTree->clear();
+	ui.baselineBox->hide();
+	ui.clearButton->setEnabled(false);
+	fillTree(ui.currentTree, m_nodes, m_baseline);
+	updateSummary();
+}
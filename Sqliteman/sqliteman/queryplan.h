@@ -0,0 +1,141 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef QUERYPLAN_H
+#define QUERYPLAN_H
+
+#include <QColor>
+#include <QCoreApplication>
+#include <QDialog>
+#include <QMap>
+#include <QStringList>
+
+#include "ui_queryplandialog.h"
+
+class QTreeWidget;
+class QTreeWidgetItem;
+
+
+/*! \brief One row of EXPLAIN QUERY PLAN output.
+Old sqlite versions (before 3.24) report selectid/order/from instead
+of id/parent. In that case the selectid is used as the id and the
+nodes are left flat (parent 0).
+*/
+typedef struct
+{
+	int id;
+	int parent;
+	QString detail;
+	//! \brief table (or subquery alias) the step works on, if any
+	QString table;
+	//! \brief index used by a SEARCH step, if any
+	QString index;
+	//! \brief number of "col=?" terms used with the index
+	int equalities;
+}
+QueryPlanNode;
+
+
+/*! \brief Helper for running and classifying EXPLAIN QUERY PLAN.
+All methods are static like in the Database class.
+*/
+class QueryPlan
+{
+		Q_DECLARE_TR_FUNCTIONS(QueryPlan)
+
+	public:
+		enum StepKind
+		{
+			Other = 0,
+			//! \brief full table (or full index) scan
+			Scan,
+			//! \brief index lookup
+			Search,
+			//! \brief temporary b-tree for ORDER BY, GROUP BY, DISTINCT
+			TempBTree
+		};
+
+		/*! \brief Run EXPLAIN QUERY PLAN for sql.
+		\param sql a single SQL statement without the explain prefix
+		\param error set to the error text when the statement fails
+		\retval QList<QueryPlanNode> plan nodes in the order sqlite
+		        returned them (parents always come before children)
+		*/
+		static QList<QueryPlanNode> explain(const QString & sql,
+											QString * error = 0);
+
+		static StepKind kind(const QString & detail);
+
+		/*! \brief Highlight colour for a plan step.
+		\retval QColor invalid colour for steps not worth highlighting
+		*/
+		static QColor colour(const QString & detail);
+
+		//! \brief Append plan nodes to the tree as an id/parent hierarchy.
+		static QMap<int, QTreeWidgetItem *> fillTree(QTreeWidget * tree,
+			const QList<QueryPlanNode> & nodes);
+
+		/*! \brief Stable text identifying the shape of a plan.
+		Two runs of the same statement give the same fingerprint
+		unless sqlite chose a different plan.
+		*/
+		static QString fingerprint(const QList<QueryPlanNode> & nodes);
+
+		//! \brief Number of Scan steps in the plan.
+		static int fullScans(const QList<QueryPlanNode> & nodes);
+
+	private:
+		static void parseDetail(QueryPlanNode & node);
+};
+
+
+/*! \brief Non-modal viewer for EXPLAIN QUERY PLAN.
+It rebuilds the id/parent tree, highlights full scans, index searches
+and temporary b-tree sorts and adds row estimates from sqlite_stat1
+and page counts from dbstat when they are available.
+One plan can be pinned as a baseline so a modified version of the
+query can be compared with it side by side.
+*/
+class QueryPlanDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		QueryPlanDialog(QWidget * parent = 0);
+		~QueryPlanDialog();
+
+		//! \brief Explain sql and show it in the current plan pane.
+		void setQuery(const QString & sql);
+
+	private:
+		Ui::QueryPlanDialog ui;
+
+		QString m_sql;
+		QList<QueryPlanNode> m_nodes;
+		QString m_baselineSql;
+		QList<QueryPlanNode> m_baseline;
+
+		//! \brief sqlite_stat1 rows keyed by "table\nindex"
+		QMap<QString, QStringList> m_stats;
+		//! \brief page counts from dbstat keyed by table name
+		QMap<QString, int> m_pages;
+		bool m_haveDbstat;
+
+		void loadStatistics(const QList<QueryPlanNode> & nodes);
+		QString rowEstimate(const QueryPlanNode & node);
+		QString pageCount(const QueryPlanNode & node);
+		void fillTree(QTreeWidget * tree,
+					  const QList<QueryPlanNode> & nodes,
+					  const QList<QueryPlanNode> & other);
+		void updateSummary();
+
+	private slots:
+		void pinButton_clicked();
+		void clearButton_clicked();
+};
+
+#endif
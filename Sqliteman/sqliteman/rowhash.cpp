@@ -0,0 +1,144 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QCryptographicHash>
+
+#include "rowhash.h"
+
+// rows hashed between two updates of RangeHasher::rows()
+#define ROWS_INTERVAL 256
+
+
+RowHash::RowHash(sqlite3_stmt * stmt, int first)
+{
+	QCryptographicHash md5(QCryptographicHash::Md5);
+	for (int i = first; i < sqlite3_column_count(stmt); ++i)
+	{
+		int type = sqlite3_column_type(stmt, i);
+		char code = (char)type;
+		md5.addData(&code, 1);
+		switch (type)
+		{
+			case SQLITE_INTEGER:
+			{
+				qint64 v = sqlite3_column_int64(stmt, i);
+				md5.addData((const char *)&v, sizeof(v));
+				break;
+			}
+			case SQLITE_FLOAT:
+			{
+				double v = sqlite3_column_double(stmt, i);
+				md5.addData((const char *)&v, sizeof(v));
+				break;
+			}
+			case SQLITE_TEXT:
+			case SQLITE_BLOB:
+			{
+				// the length keeps ('ab', 'c') apart from ('a', 'bc')
+				const char * data = (type == SQLITE_TEXT)
+					? (const char *)sqlite3_column_text(stmt, i)
+					: (const char *)sqlite3_column_blob(stmt, i);
+				qint32 size = sqlite3_column_bytes(stmt, i);
+				md5.addData((const char *)&size, sizeof(size));
+				md5.addData(data, size);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	QByteArray digest(md5.result());
+	hi = lo = 0;
+	for (int i = 0; i < 8; ++i)
+	{
+		hi = (hi << 8) | (uchar)digest.at(i);
+		lo = (lo << 8) | (uchar)digest.at(i + 8);
+	}
+}
+
+RowHash & RowHash::operator+=(const RowHash & other)
+{
+	lo += other.lo;
+	hi += other.hi + ((lo < other.lo) ? 1 : 0);
+	return *this;
+}
+
+QString RowHash::toString() const
+{
+	return QString("%1%2").arg(hi, 16, 16, QChar('0'))
+						  .arg(lo, 16, 16, QChar('0'));
+}
+
+
+RangeHasher::RangeHasher(sqlite3 * handle, const QString & sql,
+						 qint64 lo, qint64 hi, qint64 width)
+	: QThread(),
+	  m_handle(handle),
+	  m_sql(sql.toUtf8()),
+	  m_lo(lo),
+	  m_hi(hi),
+	  m_width(width),
+	  m_first(0),
+	  m_rows(0),
+	  m_cancelled(0)
+{
+}
+
+void RangeHasher::cancel()
+{
+	m_cancelled = 1;
+	if (isRunning())
+		sqlite3_interrupt(m_handle);
+}
+
+qlonglong RangeHasher::rows()
+{
+	QMutexLocker locker(&m_rowsMutex);
+	return m_rows;
+}
+
+RowHash RangeHasher::sum()
+{
+	RowHash total;
+	foreach (RowHash hash, m_buckets)
+		total += hash;
+	return total;
+}
+
+bool RangeHasher::scan()
+{
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, m_sql.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		sqlite3_bind_int64(stmt, 1, m_lo);
+		sqlite3_bind_int64(stmt, 2, m_hi);
+		int unpublished = 0;
+		while ((m_cancelled == 0) && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+		{
+			// unsigned, so the distance cannot overflow
+			quint64 offset = (quint64)sqlite3_column_int64(stmt, 0)
+							 - (quint64)m_lo;
+			qint64 bucket = (m_width > 0) ? (qint64)(offset / m_width) : 0;
+			m_buckets[bucket] += RowHash(stmt, m_first);
+			if (++unpublished == ROWS_INTERVAL)
+			{
+				QMutexLocker locker(&m_rowsMutex);
+				m_rows += unpublished;
+				unpublished = 0;
+			}
+		}
+		QMutexLocker locker(&m_rowsMutex);
+		m_rows += unpublished;
+	}
+	if (m_cancelled != 0)
+		m_error = QObject::tr("Cancelled");
+	else if ((rc != SQLITE_OK) && (rc != SQLITE_DONE))
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	return m_error.isEmpty();
+}
@@ -0,0 +1,96 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef ROWHASH_H
+#define ROWHASH_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+
+#include "sqlite3.h"
+
+
+/*! \brief 128-bit MD5 hash of a table row.
+The values are hashed with their storage class, so 1, 1.0 and '1' differ.
+Hashes add up modulo 2^128, which does not depend on the order of the
+rows and, unlike XOR, does not cancel out duplicate rows.
+*/
+class RowHash
+{
+	public:
+		RowHash() : hi(0), lo(0) {}
+		//! \brief Hash the columns from first on of the current row of stmt.
+		RowHash(sqlite3_stmt * stmt, int first);
+
+		bool operator==(const RowHash & other) const
+			{ return (hi == other.hi) && (lo == other.lo); }
+		bool operator!=(const RowHash & other) const
+			{ return !(*this == other); }
+		RowHash & operator+=(const RowHash & other);
+		//! \brief 32 hex digits
+		QString toString() const;
+
+		quint64 hi;
+		quint64 lo;
+};
+
+
+/*! \brief Hashes the rows of a rowid range of a table on one connection.
+sql selects the rowid and the columns to hash, with ?1 and ?2 for the
+lowest and the highest rowid. The row hashes are summed up in buckets
+of width rowids from lo on, so two copies of a table hashed with the
+same lo and width can be compared bucket by bucket; width 0 gives a
+single bucket and width 1 a hash per row.
+It runs as a thread, or with scan() on the current one. Connections are
+serialized, so hashers may share one, just without running in parallel.
+*/
+class RangeHasher : public QThread
+{
+	public:
+		RangeHasher(sqlite3 * handle, const QString & sql,
+					qint64 lo, qint64 hi, qint64 width = 0);
+
+		/*! \brief Whether the rowid is a part of the row hashes, the default.
+		VACUUM may renumber the rows of a table without an INTEGER PRIMARY
+		KEY, so copies of a table can have other rowids for the same rows.
+		*/
+		void setHashRowid(bool hash) { m_first = hash ? 0 : 1; }
+		//! \retval bool false on error, see error()
+		bool scan();
+		//! \brief Stop the scan, from any thread.
+		void cancel();
+
+		//! \brief Rows hashed so far, updated every few hundred rows.
+		qlonglong rows();
+		//! \brief Bucket number to the sum of its row hashes.
+		const QHash<qint64,RowHash> & buckets() { return m_buckets; }
+		//! \brief Sum of all row hashes.
+		RowHash sum();
+		QString error() { return m_error; }
+
+	protected:
+		void run() { scan(); }
+
+	private:
+		sqlite3 * m_handle;
+		QByteArray m_sql;
+		qint64 m_lo;
+		qint64 m_hi;
+		qint64 m_width;
+		//! \brief first column hashed
+		int m_first;
+		//! \brief 64 bits, which QAtomicInt does not have, so locked
+		QMutex m_rowsMutex;
+		qlonglong m_rows;
+		QAtomicInt m_cancelled;
+		QHash<qint64,RowHash> m_buckets;
+		QString m_error;
+};
+
+#endif
@@ -0,0 +1,494 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QFile>
+#include <QSqlDatabase>
+#include <QStack>
+#include <QTextStream>
+
+#include <qscilexer.h>
+#include <qsciscintilla.h>
+
+#include "database.h"
+#include "databaseworker.h"
+#include "schemaapis.h"
+#include "schemacatalog.h"
+#include "sqlkeywords.h"
+#include "sqlparser.h"
+#include "utils.h"
+
+// most words offered for one prefix
+#define COMPLETION_LIMIT 500
+// ms between two checks of the schema versions
+#define SCHEMA_CHECK_INTERVAL 1000
+// lines searched for the ends of the current statement
+#define STATEMENT_LINES 200
+
+
+CompletionTrie::CompletionTrie()
+{
+	Node root;
+	root.ch = 0;
+	root.child = -1;
+	root.sibling = -1;
+	root.word = -1;
+	m_nodes.append(root);
+}
+
+int CompletionTrie::child(int node, ushort ch) const
+{
+	for (int i = m_nodes.at(node).child; i >= 0; i = m_nodes.at(i).sibling)
+	{
+		if (m_nodes.at(i).ch == ch) { return i; }
+	}
+	return -1;
+}
+
+void CompletionTrie::insert(const QString & word)
+{
+	if (word.isEmpty()) { return; }
+	QString lower(word.toLower());
+	int node = 0;
+	for (int i = 0; i < lower.length(); ++i)
+	{
+		ushort ch = lower.at(i).unicode();
+		int next = child(node, ch);
+		if (next < 0)
+		{
+			Node n;
+			n.ch = ch;
+			n.child = -1;
+			n.sibling = m_nodes.at(node).child;
+			n.word = -1;
+			next = m_nodes.count();
+			m_nodes.append(n);
+			m_nodes[node].child = next;
+		}
+		node = next;
+	}
+	if (m_nodes.at(node).word < 0)
+	{
+		m_nodes[node].word = m_words.count();
+		m_words.append(word);
+	}
+}
+
+QStringList CompletionTrie::find(const QString & prefix, int limit) const
+{
+	QStringList result;
+	QString lower(prefix.toLower());
+	int node = 0;
+	for (int i = 0; (i < lower.length()) && (node >= 0); ++i)
+		node = child(node, lower.at(i).unicode());
+	if (node < 0) { return result; }
+
+	if (m_nodes.at(node).word >= 0)
+		result.append(m_words.at(m_nodes.at(node).word));
+	// depth first below node; the siblings of node itself do not match
+	QStack<int> stack;
+	if (m_nodes.at(node).child >= 0)
+		stack.push(m_nodes.at(node).child);
+	while (!stack.isEmpty() && (result.count() < limit))
+	{
+		const Node & n = m_nodes.at(stack.pop());
+		if (n.word >= 0)
+			result.append(m_words.at(n.word));
+		if (n.sibling >= 0)
+			stack.push(n.sibling);
+		if (n.child >= 0)
+			stack.push(n.child);
+	}
+	return result;
+}
+
+
+CompletionBuilder::CompletionBuilder(const QStringList & words,
+									 const QHash<QString,int> & versions,
+									 QObject * parent)
+	: QThread(parent),
+	  m_words(words)
+{
+	m_data.versions = versions;
+	QString error;
+	m_handle = Database::openConnection(true, &error);
+}
+
+CompletionBuilder::~CompletionBuilder()
+{
+	wait();
+	if (m_handle)
+		sqlite3_close(m_handle);
+}
+
+void CompletionBuilder::run()
+{
+	build(m_handle, m_words, m_data);
+}
+
+void CompletionBuilder::build(sqlite3 * handle, const QStringList & words,
+							  CompletionData & data)
+{
+	foreach (QString word, words)
+		data.words.insert(word);
+	if (!handle) { return; }
+
+	foreach (QString key, data.versions.keys())
+	{
+		QString schema(key.section('\n', 0, 0));
+		SchemaSnapshot snapshot;
+		QString error;
+		if (!SchemaCatalog::load(handle, schema, snapshot, &error))
+			continue;
+		foreach (SchemaObject o, snapshot.objects)
+		{
+			if ((o.type != "table") && (o.type != "view"))
+				continue;
+			data.words.insert(o.name);
+			QStringList & columns
+				= data.columns[schema.toLower() + '\n' + o.name.toLower()];
+			QByteArray sql(QString("PRAGMA %1.table_info(%2);")
+						   .arg(Utils::q(schema)).arg(Utils::q(o.name))
+						   .toUtf8());
+			sqlite3_stmt * stmt = 0;
+			if (sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, NULL)
+				== SQLITE_OK)
+			{
+				while (sqlite3_step(stmt) == SQLITE_ROW)
+				{
+					QString column(QString::fromUtf8(
+						(const char *)sqlite3_column_text(stmt, 1)));
+					columns.append(column);
+					data.words.insert(column);
+				}
+			}
+			sqlite3_finalize(stmt);
+		}
+	}
+}
+
+
+SchemaAPIs::SchemaAPIs(QsciLexer * lexer)
+	: QsciAbstractAPIs(lexer),
+	  m_builder(0)
+{
+	m_staticWords = sqlKeywords();
+	QFile f(":/api/sqlite.api");
+	if (f.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		QTextStream in(&f);
+		while (!in.atEnd())
+		{
+			QString word(in.readLine().trimmed());
+			if (!word.isEmpty())
+				m_staticWords.append(word);
+		}
+	}
+	foreach (QString word, m_staticWords)
+		m_data.words.insert(word);
+}
+
+SchemaAPIs::~SchemaAPIs()
+{
+	delete m_builder;
+}
+
+void SchemaAPIs::updateAutoCompletionList(const QStringList & context,
+										  QStringList & list)
+{
+	checkSchema();
+	if (context.isEmpty()) { return; }
+	QString word(context.last());
+	QHash<QString,QString> names(aliases(currentStatement()));
+
+	QString table(qualifier(word.length()).toLower());
+	QStringList columns;
+	if (!table.isEmpty() && tableColumns(names.value(table, table), &columns))
+	{
+		foreach (QString column, columns)
+		{
+			if (column.startsWith(word, Qt::CaseInsensitive))
+				list.append(column);
+		}
+		return;
+	}
+
+	list += m_data.words.find(word, COMPLETION_LIMIT);
+	QHashIterator<QString,QString> it(names);
+	while (it.hasNext())
+	{
+		it.next();
+		if (   (it.key() != it.value().section('\n', -1))
+			&& it.key().startsWith(word, Qt::CaseInsensitive)
+			&& !list.contains(it.key()))
+		{
+			list.append(it.key());
+		}
+	}
+}
+
+QStringList SchemaAPIs::callTips(const QStringList & /*context*/,
+								 int /*commas*/,
+								 QsciScintilla::CallTipsStyle /*style*/,
+								 QList<int> & /*shifts*/)
+{
+	return QStringList();
+}
+
+void SchemaAPIs::checkSchema()
+{
+	// a worker on the main connection would keep it waiting
+	if (   m_builder
+		|| (m_checked.isValid() && (m_checked.elapsed() < SCHEMA_CHECK_INTERVAL))
+		|| MainConnectionMonitor::instance()->isBusy())
+	{
+		return;
+	}
+	m_checked.start();
+
+	sqlite3 * handle = 0;
+	if (QSqlDatabase::database(SESSION_NAME, false).isOpen())
+		handle = Database::sqlite3handle();
+	QHash<QString,int> versions(schemaVersions(handle));
+	if (versions == m_data.versions) { return; }
+
+	m_builder = new CompletionBuilder(m_staticWords, versions, this);
+	if (m_builder->isValid())
+	{
+		connect(m_builder, SIGNAL(finished()),
+				this, SLOT(builder_finished()));
+		m_builder->start(QThread::LowPriority);
+	}
+	else
+	{
+		// an in-memory database cannot be opened twice; it is read
+		// here on the main connection
+		delete m_builder;
+		m_builder = 0;
+		CompletionData data;
+		data.versions = versions;
+		CompletionBuilder::build(handle, m_staticWords, data);
+		m_data = data;
+	}
+}
+
+void SchemaAPIs::builder_finished()
+{
+	m_data = m_builder->data();
+	m_builder->deleteLater();
+	m_builder = 0;
+}
+
+QHash<QString,int> SchemaAPIs::schemaVersions(sqlite3 * handle)
+{
+	QHash<QString,int> result;
+	if (!handle) { return result; }
+
+	QStringList schemas;
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(handle, "PRAGMA database_list;", -1, &stmt, NULL)
+		== SQLITE_OK)
+	{
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			schemas.append(QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 1)));
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	foreach (QString schema, schemas)
+	{
+		// not seen by the builder's own connection
+		if (schema == "temp") { continue; }
+		QByteArray sql(QString("PRAGMA %1.schema_version;")
+					   .arg(Utils::q(schema)).toUtf8());
+		stmt = 0;
+		if (   (sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, NULL)
+				== SQLITE_OK)
+			&& (sqlite3_step(stmt) == SQLITE_ROW))
+		{
+			QString fileName(QString::fromUtf8(
+				sqlite3_db_filename(handle, schema.toUtf8().constData())));
+			result.insert(schema + '\n' + fileName,
+						  sqlite3_column_int(stmt, 0));
+		}
+		sqlite3_finalize(stmt);
+	}
+	return result;
+}
+
+QString SchemaAPIs::qualifier(int wordLength)
+{
+	QsciScintilla * editor = lexer()->editor();
+	if (!editor) { return QString(); }
+
+	// Scintilla positions are bytes of the UTF-8 text
+	long pos = editor->SendScintilla(QsciScintilla::SCI_GETCURRENTPOS);
+	long line = editor->SendScintilla(QsciScintilla::SCI_LINEFROMPOSITION, pos);
+	long start = editor->SendScintilla(QsciScintilla::SCI_POSITIONFROMLINE,
+									   line);
+	QString before(QString::fromUtf8(
+		editor->text(line).toUtf8().left(pos - start)));
+
+	int dot = before.length() - wordLength - 1;
+	if ((dot < 1) || (before.at(dot) != '.')) { return QString(); }
+	QChar c(before.at(dot - 1));
+	if ((c == '"') || (c == ']') || (c == '`'))
+	{
+		int open = before.lastIndexOf(c == ']' ? QChar('[') : c, dot - 2);
+		if (open < 0) { return QString(); }
+		return before.mid(open + 1, dot - open - 2);
+	}
+	int i = dot;
+	while (   (i > 0)
+		   && (   before.at(i - 1).isLetterOrNumber()
+			   || (before.at(i - 1) == '_') || (before.at(i - 1) == '$')))
+	{
+		--i;
+	}
+	return before.mid(i, dot - i);
+}
+
+QString SchemaAPIs::currentStatement()
+{
+	QsciScintilla * editor = lexer()->editor();
+	if (!editor) { return QString(); }
+
+	int line, index;
+	editor->getCursorPosition(&line, &index);
+	int first = line;
+	while (   (first > 0) && (line - first < STATEMENT_LINES)
+		   && !editor->text(first - 1).contains(';'))
+	{
+		--first;
+	}
+	int last = line;
+	while (   (last + 1 < editor->lines()) && (last - line < STATEMENT_LINES)
+		   && !editor->text(last).contains(';'))
+	{
+		++last;
+	}
+
+	QString statement;
+	for (int i = first; i <= last; ++i)
+		statement += editor->text(i);
+	return statement;
+}
+
+static bool isName(enum tokenType type)
+{
+	return    (type == tokenIdentifier)
+		   || (type == tokenQuotedIdentifier)
+		   || (type == tokenSquareIdentifier)
+		   || (type == tokenBackQuotedIdentifier);
+}
+
+// words which end the list of tables of a FROM clause
+static bool isClause(const QString & name)
+{
+	static QStringList clauses;
+	if (clauses.isEmpty())
+	{
+		clauses << "WHERE" << "GROUP" << "HAVING" << "WINDOW" << "ORDER"
+				<< "LIMIT" << "UNION" << "EXCEPT" << "INTERSECT" << "ON"
+				<< "USING" << "SET" << "VALUES" << "SELECT" << "RETURNING"
+				<< "INDEXED" << "DEFAULT";
+	}
+	return clauses.contains(name, Qt::CaseInsensitive);
+}
+
+bool SchemaAPIs::tableColumns(const QString & table, QStringList * columns)
+{
+	QHash<QString,QStringList>::const_iterator it = m_data.columns.constFind(
+		table.contains('\n') ? table : "main\n" + table);
+	if ((it == m_data.columns.constEnd()) && !table.contains('\n'))
+	{
+		for (it = m_data.columns.constBegin();
+			 it != m_data.columns.constEnd(); ++it)
+		{
+			if (it.key().section('\n', 1) == table)
+				break;
+		}
+	}
+	if (it == m_data.columns.constEnd())
+		return false;
+	*columns = it.value();
+	return true;
+}
+
+QHash<QString,QString> SchemaAPIs::aliases(const QString & statement)
+{
+	QHash<QString,QString> result;
+	SqlParser parser(QString());
+	QVector<TokenSpan> tokens(parser.scan(statement));
+	bool inFrom = false;
+	bool expectTable = false;
+	for (int i = 0; i < tokens.count(); ++i)
+	{
+		const TokenSpan & t = tokens.at(i);
+		QString name(SqlParser::tokenName(statement, t));
+		if (t.type == tokenIdentifier)
+		{
+			if (   (name.compare("FROM", Qt::CaseInsensitive) == 0)
+				|| (name.compare("JOIN", Qt::CaseInsensitive) == 0)
+				|| (name.compare("UPDATE", Qt::CaseInsensitive) == 0)
+				|| (name.compare("INTO", Qt::CaseInsensitive) == 0))
+			{
+				inFrom = true;
+				expectTable = true;
+				continue;
+			}
+			if (isClause(name))
+			{
+				inFrom = false;
+				continue;
+			}
+		}
+		if (!inFrom) { continue; }
+		if ((t.type == tokenSingle) && (name == ","))
+		{
+			expectTable = true;
+			continue;
+		}
+		if (!expectTable) { continue; }
+		// a sub-select has no name to complete from
+		expectTable = false;
+		if (!isName(t.type)) { continue; }
+
+		QString table(name.toLower());
+		if (   (i + 2 < tokens.count())
+			&& (tokens.at(i + 1).type == tokenSingle)
+			&& (SqlParser::tokenName(statement, tokens.at(i + 1)) == ".")
+			&& isName(tokens.at(i + 2).type))
+		{
+			// schema.table
+			i += 2;
+			table += '\n' + SqlParser::tokenName(statement, tokens.at(i))
+							 .toLower();
+		}
+		result.insert(table.section('\n', -1), table);
+
+		int j = i + 1;
+		if (   (j < tokens.count()) && (tokens.at(j).type == tokenOperator)
+			&& (SqlParser::tokenName(statement, tokens.at(j))
+					.compare("AS", Qt::CaseInsensitive) == 0))
+		{
+			++j;
+		}
+		if ((j < tokens.count()) && isName(tokens.at(j).type))
+		{
+			QString alias(SqlParser::tokenName(statement, tokens.at(j)));
+			if (   (tokens.at(j).type != tokenIdentifier)
+				|| !(isKeyword(alias) || isClause(alias)))
+			{
+				result.insert(alias.toLower(), table);
+				i = j;
+			}
+		}
+	}
+	return result;
+}
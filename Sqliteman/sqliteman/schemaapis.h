@@ -0,0 +1,155 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef SCHEMAAPIS_H
+#define SCHEMAAPIS_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+#include <qsciabstractapis.h>
+
+#include "sqlite3.h"
+
+
+/*! \brief Prefix trie of the completion words.
+Words are matched case insensitively and returned as they were inserted;
+a word inserted twice (in any case) is kept once. The nodes live in one
+vector with the children as sibling lists, so a lookup only walks the
+prefix and the subtree below it, however many words there are.
+*/
+class CompletionTrie
+{
+	public:
+		CompletionTrie();
+
+		void insert(const QString & word);
+		//! \brief At most limit words starting with prefix.
+		QStringList find(const QString & prefix, int limit) const;
+		int count() const { return m_words.count(); }
+
+	private:
+		typedef struct
+		{
+			ushort ch; // lowercased
+			int child;
+			int sibling;
+			int word; // index to m_words or -1
+		} Node;
+
+		QVector<Node> m_nodes;
+		QStringList m_words;
+
+		int child(int node, ushort ch) const;
+};
+
+
+//! \brief Everything SchemaAPIs completes from.
+typedef struct
+{
+	//! \brief keywords, functions, tables, views and columns
+	CompletionTrie words;
+	//! \brief lower(schema) "\n" lower(table or view) to its columns
+	QHash<QString,QStringList> columns;
+	//! \brief schema and file to PRAGMA schema_version they were read at
+	QHash<QString,int> versions;
+} CompletionData;
+
+
+/*! \brief Builds CompletionData on a worker thread.
+It uses its own read only connection like SchemaCatalogLoader, so the
+temp schema and uncommitted changes are not seen.
+*/
+class CompletionBuilder : public QThread
+{
+	public:
+		//! \brief Opens the connection; call it from the GUI thread.
+		CompletionBuilder(const QStringList & words,
+						  const QHash<QString,int> & versions,
+						  QObject * parent = 0);
+		~CompletionBuilder();
+
+		//! \brief false when no connection could be opened
+		bool isValid() { return m_handle != 0; }
+		//! \brief Valid after finished().
+		const CompletionData & data() { return m_data; }
+
+		/*! \brief Fill data from the schemas of data.versions.
+		Used by run() and, for a database which cannot be opened twice,
+		on the main connection.
+		*/
+		static void build(sqlite3 * handle, const QStringList & words,
+						  CompletionData & data);
+
+	protected:
+		void run();
+
+	private:
+		sqlite3 * m_handle;
+		QStringList m_words;
+		CompletionData m_data;
+};
+
+
+/*! \brief Code completion of SqlEditorWidget.
+It offers the keywords, the functions of api/sqlite.api and the tables,
+views and columns of all schemas. After "name." only the columns of
+that table are offered, where name may be an alias from the FROM or JOIN
+clauses of the current statement.
+The words are kept in a CompletionTrie. When a PRAGMA schema_version
+changes, a new one is built by a CompletionBuilder in the background;
+the old one is used until it has finished.
+*/
+class SchemaAPIs : public QsciAbstractAPIs
+{
+		Q_OBJECT
+
+	public:
+		SchemaAPIs(QsciLexer * lexer);
+		~SchemaAPIs();
+
+		void updateAutoCompletionList(const QStringList & context,
+									  QStringList & list);
+		//! \brief No call tips, api/sqlite.api has no signatures.
+		QStringList callTips(const QStringList & context, int commas,
+							 QsciScintilla::CallTipsStyle style,
+							 QList<int> & shifts);
+
+	private:
+		QStringList m_staticWords;
+		CompletionData m_data;
+		CompletionBuilder * m_builder;
+		//! \brief since the schema versions were checked
+		QElapsedTimer m_checked;
+
+		//! \brief Start a CompletionBuilder when the schema has changed.
+		void checkSchema();
+		//! \brief Version of each attached schema, see CompletionData.
+		static QHash<QString,int> schemaVersions(sqlite3 * handle);
+		//! \brief Name before the "." in front of the word being typed.
+		QString qualifier(int wordLength);
+		//! \brief Text of the statement around the cursor.
+		QString currentStatement();
+		/*! \brief lower(alias or table) to lower(table) of the FROM clauses.
+		A table given with its schema is lower(schema) "\n" lower(table).
+		*/
+		static QHash<QString,QString> aliases(const QString & statement);
+		/*! \brief Columns of a table as aliases() names it.
+		A table without a schema is looked for in main first, as sqlite
+		does (the temp schema is not read), then in the attached ones.
+		\retval bool false if no schema has it
+		*/
+		bool tableColumns(const QString & table, QStringList * columns);
+
+	private slots:
+		void builder_finished();
+};
+
+#endif
@@ -6,15 +6,60 @@ for which a new license (GPL+exception) is in place.
 */
 #include <QInputDialog>
 #include <QFileInfo>
+#include <QSqlDatabase>
+#include <QTimer>
 
 #include "schemabrowser.h"
 #include "database.h"
+#include "databaseworker.h"
 #include "extensionmodel.h"
 #include "utils.h"
 
+// milliseconds between reads of the volatile pragmas
+#define PRAGMA_POLL_INTERVAL 2000
+
+// columns of storageTree
+#define STORAGE_PAGES 1
+#define STORAGE_SIZE 2
+#define STORAGE_PAYLOAD 3
+#define STORAGE_UNUSED 4
+#define STORAGE_OVERFLOW 5
+#define STORAGE_FANOUT 6
+#define STORAGE_FRAGMENTATION 7
+#define STORAGE_ENTRIES 8
+
+
+/*! \brief Sorts storageTree by the numbers behind the formatted text.
+*/
+class StorageItem : public QTreeWidgetItem
+{
+	public:
+		StorageItem(QTreeWidget * parent) : QTreeWidgetItem(parent) {}
+		StorageItem(QTreeWidgetItem * parent) : QTreeWidgetItem(parent) {}
+
+		void setValue(int column, double value, const QString & text)
+		{
+			setData(column, Qt::UserRole, value);
+			setText(column, text);
+			setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+		}
+
+		bool operator<(const QTreeWidgetItem & other) const
+		{
+			int column = treeWidget() ? treeWidget()->sortColumn() : 0;
+			QVariant a(data(column, Qt::UserRole));
+			QVariant b(other.data(column, Qt::UserRole));
+			if (a.isValid() && b.isValid())
+				return a.toDouble() < b.toDouble();
+			return QTreeWidgetItem::operator<(other);
+		}
+};
+
 
 SchemaBrowser::SchemaBrowser(QWidget * parent, Qt::WindowFlags f)
-	: QWidget(parent, f)
+	: QWidget(parent, f),
+	  m_pragmasDirty(false),
+	  m_batchProbed(false)
 {
 	setupUi(this);
 
@@ -30,67 +75,232 @@ SchemaBrowser::SchemaBrowser(QWidget * parent, Qt::WindowFlags f)
 // 	connect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
 // 			this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
 	connect(setPragmaButton, SIGNAL(clicked()), this, SLOT(setPragmaButton_clicked()));
+
+	storageTree->setHeaderLabels(QStringList() << tr("Name") << tr("Pages")
+		<< tr("Size") << tr("Payload") << tr("Unused") << tr("Overflow")
+		<< tr("Fanout") << tr("Fragmentation") << tr("Entries"));
+	storageTree->sortByColumn(STORAGE_PAGES, Qt::DescendingOrder);
+	connect(storageButton, SIGNAL(clicked()), this, SLOT(storageButton_clicked()));
+	connect(storageTree,
+			SIGNAL(currentItemChanged(QTreeWidgetItem *, QTreeWidgetItem *)),
+			this, SLOT(storageTree_currentItemChanged(QTreeWidgetItem *)));
+
+	m_pragmaTimer = new QTimer(this);
+	m_pragmaTimer->setInterval(PRAGMA_POLL_INTERVAL);
+	connect(m_pragmaTimer, SIGNAL(timeout()), this, SLOT(pragmaTimer_timeout()));
+	// the poll would wait for a worker on the main connection
+	connect(MainConnectionMonitor::instance(), SIGNAL(busy()),
+			m_pragmaTimer, SLOT(stop()));
+	connect(MainConnectionMonitor::instance(), SIGNAL(idle()),
+			this, SLOT(mainConnection_idle()));
 }
 
 void SchemaBrowser::buildPragmasTree()
 {
-	int row = pragmaTable->currentRow();
-	disconnect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
-			   this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
-	pragmaTable->clearContents();
-	pragmaTable->setRowCount(0);
-
-	addPragma("application_id", "editable", "integer");
-	addPragma("auto_vacuum", "editable", "0, 1, 2");
-	addPragma("automatic_index", "editable", "0 or 1");
-	addPragma("busy_timeout", "editable", "milliseconds");
-	addPragma("cache_size", "editable", "pages or -kbytes");
-	addPragma("cache_spill", "editable", "pages");
-	addPragma("case_sensitive_like", "editable", "0 or 1");
-	addPragma("cell_size_check", "editable", "0 or 1");
-	addPragma("checkpoint_fullfsync", "editable", "0 or 1");
-	addPragma("count_changes", "editable", "0 or 1");
-	addPragma("data_version", "read-only", "");
-	addPragma("default_cache_size", "editable", "pages");
-	addPragma("defer_foreign_keys", "editable", "0 or 1");
-	addPragma("empty_result_callbacks", "editable", "0 or 1");
-	addPragma("encoding", "editable", "UTF-8, UTF-16, UTF16le, UTF16be");
-	addPragma("foreign_keys", "editable", "0 or 1");
-	addPragma("freelist_count", "read-only", "");
-	addPragma("full_column_names", "editable", "0 or 1");
-	addPragma("fullfsync", "editable", "0 or 1");
-	addPragma("ignore_check_constraints", "editable", "0 or 1");
-	addPragma("journal_mode", "editable",
-              "delete, truncate, persist, memory, wal, off");
-	addPragma("journal_size_limit", "editable", "bytes");
-	addPragma("legacy_alter_table", "editable", "0 or 1");
-	addPragma("legacy_file_format", "editable", "0 or 1");
-	addPragma("locking_mode", "editable", "normal, exclusive");
-	addPragma("max_page_count", "editable", "pages");
-	addPragma("mmap_size", "editable", "bytes");
-	addPragma("page_count", "read-only", "");
-	addPragma("page_size", "read-only", "bytes");
-	addPragma("query_only", "editable", "0 or 1");
-	addPragma("read_uncommitted", "editable", "0 or 1");
-	addPragma("recursive_triggers", "editable", "0 or 1");
-	addPragma("reverse_unordered_selects", "editable", "0 or 1");
-    
-    /* This one is actually editable, but it's dangerous to do so. */
-	addPragma("schema_version", "read-only", "");
-	addPragma("secure_delete", "editable", "0 or 1 or fast");
-	addPragma("short_column_names", "editable", "0 or 1");
-	addPragma("soft_heap_limit", "editable", "bytes");
-	addPragma("synchronous", "editable", "0, 1, 2, 3");
-	addPragma("temp_store", "editable", "0, 1, 2");
-	addPragma("threads", "editable", "integer");
-	addPragma("user_version", "editable", "integer");
-	addPragma("wal_autocheckpoint", "editable", "integer");
-
-	if (row < 0) { row = 0; }
-	pragmaTable_currentCellChanged(row, 0, 0, 0);
-	pragmaTable->setCurrentItem(pragmaTable->item(row, 0));
-	connect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
-		    this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
+	m_pragmasDirty = true;
+	if (pragmasVisible()) { refreshPragmas(); }
+}
+
+bool SchemaBrowser::pragmasVisible()
+{
+	return isVisible() && (schemaTabWidget->currentWidget() == pragmaTab);
+}
+
+void SchemaBrowser::showEvent(QShowEvent * event)
+{
+	QWidget::showEvent(event);
+	if (m_pragmasDirty && pragmasVisible()) { refreshPragmas(); }
+}
+
+void SchemaBrowser::pragmaTimer_timeout()
+{
+	if (   !pragmasVisible()
+		|| !QSqlDatabase::database(SESSION_NAME, false).isOpen()
+		|| MainConnectionMonitor::instance()->isBusy())
+	{
+		m_pragmaTimer->stop();
+		return;
+	}
+	refreshPragmas(QStringList() << "data_version" << "freelist_count"
+								 << "page_count");
+}
+
+void SchemaBrowser::mainConnection_idle()
+{
+	if (pragmasVisible() && (pragmaTable->rowCount() > 0))
+		pragmaTimer_timeout();
+}
+
+QMap<QString,QString> SchemaBrowser::readPragmas(const QStringList & names)
+{
+	QMap<QString,QString> values;
+	sqlite3 * handle = Database::sqlite3handle();
+	if (!handle) { return values; }
+
+	// Not every pragma has a table-valued function (it depends on the
+	// version and compile options), so find out once which ones do.
+	if (!m_batchProbed)
+	{
+		for (int row = 0; row < pragmaTable->rowCount(); ++row)
+		{
+			QString name(pragmaTable->item(row, 0)->text());
+			QByteArray sql(QString("SELECT (SELECT * FROM pragma_%1);")
+						   .arg(name).toUtf8());
+			sqlite3_stmt * stmt = 0;
+			if (sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, 0)
+				== SQLITE_OK)
+			{
+				m_batchPragmas.append(name);
+			}
+			sqlite3_finalize(stmt);
+		}
+		m_batchProbed = true;
+	}
+
+	// case_sensitive_like cannot be read, Database::pragma() tests it
+	QStringList batch;
+	QStringList columns;
+	foreach (QString name, names)
+	{
+		if (name == "case_sensitive_like")
+		{
+			batch.append(name);
+			columns.append("('a' NOT LIKE 'A')");
+		}
+		else if (m_batchPragmas.contains(name))
+		{
+			batch.append(name);
+			columns.append(QString("(SELECT * FROM pragma_%1)").arg(name));
+		}
+		else
+		{
+			values.insert(name, Database::pragma(name));
+		}
+	}
+	if (batch.isEmpty()) { return values; }
+
+	QByteArray sql(QString("SELECT %1;").arg(columns.join(", ")).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (   (sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, 0)
+			== SQLITE_OK)
+		&& (sqlite3_step(stmt) == SQLITE_ROW))
+	{
+		for (int i = 0; i < batch.count(); ++i)
+		{
+			if (sqlite3_column_type(stmt, i) == SQLITE_NULL)
+			{
+				values.insert(batch.at(i), tr("Not Set"));
+			}
+			else
+			{
+				values.insert(batch.at(i), QString::fromUtf8(
+					(const char *)sqlite3_column_text(stmt, i)));
+			}
+		}
+	}
+	else
+	{
+		// fall back to one query per pragma
+		foreach (QString name, batch)
+			values.insert(name, Database::pragma(name));
+	}
+	sqlite3_finalize(stmt);
+	return values;
+}
+
+void SchemaBrowser::refreshPragmas(const QStringList & names)
+{
+	if (   !QSqlDatabase::database(SESSION_NAME, false).isOpen()
+		|| MainConnectionMonitor::instance()->isBusy())
+	{
+		return;
+	}
+
+	if (pragmaTable->rowCount() == 0)
+	{
+		disconnect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
+				   this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
+
+		addPragma("application_id", "editable", "integer");
+		addPragma("auto_vacuum", "editable", "0, 1, 2");
+		addPragma("automatic_index", "editable", "0 or 1");
+		addPragma("busy_timeout", "editable", "milliseconds");
+		addPragma("cache_size", "editable", "pages or -kbytes");
+		addPragma("cache_spill", "editable", "pages");
+		addPragma("case_sensitive_like", "editable", "0 or 1");
+		addPragma("cell_size_check", "editable", "0 or 1");
+		addPragma("checkpoint_fullfsync", "editable", "0 or 1");
+		addPragma("count_changes", "editable", "0 or 1");
+		addPragma("data_version", "read-only", "");
+		addPragma("default_cache_size", "editable", "pages");
+		addPragma("defer_foreign_keys", "editable", "0 or 1");
+		addPragma("empty_result_callbacks", "editable", "0 or 1");
+		addPragma("encoding", "editable", "UTF-8, UTF-16, UTF16le, UTF16be");
+		addPragma("foreign_keys", "editable", "0 or 1");
+		addPragma("freelist_count", "read-only", "");
+		addPragma("full_column_names", "editable", "0 or 1");
+		addPragma("fullfsync", "editable", "0 or 1");
+		addPragma("ignore_check_constraints", "editable", "0 or 1");
+		addPragma("journal_mode", "editable",
+				  "delete, truncate, persist, memory, wal, off");
+		addPragma("journal_size_limit", "editable", "bytes");
+		addPragma("legacy_alter_table", "editable", "0 or 1");
+		addPragma("legacy_file_format", "editable", "0 or 1");
+		addPragma("locking_mode", "editable", "normal, exclusive");
+		addPragma("max_page_count", "editable", "pages");
+		addPragma("mmap_size", "editable", "bytes");
+		addPragma("page_count", "read-only", "");
+		addPragma("page_size", "read-only", "bytes");
+		addPragma("query_only", "editable", "0 or 1");
+		addPragma("read_uncommitted", "editable", "0 or 1");
+		addPragma("recursive_triggers", "editable", "0 or 1");
+		addPragma("reverse_unordered_selects", "editable", "0 or 1");
+
+		/* This one is actually editable, but it's dangerous to do so. */
+		addPragma("schema_version", "read-only", "");
+		addPragma("secure_delete", "editable", "0 or 1 or fast");
+		addPragma("short_column_names", "editable", "0 or 1");
+		addPragma("soft_heap_limit", "editable", "bytes");
+		addPragma("synchronous", "editable", "0, 1, 2, 3");
+		addPragma("temp_store", "editable", "0, 1, 2");
+		addPragma("threads", "editable", "integer");
+		addPragma("user_version", "editable", "integer");
+		addPragma("wal_autocheckpoint", "editable", "integer");
+
+		pragmaTable->setCurrentItem(pragmaTable->item(0, 0));
+		connect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
+				this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
+	}
+
+	QStringList read(names);
+	if (read.isEmpty())
+	{
+		for (int row = 0; row < pragmaTable->rowCount(); ++row)
+			read.append(pragmaTable->item(row, 0)->text());
+		m_pragmasDirty = false;
+	}
+	QMap<QString,QString> values(readPragmas(read));
+
+	// only touch the cells which changed
+	int current = pragmaTable->currentRow();
+	for (int row = 0; row < pragmaTable->rowCount(); ++row)
+	{
+		QString name(pragmaTable->item(row, 0)->text());
+		if (!values.contains(name)) { continue; }
+		QTableWidgetItem * twi = pragmaTable->item(row, 1);
+		if (twi->text() != values.value(name))
+		{
+			twi->setText(values.value(name));
+			if (row == current)
+				pragmaTable_currentCellChanged(row, 0, 0, 0);
+		}
+	}
+	if (current < 0) { current = 0; }
+	if (names.isEmpty())
+		pragmaTable_currentCellChanged(current, 0, 0, 0);
+
+	if (!m_pragmaTimer->isActive())
+		m_pragmaTimer->start();
 }
 
 void SchemaBrowser::addPragma(
@@ -101,8 +311,7 @@ void SchemaBrowser::addPragma(
 	QTableWidgetItem * twi = new QTableWidgetItem(name);
 	twi->setToolTip(editable);
 	pragmaTable->setItem(row, 0, twi);
-	QString value(Database::pragma(name));
-	twi = new QTableWidgetItem(value);
+	twi = new QTableWidgetItem();
 	twi->setToolTip(valueshint);
 	pragmaTable->setItem(row, 1, twi);
 }
@@ -111,8 +320,138 @@ void SchemaBrowser::tabWidget_currentChanged(int index)
 {
 	if (index == 1)
 	{
+		if (m_pragmasDirty) { refreshPragmas(); }
 		Utils::setColumnWidths(pragmaTable);
 	}
+	else if (   (schemaTabWidget->widget(index) == storageTab)
+			 && QSqlDatabase::database(SESSION_NAME, false).isOpen())
+	{
+		// databases may have been attached or detached meanwhile
+		QString current(storageSchemaCombo->currentText());
+		storageSchemaCombo->clear();
+		storageSchemaCombo->addItems(Database::getDatabases().keys());
+		int i = storageSchemaCombo->findText(current.isEmpty() ? QString("main")
+															   : current);
+		storageSchemaCombo->setCurrentIndex(qMax(i, 0));
+	}
+}
+
+void SchemaBrowser::storageButton_clicked()
+{
+	QString schema(storageSchemaCombo->currentText());
+	if (   schema.isEmpty()
+		|| !QSqlDatabase::database(SESSION_NAME, false).isOpen())
+	{
+		return;
+	}
+
+	StorageAnalyzer analyzer(Database::sqlite3handle(), schema, this);
+	analyzer.runWithProgress(tr("Reading the pages of %1").arg(schema), this);
+	storageTree->clear();
+	m_storage.clear();
+	if (!analyzer.errorMessage().isEmpty())
+	{
+		m_storageSummary = QString("<span style=\" color:#ff0000;\">")
+						   + analyzer.errorMessage() + "</span>";
+		storageLabel->setText(m_storageSummary);
+		return;
+	}
+	m_storage = analyzer.objects();
+	m_storageSummary = tr("%1: %2 pages of %3, %4 of them free (%5).")
+		.arg(schema)
+		.arg(analyzer.pageCount())
+		.arg(Utils::formatSize(analyzer.pageSize()))
+		.arg(analyzer.freePages())
+		.arg(Utils::formatSize(analyzer.freePages() * analyzer.pageSize()));
+	showStorage();
+}
+
+void SchemaBrowser::showStorage()
+{
+	storageTree->setSortingEnabled(false);
+	// indexes go below their tables
+	QMap<QString,QTreeWidgetItem *> tables;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (int i = 0; i < m_storage.count(); ++i)
+		{
+			const StorageAnalyzer::Object & o = m_storage.at(i);
+			bool isIndex = (o.type == "index");
+			if (isIndex != (pass == 1)) { continue; }
+
+			StorageItem * item;
+			QTreeWidgetItem * parent = tables.value(o.table);
+			if (isIndex && parent)
+				item = new StorageItem(parent);
+			else
+				item = new StorageItem(storageTree);
+			if (!isIndex)
+				tables.insert(o.name, item);
+
+			qint64 pages = o.pages[StorageAnalyzer::Internal]
+						   + o.pages[StorageAnalyzer::Leaf]
+						   + o.pages[StorageAnalyzer::Overflow];
+			double fragmentation = StorageAnalyzer::fragmentation(o);
+			item->setText(0, o.name);
+			item->setData(0, Qt::UserRole + 1, i);
+			item->setValue(STORAGE_PAGES, pages, QString::number(pages));
+			item->setValue(STORAGE_SIZE, o.bytes, Utils::formatSize(o.bytes));
+			item->setValue(STORAGE_PAYLOAD, o.payload,
+						   Utils::formatSize(o.payload));
+			item->setValue(STORAGE_UNUSED, o.unused,
+						   Utils::formatSize(o.unused));
+			item->setValue(STORAGE_OVERFLOW,
+						   o.pages[StorageAnalyzer::Overflow],
+						   QString::number(o.pages[StorageAnalyzer::Overflow]));
+			item->setValue(STORAGE_FANOUT, StorageAnalyzer::fanout(o),
+						   QString::number(StorageAnalyzer::fanout(o), 'f', 1));
+			item->setValue(STORAGE_FRAGMENTATION, fragmentation,
+						   QString("%1 %").arg(fragmentation * 100, 0, 'f', 1));
+			item->setValue(STORAGE_ENTRIES, StorageAnalyzer::entries(o),
+						   QString::number(StorageAnalyzer::entries(o)));
+		}
+	}
+	storageTree->setSortingEnabled(true);
+	for (int i = 0; i < storageTree->columnCount(); ++i)
+		storageTree->resizeColumnToContents(i);
+	storageLabel->setText(m_storageSummary);
+}
+
+void SchemaBrowser::storageTree_currentItemChanged(QTreeWidgetItem * current)
+{
+	if (!current)
+	{
+		storageLabel->setText(m_storageSummary);
+		return;
+	}
+	const StorageAnalyzer::Object & o =
+		m_storage.at(current->data(0, Qt::UserRole + 1).toInt());
+	QString text(tr("%1: %2 internal, %3 leaf and %4 overflow pages.")
+		.arg(o.name)
+		.arg(o.pages[StorageAnalyzer::Internal])
+		.arg(o.pages[StorageAnalyzer::Leaf])
+		.arg(o.pages[StorageAnalyzer::Overflow]));
+	if (o.bytes > 0)
+	{
+		text += " " + tr("%1 % of its space is unused.")
+					  .arg(100.0 * o.unused / o.bytes, 0, 'f', 1);
+	}
+	if (StorageAnalyzer::entries(o) > 0)
+	{
+		text += " " + tr("%1 bytes of payload per entry.")
+			.arg((double)o.payload / StorageAnalyzer::entries(o), 0, 'f', 1);
+	}
+	if (current->childCount() > 0)
+	{
+		qint64 bytes = o.bytes;
+		for (int i = 0; i < current->childCount(); ++i)
+		{
+			bytes += m_storage.at(current->child(i)->data(0, Qt::UserRole + 1)
+								  .toInt()).bytes;
+		}
+		text += " " + tr("With its indexes: %1.").arg(Utils::formatSize(bytes));
+	}
+	storageLabel->setText(text);
 }
 
 void SchemaBrowser::pragmaTable_currentCellChanged(int currentRow, int /*currentColumn*/, int /*previousRow*/, int /*previousColumn*/)
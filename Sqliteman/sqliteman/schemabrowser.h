@@ -8,13 +8,20 @@ for which a new license (GPL+exception) is in place.
 #ifndef SCHEMABROWSER_H
 #define SCHEMABROWSER_H
 
+#include "storageanalyzer.h"
 #include "ui_schemabrowser.h"
 
 class ExtensionModel;
+class QTimer;
 
 
 /*! \brief A "toolbox" widget containing DB objects and more useful info.
-It contains a DB object tree and PRAGMAs list now.
+It contains a DB object tree, PRAGMAs list and the space used by each
+table and index (StorageAnalyzer) now.
+The pragma values are read only while the Pragmas tab is visible, in
+one SELECT over the pragma_* table-valued functions where the sqlite
+library has them. Volatile values are polled by a timer, which pauses
+while a worker uses the main connection (MainConnectionMonitor).
 \author Petr Vanek <petr@scribus.info>
 */
 class SchemaBrowser : public QWidget, public Ui::SchemaBrowser
@@ -24,7 +31,10 @@ class SchemaBrowser : public QWidget, public Ui::SchemaBrowser
 	public:
 		SchemaBrowser(QWidget * parent = 0, Qt::WindowFlags f = 0);
 
-		//! \brief Clear and reset the pragma values.
+		/*! \brief The pragma values may have changed.
+		They are re-read now if the Pragmas tab is visible, otherwise
+		when it is shown.
+		*/
 		void buildPragmasTree();
 		/*! \brief Append all loaded extensions to display
 		\param list a filenames to append
@@ -32,22 +42,52 @@ class SchemaBrowser : public QWidget, public Ui::SchemaBrowser
 		*/
 		void appendExtensions(const QStringList & list, bool switchToTab = false);
 
+	protected:
+		void showEvent(QShowEvent * event);
+
 	private:
 		ExtensionModel * m_extensionModel;
+		//! \brief values are outdated, read them when visible
+		bool m_pragmasDirty;
+		//! \brief pragmas readable as pragma_* functions, see readPragmas()
+		QStringList m_batchPragmas;
+		bool m_batchProbed;
+		QTimer * m_pragmaTimer;
+		//! \brief the last analysis of the Storage tab
+		QList<StorageAnalyzer::Object> m_storage;
+		//! \brief page totals of the schema, shown without a current item
+		QString m_storageSummary;
 
 		/*! \brief Add a pragma into the list (QTableWidget).
-		Query the DB for its value and store it in the widget.
+		The value is filled by refreshPragmas().
 		\param name name of the pragma (PRAGMA name;)
 		*/
 		void addPragma(const QString & name,
                        const QString & editable, const QString& valueshint);
+		bool pragmasVisible();
+		/*! \brief Read pragma values and update the cells which changed.
+		\param names pragmas to read, all of them when empty
+		*/
+		void refreshPragmas(const QStringList & names = QStringList());
+		//! \brief Current values of names, mostly in a single statement.
+		QMap<QString,QString> readPragmas(const QStringList & names);
+		//! \brief Fill storageTree from m_storage.
+		void showStorage();
 
 	private slots:
 		void tabWidget_currentChanged(int);
+		//! \brief Poll the pragmas which change with every write.
+		void pragmaTimer_timeout();
+		//! \brief Poll again after a worker left the main connection.
+		void mainConnection_idle();
 		//! \brief Show currently selected pragma in the detail widget.
 		void pragmaTable_currentCellChanged(int currentRow, int currentColumn, int previousRow, int previousColumn);
 		//! \brief Set new value for the chosen pragma.
 		void setPragmaButton_clicked();
+		//! \brief Read the page statistics of the chosen schema.
+		void storageButton_clicked();
+		//! \brief Page details of an object in storageLabel.
+		void storageTree_currentItemChanged(QTreeWidgetItem * current);
 };
 
 #endif
@@ -0,0 +1,319 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "schemacatalog.h"
+#include "sqlparser.h"
+#include "utils.h"
+
+
+SchemaCatalog * SchemaCatalog::_instance = 0;
+QAtomicInt SchemaCatalog::m_generation(0);
+
+SchemaCatalog * SchemaCatalog::instance()
+{
+	if (_instance == 0)
+		_instance = new SchemaCatalog();
+
+	return _instance;
+}
+
+void SchemaCatalog::deleteInstance()
+{
+	if (_instance)
+		delete _instance;
+	_instance = 0;
+}
+
+SchemaCatalog::SchemaCatalog()
+	: m_handle(0)
+{
+}
+
+SchemaCatalog::~SchemaCatalog()
+{
+	reset();
+}
+
+void SchemaCatalog::reset()
+{
+	if (m_handle)
+		sqlite3_set_authorizer(m_handle, NULL, NULL);
+	m_handle = 0;
+	m_schemas.clear();
+}
+
+int SchemaCatalog::authorizer(void * /*unused*/, int action, const char * arg1,
+							  const char * /*arg2*/, const char * /*arg3*/,
+							  const char * /*arg4*/)
+{
+	if (   ((action == SQLITE_TRANSACTION) || (action == SQLITE_SAVEPOINT))
+		&& arg1 && (qstricmp(arg1, "ROLLBACK") == 0))
+	{
+		// the statement may be prepared on a worker thread
+		m_generation.ref();
+	}
+	return SQLITE_OK;
+}
+
+sqlite3 * SchemaCatalog::handle()
+{
+	if (!m_handle)
+	{
+		m_handle = Database::sqlite3handle();
+		if (m_handle)
+			sqlite3_set_authorizer(m_handle, authorizer, NULL);
+	}
+	return m_handle;
+}
+
+bool SchemaCatalog::version(sqlite3 * handle, const QString & schema,
+							int * version, QString * fileName,
+							QString * error)
+{
+	QByteArray sql(QString("PRAGMA %1.schema_version;")
+				   .arg(Utils::q(schema)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, NULL);
+	if (rc == SQLITE_OK)
+	{
+		rc = sqlite3_step(stmt);
+		if (rc == SQLITE_ROW)
+			*version = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_ROW)
+	{
+		*error = QString::fromUtf8(sqlite3_errmsg(handle));
+		return false;
+	}
+	*fileName = QString::fromUtf8(
+		sqlite3_db_filename(handle, schema.toUtf8().constData()));
+	return true;
+}
+
+bool SchemaCatalog::load(sqlite3 * handle, const QString & schema,
+						 SchemaSnapshot & snapshot, QString * error)
+{
+	snapshot = SchemaSnapshot();
+	// set by the caller, so load() does not touch m_generation on
+	// a worker thread
+	snapshot.generation = -1;
+	// The version is read first: if another connection changes the
+	// schema in between, the next check sees a newer version and reloads.
+	bool ok = version(handle, schema, &snapshot.version,
+					  &snapshot.fileName, error);
+	if (ok)
+	{
+		QByteArray sql(QString("SELECT type, name, tbl_name, sql FROM %1;")
+					   .arg(Database::getMaster(schema)).toUtf8());
+		sqlite3_stmt * stmt = 0;
+		int rc = sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, NULL);
+		while ((rc == SQLITE_OK || rc == SQLITE_ROW)
+			   && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+		{
+			SchemaObject o;
+			o.type = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 0));
+			o.name = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 1));
+			o.tblName = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 2));
+			o.sql = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 3));
+
+			snapshot.byName.insert(o.name.toLower(), snapshot.objects.count());
+			snapshot.all.insertMulti(o.tblName, o.name);
+			// the same test as "name like 'sqlite_%'"
+			bool system = (o.name.length() > 6)
+						  && o.name.startsWith("sqlite", Qt::CaseInsensitive);
+			if (!system)
+				snapshot.byType[o.type.toLower()].insertMulti(o.tblName, o.name);
+			else if (o.type == "table")
+				snapshot.sys.insertMulti(o.tblName, o.name);
+			snapshot.objects.append(o);
+		}
+		if (rc != SQLITE_DONE)
+		{
+			*error = QString::fromUtf8(sqlite3_errmsg(handle));
+			ok = false;
+		}
+		sqlite3_finalize(stmt);
+	}
+	return ok;
+}
+
+SchemaSnapshot * SchemaCatalog::current(const QString & schema,
+										QString * error)
+{
+	sqlite3 * h = handle();
+	if (!h)
+	{
+		*error = tr("No database is open");
+		return 0;
+	}
+
+	QString key(schema.toLower());
+	QHash<QString,SchemaSnapshot>::iterator it = m_schemas.find(key);
+	if (it != m_schemas.end())
+	{
+		int v;
+		QString fileName;
+		if (!version(h, schema, &v, &fileName, error))
+		{
+			m_schemas.erase(it);
+			return 0;
+		}
+		if (   (it->version == v) && (it->fileName == fileName)
+			&& (it->generation == generation()))
+		{
+			return &(*it);
+		}
+	}
+
+	SchemaSnapshot snapshot;
+	if (!load(h, schema, snapshot, error))
+	{
+		m_schemas.remove(key);
+		return 0;
+	}
+	snapshot.generation = generation();
+	return &(m_schemas.insert(key, snapshot).value());
+}
+
+const SchemaSnapshot * SchemaCatalog::snapshot(const QString & schema,
+											   QString * error)
+{
+	return current(schema, error);
+}
+
+void SchemaCatalog::store(const QString & schema,
+						  const SchemaSnapshot & snapshot)
+{
+	sqlite3 * h = handle();
+	if (!h || (snapshot.generation != generation())) { return; }
+	int v;
+	QString fileName;
+	QString error;
+	if (   version(h, schema, &v, &fileName, &error)
+		&& (v == snapshot.version) && (fileName == snapshot.fileName))
+	{
+		m_schemas.insert(schema.toLower(), snapshot);
+	}
+}
+
+bool SchemaCatalog::isCurrent(const QString & schema)
+{
+	sqlite3 * h = handle();
+	if (!h) { return false; }
+	QHash<QString,SchemaSnapshot>::const_iterator it =
+		m_schemas.find(schema.toLower());
+	if (it == m_schemas.end()) { return false; }
+	int v;
+	QString fileName;
+	QString error;
+	return    version(h, schema, &v, &fileName, &error)
+		   && (it->version == v) && (it->fileName == fileName)
+		   && (it->generation == generation());
+}
+
+QList<FieldInfo> SchemaCatalog::fields(const QString & table,
+									   const QString & schema,
+									   QString * error)
+{
+	SchemaSnapshot * s = current(schema, error);
+	if (!s) { return QList<FieldInfo>(); }
+
+	QString key(table.toLower());
+	QHash<QString,QList<FieldInfo> >::const_iterator it = s->fields.find(key);
+	if (it != s->fields.end()) { return it.value(); }
+
+	int i = s->byName.value(key, -1);
+	SqlParser parser(i < 0 ? QString() : s->objects.at(i).sql);
+	s->fields.insert(key, parser.m_fields);
+	return parser.m_fields;
+}
+
+QStringList SchemaCatalog::sysIndexes(const QString & table,
+									  const QString & schema,
+									  QString * error)
+{
+	SchemaSnapshot * s = current(schema, error);
+	if (!s) { return QStringList(); }
+
+	QString key(table.toLower());
+	QHash<QString,QStringList>::const_iterator it = s->sysIndexes.find(key);
+	if (it != s->sysIndexes.end()) { return it.value(); }
+
+	// tbl_name of an index is the name the table was created with
+	int i = s->byName.value(key, -1);
+	QString name(i < 0 ? table : s->objects.at(i).name);
+	// really all indexes, including the ones of WITHOUT ROWID primary keys
+	QStringList orig(s->byType.value("index").values(name));
+	QStringList sysIx;
+	QByteArray sql(QString("PRAGMA %1.index_list(%2);")
+				   .arg(Utils::q(schema)).arg(Utils::q(table)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, NULL);
+	while ((rc == SQLITE_OK || rc == SQLITE_ROW)
+		   && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+	{
+		QString curr(QString::fromUtf8(
+			(const char *)sqlite3_column_text(stmt, 1)));
+		if (!orig.contains(curr))
+			sysIx.append(curr);
+	}
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_DONE)
+	{
+		*error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+		return sysIx;
+	}
+	s->sysIndexes.insert(key, sysIx);
+	return sysIx;
+}
+
+QString SchemaCatalog::objectSql(const QString & name, const QString & schema,
+								 QString * error)
+{
+	SchemaSnapshot * s = current(schema, error);
+	if (!s) { return QString(); }
+	int i = s->byName.value(name.toLower(), -1);
+	return i < 0 ? QString() : s->objects.at(i).sql;
+}
+
+
+SchemaCatalogLoader::SchemaCatalogLoader(const QStringList & schemas,
+										 QObject * parent)
+	: QThread(parent),
+	  m_generation(SchemaCatalog::generation()),
+	  m_schemas(schemas)
+{
+	QString error;
+	m_handle = Database::openConnection(true, &error);
+}
+
+SchemaCatalogLoader::~SchemaCatalogLoader()
+{
+	wait();
+	if (m_handle)
+		sqlite3_close(m_handle);
+}
+
+void SchemaCatalogLoader::run()
+{
+	if (!m_handle) { return; }
+	foreach (QString schema, m_schemas)
+	{
+		SchemaSnapshot snapshot;
+		QString error;
+		if (SchemaCatalog::load(m_handle, schema, snapshot, &error))
+		{
+			snapshot.generation = m_generation;
+			m_snapshots.insert(schema, snapshot);
+		}
+	}
+}
@@ -0,0 +1,180 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef SCHEMACATALOG_H
+#define SCHEMACATALOG_H
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QHash>
+#include <QThread>
+
+#include "database.h"
+
+
+/*! \brief One row of sqlite_master.
+*/
+typedef struct
+{
+	QString type;
+	QString name;
+	QString tblName;
+	QString sql;
+}
+SchemaObject;
+
+
+/*! \brief Contents of one schema's sqlite_master with lookup tables.
+The parsed columns and the system indexes are filled on first use.
+*/
+typedef struct
+{
+	//! \brief PRAGMA schema_version the snapshot was read at
+	int version;
+	//! \brief file of the schema, so a re-ATTACH is noticed
+	QString fileName;
+	//! \brief SchemaCatalog generation the snapshot was read in
+	int generation;
+	//! \brief rows in sqlite_master order
+	QList<SchemaObject> objects;
+	//! \brief lower(name) to position in objects
+	QHash<QString,int> byName;
+	//! \brief lower(type) to tbl_name/name of the user objects
+	QHash<QString,DbObjects> byType;
+	//! \brief tbl_name/name of all objects
+	DbObjects all;
+	//! \brief tbl_name/name of the sqlite_% tables
+	DbObjects sys;
+	//! \brief lower(table) to its parsed columns
+	QHash<QString,QList<FieldInfo> > fields;
+	//! \brief lower(table) to its indexes which are not in sqlite_master
+	QHash<QString,QStringList> sysIndexes;
+}
+SchemaSnapshot;
+
+
+/*! \brief Cache of sqlite_master for all schemas of the open database.
+Each schema is read once into a SchemaSnapshot and served from memory
+until its PRAGMA schema_version or its file changes. Checking the
+version is a single cheap pragma, so building the object tree no longer
+queries sqlite_master (and parses the CREATE statement) for every table.
+A rolled back transaction or savepoint can bring an older
+schema_version back, so any ROLLBACK prepared on the connection (seen
+through the authorizer) forces a reload as well. sqlite keeps a single
+authorizer per connection and cannot tell the one it replaces, so the
+catalog's authorizer is exclusive: nothing else may install one on the
+main connection.
+Database::getObjects(), tableFields(), getSysIndexes() and parseTable()
+are served from here. SchemaCatalog is a singleton like Preferences.
+*/
+class SchemaCatalog
+{
+		Q_DECLARE_TR_FUNCTIONS(SchemaCatalog)
+
+	public:
+		static SchemaCatalog * instance();
+		static void deleteInstance();
+
+		/*! \brief Read sqlite_master of schema into snapshot.
+		It only uses handle, so it can run on a worker thread with its
+		own connection (see Database::openConnection()).
+		\retval bool false on error, with error set
+		*/
+		static bool load(sqlite3 * handle, const QString & schema,
+						 SchemaSnapshot & snapshot, QString * error);
+
+		/*! \brief Current snapshot of schema.
+		It is (re)loaded when it is missing or outdated.
+		\retval SchemaSnapshot* 0 on error, with error set
+		*/
+		const SchemaSnapshot * snapshot(const QString & schema,
+										QString * error);
+
+		/*! \brief Use snapshot, loaded elsewhere, for schema.
+		It is ignored when the schema has changed since it was read.
+		*/
+		void store(const QString & schema, const SchemaSnapshot & snapshot);
+
+		//! \brief Parsed columns of table. Empty if it does not exist.
+		QList<FieldInfo> fields(const QString & table, const QString & schema,
+								QString * error);
+		//! \brief Indexes of table which are not in sqlite_master.
+		QStringList sysIndexes(const QString & table, const QString & schema,
+							   QString * error);
+		//! \brief CREATE statement of an object, found case insensitively.
+		QString objectSql(const QString & name, const QString & schema,
+						  QString * error);
+
+		//! \brief True when schema's snapshot is loaded and up to date.
+		bool isCurrent(const QString & schema);
+
+		//! \brief Forget everything, e.g. when another database is opened.
+		void reset();
+
+		//! \brief Counter of rolled back transactions, see store().
+		static int generation() { return m_generation; }
+
+	private:
+		SchemaCatalog();
+		//! \brief Also removes the authorizer from the connection.
+		~SchemaCatalog();
+
+		static SchemaCatalog * _instance;
+		/*! \brief bumped for every ROLLBACK prepared on the main connection
+		Atomic, as the authorizer runs on whichever thread prepares.
+		*/
+		static QAtomicInt m_generation;
+
+		sqlite3 * m_handle;
+		//! \brief lower(schema) to its snapshot
+		QHash<QString,SchemaSnapshot> m_schemas;
+
+		sqlite3 * handle();
+		SchemaSnapshot * current(const QString & schema, QString * error);
+		static bool version(sqlite3 * handle, const QString & schema,
+							int * version, QString * fileName, QString * error);
+		static int authorizer(void * unused, int action, const char * arg1,
+							  const char * arg2, const char * arg3,
+							  const char * arg4);
+};
+
+
+
+/*! \brief Reads snapshots of some schemas on a worker thread.
+It uses its own read only connection (Database::openConnection()), so
+the GUI stays responsive while a large sqlite_master is read. The
+connection does not see the temp schema or uncommitted changes, so
+those have to be read on the main connection.
+When the thread has finished, the GUI thread passes snapshots() to
+SchemaCatalog::store().
+*/
+class SchemaCatalogLoader : public QThread
+{
+		Q_OBJECT
+
+	public:
+		//! \brief Opens the connection; call it from the GUI thread.
+		SchemaCatalogLoader(const QStringList & schemas, QObject * parent = 0);
+		~SchemaCatalogLoader();
+
+		//! \brief false when no connection could be opened
+		bool isValid() { return m_handle != 0; }
+		const QStringList & schemas() { return m_schemas; }
+		//! \brief Snapshots read, by schema. Valid after finished().
+		const QMap<QString,SchemaSnapshot> & snapshots() { return m_snapshots; }
+
+	protected:
+		void run();
+
+	private:
+		sqlite3 * m_handle;
+		int m_generation;
+		QStringList m_schemas;
+		QMap<QString,SchemaSnapshot> m_snapshots;
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegExp>
+#include <ctype.h>
+
+#include "scriptrunner.h"
+
+// longest statement text quoted in an error message
+#define QUOTE_LENGTH 200
+
+
+ScriptRunner::ScriptRunner(sqlite3 * handle, const QString & fileName,
+						   bool oneTransaction, QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_fileName(fileName),
+	  m_oneTransaction(oneTransaction),
+	  m_statements(0)
+{
+}
+
+bool ScriptRunner::isTransactionControl(sqlite3_stmt * stmt)
+{
+	// sqlite3_sql() starts with any comments before the statement
+	QRegExp control(
+		"^(\\s|--[^\\n]*\\n|/\\*.*\\*/)*(BEGIN|COMMIT|END|ROLLBACK)\\b",
+		Qt::CaseInsensitive);
+	control.setMinimal(true);
+	QRegExp rollbackTo("^ROLLBACK(\\s+TRANSACTION)?\\s+TO\\b",
+					   Qt::CaseInsensitive);
+	QString sql(QString::fromUtf8(sqlite3_sql(stmt)));
+	if (control.indexIn(sql) != 0) { return false; }
+	return rollbackTo.indexIn(sql.mid(control.pos(2))) != 0;
+}
+
+void ScriptRunner::fileError(const char * data, qint64 offset, qint64 size,
+							 const QString & error)
+{
+	qint64 line = 1;
+	for (const char * p = data; p < data + offset; ++p)
+	{
+		if (*p == '\n') { ++line; }
+	}
+	int length = (int)qMin<qint64>(size - offset, QUOTE_LENGTH);
+	m_error = tr("Error at byte %1 (line %2): %3")
+			  .arg(offset).arg(line).arg(error);
+	emit message("-- " + m_error);
+	emit message(QString::fromUtf8(data + offset, length)
+				 + (length < size - offset ? "..." : ""));
+}
+
+void ScriptRunner::run()
+{
+	QFile file(m_fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		m_error = tr("Cannot open file %1: %2")
+				  .arg(m_fileName).arg(file.errorString());
+		emit message("-- " + m_error);
+		return;
+	}
+
+	// map the file; if that is not possible, read it
+	qint64 size = file.size();
+	QByteArray buffer;
+	const char * data = (size > 0) ? (const char *)file.map(0, size) : 0;
+	if (!data)
+	{
+		buffer = file.readAll();
+		data = buffer.constData();
+		size = buffer.size();
+	}
+	qint64 offset = 0;
+	if ((size >= 3) && (qstrncmp(data, "\xEF\xBB\xBF", 3) == 0))
+		offset = 3; // UTF-8 byte order mark
+
+	emit message("-- " + tr("Executing %1 (%2 bytes)")
+						 .arg(m_fileName).arg(size));
+	QElapsedTimer timer;
+	timer.start();
+	int changes = sqlite3_total_changes(m_handle);
+	int skipped = 0;
+	bool ok = true;
+
+	if (m_oneTransaction && !exec("SAVEPOINT EXECUTE_FILE;"))
+	{
+		emit message("-- " + m_error);
+		return;
+	}
+
+	while ((offset < size) && !isCancelled())
+	{
+		// sqlite3_prepare_v2 takes an int length
+		int length = (int)qMin<qint64>(size - offset, 0x7fffffff);
+		const char * sql = data + offset;
+		const char * tail = 0;
+		sqlite3_stmt * stmt = 0;
+		int rc = sqlite3_prepare_v2(m_handle, sql, length, &stmt, &tail);
+		if (rc != SQLITE_OK)
+		{
+			if (rc == SQLITE_INTERRUPT) { break; }
+			qint64 at = offset;
+#if SQLITE_VERSION_NUMBER >= 3038000
+			int inside = sqlite3_error_offset(m_handle);
+			if (inside >= 0) { at += inside; }
+#endif
+			fileError(data, at, size,
+					  QString::fromUtf8(sqlite3_errmsg(m_handle)));
+			ok = false;
+			break;
+		}
+		if (stmt == 0) // only white space or comments left
+		{
+			offset = size;
+			break;
+		}
+
+		if (m_oneTransaction && isTransactionControl(stmt))
+		{
+			++skipped;
+		}
+		else
+		{
+			while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+				; // results are not shown
+			if (rc != SQLITE_DONE)
+			{
+				if (!isCancelled())
+				{
+					// report where the statement starts, after blanks
+					qint64 at = offset;
+					while ((at < size) && isspace((unsigned char)data[at]))
+						++at;
+					fileError(data, at, size,
+							  QString::fromUtf8(sqlite3_errmsg(m_handle)));
+					ok = false;
+				}
+				sqlite3_finalize(stmt);
+				break;
+			}
+			++m_statements;
+		}
+		sqlite3_finalize(stmt);
+		offset = tail - data;
+		reportProgress(offset, size);
+	}
+
+	if (isCancelled())
+	{
+		emit message("-- " + tr("Cancelled at byte %1").arg(offset));
+		ok = false;
+	}
+	if (m_oneTransaction)
+	{
+		QString error(m_error);
+		if (!ok) { exec("ROLLBACK TO EXECUTE_FILE;"); }
+		exec("RELEASE EXECUTE_FILE;");
+		if (!ok)
+			emit message("-- " + tr("All changes of the file are rolled back"));
+		m_error = error;
+	}
+
+	QString summary(tr("%1 statements executed, %2 rows changed "
+					   "in %3 seconds")
+					.arg(m_statements)
+					.arg(sqlite3_total_changes(m_handle) - changes)
+					.arg(timer.elapsed() / 1000.0));
+	if (skipped > 0)
+		summary += tr(", %1 transaction statements skipped").arg(skipped);
+	emit message("-- " + summary);
+	emit progress(1000);
+}
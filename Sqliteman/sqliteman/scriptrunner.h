@@ -0,0 +1,51 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef SCRIPTRUNNER_H
+#define SCRIPTRUNNER_H
+
+#include "databaseworker.h"
+
+
+/*! \brief Execute an SQL file straight from the disk.
+The file is memory mapped and fed to sqlite3_prepare_v2() one statement
+at a time, following the tail pointer, so it never has to be loaded
+into the editor or held in memory as a QString. Result rows are stepped
+through and dropped. Only summary lines are sent to message(); an error
+stops the run and is reported with its byte offset and line in the
+file.
+When oneTransaction is set, the whole file runs inside a savepoint and
+the file's own BEGIN, COMMIT, END and ROLLBACK statements are skipped,
+so an error or cancel leaves the database as it was.
+*/
+class ScriptRunner : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		ScriptRunner(sqlite3 * handle, const QString & fileName,
+					 bool oneTransaction, QObject * parent = 0);
+
+		//! \brief True when some statement was run, even if rolled back.
+		bool executed() { return m_statements > 0; }
+
+	protected:
+		void run();
+
+	private:
+		QString m_fileName;
+		bool m_oneTransaction;
+		int m_statements;
+
+		//! \brief BEGIN, COMMIT, END or ROLLBACK (not ROLLBACK TO)
+		static bool isTransactionControl(sqlite3_stmt * stmt);
+		//! \brief Report an error at offset of the mapped file data.
+		void fileError(const char * data, qint64 offset, qint64 size,
+					   const QString & error);
+};
+
+#endif
@@ -17,13 +17,18 @@ for which a new license (GPL+exception) is in place.
 #include <QShortcut>
 #include <QSettings>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QTime>
 
 #include <qscilexer.h>
 
+#include "benchmarkdialog.h"
 #include "createviewdialog.h"
 #include "database.h"
+#include "indexadvisor.h"
 #include "preferences.h"
 #include "queryeditordialog.h"
+#include "queryplan.h"
 #include "sqleditor.h"
 #include "sqlkeywords.h"
 #include "sqlmodels.h"
@@ -32,10 +37,12 @@ for which a new license (GPL+exception) is in place.
 
 SqlEditor::SqlEditor(LiteManWindow * parent)
 	: QMainWindow(parent),
-   	  m_fileWatcher(0)
+   	  m_fileWatcher(0),
+	  m_planDialog(0)
 {
 	creator = parent;
 	ui.setupUi(this);
+	m_statements = new StatementIndex(ui.sqlTextEdit);
 
 #ifdef Q_WS_MAC
     ui.toolBar->setIconSize(QSize(16, 16));
@@ -75,6 +82,8 @@ SqlEditor::SqlEditor(LiteManWindow * parent)
 	ui.action_Run_SQL->setIcon(Utils::getIcon("runsql.png"));
 	ui.actionRun_Explain->setIcon(Utils::getIcon("runexplain.png"));
 	ui.actionRun_as_Script->setIcon(Utils::getIcon("runscript.png"));
+	ui.actionAdvise_Indexes->setIcon(Utils::getIcon("index.png"));
+	ui.actionBenchmark->setIcon(Utils::getIcon("runsql.png"));
 	ui.action_Open->setIcon(Utils::getIcon("document-open.png"));
 	ui.action_Save->setIcon(Utils::getIcon("document-save.png"));
 	ui.action_New->setIcon(Utils::getIcon("document-new.png"));
@@ -91,6 +100,9 @@ SqlEditor::SqlEditor(LiteManWindow * parent)
     connect(ui.actionShow_History, SIGNAL(triggered()),
             this, SLOT(actionShow_History_triggered()));
     actionShow_History_triggered();
+	connect(ui.historyFilterEdit, SIGNAL(textChanged(const QString &)),
+			this, SLOT(historyFilterEdit_textChanged(const QString &)));
+	loadHistory();
 
 	connect(ui.action_Run_SQL, SIGNAL(triggered()),
 			this, SLOT(action_Run_SQL_triggered()));
@@ -99,6 +111,10 @@ SqlEditor::SqlEditor(LiteManWindow * parent)
             this, SLOT(action_Run_SQL_triggered()));
 	connect(ui.actionRun_Explain, SIGNAL(triggered()),
 			this, SLOT(actionRun_Explain_triggered()));
+	connect(ui.actionBenchmark, SIGNAL(triggered()),
+			this, SLOT(actionBenchmark_triggered()));
+	connect(ui.actionAdvise_Indexes, SIGNAL(triggered()),
+			this, SLOT(actionAdvise_Indexes_triggered()));
 	connect(ui.actionRun_as_Script, SIGNAL(triggered()),
 			this, SLOT(actionRun_as_Script_triggered()));
 	connect(ui.action_Open, SIGNAL(triggered()),
@@ -152,23 +168,14 @@ QString SqlEditor::query()
 			return ui.sqlTextEdit->selectedText();
 	}
 	
-	toSQLParse::editorTokenizer tokens(ui.sqlTextEdit);
-
 	int cpos, cline;
 	ui.sqlTextEdit->getCursorPosition(&cline, &cpos);
 
-	int line;
-	int pos;
-	do
-	{
-		line = tokens.line();
-		pos = tokens.offset();
-		toSQLParse::parseStatement(tokens);
-	}
-	while (tokens.line() < cline ||
-			  (tokens.line() == cline && tokens.offset() < cpos));
-
-	return prepareExec(tokens, line, pos);
+	int i = m_statements->find(cline, cpos);
+	StatementPosition start(m_statements->start(i));
+	StatementPosition end(m_statements->end(i));
+	toSQLParse::editorTokenizer tokens(ui.sqlTextEdit, end.offset, end.line);
+	return prepareExec(tokens, start.line, start.offset);
 }
 
 QString SqlEditor::prepareExec(toSQLParse::tokenizer &tokens, int line, int pos)
@@ -266,20 +273,39 @@ void SqlEditor::action_Run_SQL_triggered()
 
 void SqlEditor::actionRun_Explain_triggered()
 {
-    QString s("explain query plan %1");
-    s = s.arg(query());
-	emit showSqlResult(s);
-    appendHistory(s);
+	QString sql(query());
+	if (!m_planDialog)
+	{
+		m_planDialog = new QueryPlanDialog(this);
+	}
+	m_planDialog->setQuery(sql);
+	m_planDialog->show();
+	m_planDialog->raise();
+	appendHistory(QString("explain query plan %1").arg(sql));
+}
+
+void SqlEditor::actionAdvise_Indexes_triggered()
+{
+	if ((!creator) || !(creator->checkForPending())) { return; }
+	IndexAdvisorDialog dia(query(), creator);
+	dia.exec();
+	if (dia.schemaChanged()) { emit buildTree(); }
+}
+
+void SqlEditor::actionBenchmark_triggered()
+{
+	if ((!creator) || !(creator->checkForPending())) { return; }
+	BenchmarkDialog dia(query(), creator);
+	dia.exec();
 }
 
 void SqlEditor::actionRun_as_Script_triggered()
 {
 	if ((!creator) || !(creator->checkForPending())) { return; }
-	SqlQueryModel * model = 0;
+	int results = 0;
 	bool rebuildTree = false;
 	bool updateTable = false;
 	m_scriptCancelled = false;
-	toSQLParse::editorTokenizer tokens(ui.sqlTextEdit);
 	int cpos, cline;
 	ui.sqlTextEdit->getCursorPosition(&cline, &cpos);
 
@@ -288,49 +314,69 @@ void SqlEditor::actionRun_as_Script_triggered()
 			tr("Cancel"), 0, ui.sqlTextEdit->lines(), this);
 	connect(dialog, SIGNAL(canceled()), this, SLOT(scriptCancelled()));
 
-	int line;
-	int pos;
+	StatementPosition start;
+	StatementPosition end = { 0, 0 };
 	bool ignore = true;
 
-	QSqlQuery query(QSqlDatabase::database(SESSION_NAME));
 	QString sql;
 	bool isError = false;
+	QElapsedTimer eventTimer;
+	eventTimer.start();
+
+	// An edit while events are processed would drop the statement
+	// bounds the loop is reading.
+	bool readOnly = ui.sqlTextEdit->isReadOnly();
+	ui.sqlTextEdit->setReadOnly(true);
 
 	emit sqlScriptStart();
 	emit showSqlScriptResult("-- " + tr("Script started"));
-	do {
-		line = tokens.line();
-		pos = tokens.offset();
-		dialog->setValue(line);
-		qApp->processEvents();
-		if (m_scriptCancelled)
-			break;
-		toSQLParse::parseStatement(tokens);
+	for (int i = 0; i < m_statements->count(); ++i)
+	{
+		start = m_statements->start(i);
+		if (eventTimer.elapsed() >= 100)
+		{
+			dialog->setValue(start.line);
+			qApp->processEvents();
+			eventTimer.restart();
+			if (m_scriptCancelled)
+				break;
+		}
+		end = m_statements->end(i);
 
-		if (ignore && (tokens.line() > cline ||
-				  (tokens.line() == cline &&
-				  tokens.offset() >= cpos)))
+		if (ignore && (end.line > cline ||
+				  (end.line == cline &&
+				  end.offset >= cpos)))
 		{
 			ignore = false;
-			cline = line;
-			cpos = pos;
+			cline = start.line;
+			cpos = start.offset;
 		}
 
-		if (tokens.line() < ui.sqlTextEdit->lines() && !ignore)
+		if (end.line < ui.sqlTextEdit->lines() && !ignore)
 		{
-			sql = prepareExec(tokens, line, pos);
+			toSQLParse::editorTokenizer tokens(ui.sqlTextEdit,
+											   end.offset, end.line);
+			sql = prepareExec(tokens, start.line, start.offset);
 			emit showSqlScriptResult(sql);
-			SqlQueryModel * mdl = new SqlQueryModel(creator);
-			mdl->setQuery(sql, QSqlDatabase::database(SESSION_NAME));
+			QString error;
+			QList<SqlQueryModel*> models;
+			bool ok = runScriptStatement(sql, &models, &error);
             appendHistory(sql);
-			if (mdl->lastError().isValid())
+			foreach (SqlQueryModel * model, models)
+			{
+				emit scriptResult(model);
+				emit showSqlScriptResult("-- " + tr("Result %1: %2 rows")
+										 .arg(++results)
+										 .arg(model->rowCount()));
+			}
+			if (!ok)
 			{
 				emit showSqlScriptResult(
-					"-- " + tr("Error: %1.").arg(mdl->lastError().text()));
+					"-- " + tr("Error: %1.").arg(error));
 				int com = QMessageBox::question(this, tr("Run as Script"),
 						tr("This script contains the following error:\n")
-						+ mdl->lastError().text()
-						+ tr("\nAt line: %1").arg(line),
+						+ error
+						+ tr("\nAt line: %1").arg(start.line),
 						QMessageBox::Ignore, QMessageBox::Abort);
 				if (com == QMessageBox::Abort)
 				{
@@ -344,27 +390,82 @@ void SqlEditor::actionRun_as_Script_triggered()
 				if (Utils::updateObjectTree(sql)) { rebuildTree = true; }
 				if (Utils::updateTables(sql)) { updateTable = true; }
 				emit showSqlScriptResult("-- " + tr("No error"));
-				if (mdl->rowCount() > 0) { model = mdl; }
-				else delete mdl;
 			}
 			emit showSqlScriptResult("--");
 		}
 	}
-	while (tokens.line() < ui.sqlTextEdit->lines());
 
 	delete dialog;
-	ui.sqlTextEdit->setSelection(cline, cpos, tokens.line(), tokens.offset());
+	ui.sqlTextEdit->setReadOnly(readOnly);
+	ui.sqlTextEdit->setSelection(cline, cpos, end.line, end.offset);
 	if (!isError)
 		emit showSqlScriptResult("-- " + tr("Script finished"));
 	if (rebuildTree) { emit buildTree(); }
 	if (updateTable) { emit refreshTable(); }
-	if (model)
+	if (results > 0)
 	{
-		creator->setTableModel(model);
+		creator->selectScriptResult();
 	}
 	creator->buildPragmasTree();
 }
 
+bool SqlEditor::runScriptStatement(const QString & sql,
+								   QList<SqlQueryModel*> * results,
+								   QString * error)
+{
+	sqlite3 * handle = Database::sqlite3handle();
+	if (!handle)
+	{
+		*error = tr("No database is open");
+		return false;
+	}
+	QByteArray utf(sql.toUtf8());
+	const char * tail = utf.constData();
+	const char * end = tail + utf.size();
+	while (tail < end)
+	{
+		sqlite3_stmt * stmt = 0;
+		if (sqlite3_prepare_v2(handle, tail, end - tail, &stmt, &tail)
+			!= SQLITE_OK)
+		{
+			*error = QString::fromUtf8(sqlite3_errmsg(handle));
+			return false;
+		}
+		if (!stmt) { break; } // only a comment or white space left
+
+		// A query without side effects is read completely here: its
+		// result shows the data as the script had it, and no statement
+		// stays open to lock the tables for the statements after it.
+		if ((sqlite3_column_count(stmt) > 0) && sqlite3_stmt_readonly(stmt))
+		{
+			QString query(QString::fromUtf8(sqlite3_sql(stmt)));
+			sqlite3_finalize(stmt);
+			SqlQueryModel * model = new SqlQueryModel(creator);
+			model->setQuery(query, QSqlDatabase::database(SESSION_NAME));
+			if (model->lastError().isValid())
+			{
+				*error = model->lastError().text();
+				SqlQueryModel::detach(model);
+				return false;
+			}
+			model->fetchAll();
+			results->append(model);
+			continue;
+		}
+		int rc;
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+			; // e.g. a pragma which sets and shows its value
+		if (rc != SQLITE_DONE)
+		{
+			*error = QString::fromUtf8(sqlite3_errmsg(handle));
+			sqlite3_finalize(stmt);
+			return false;
+		}
+		sqlite3_finalize(stmt);
+	}
+	return true;
+}
+
 void SqlEditor::actionCreateView_triggered()
 {
 	emit showSqlScriptResult("");
@@ -451,19 +552,86 @@ bool SqlEditor::setProgress(int p)
 }
 
 void SqlEditor::appendHistory(const QString & sql)
+{
+	// LiteManWindow::execSql() has recorded the profile if it succeeded
+	QueryProfile p(QueryHistory::instance()->last());
+	if (p.sql != sql)
+	{
+		p.sql = sql;
+		p.runAt = QDateTime::currentDateTime();
+		p.durationMs = -1;
+		p.rows = -1;
+		p.fullScans = -1;
+		p.slower = false;
+		p.planChanged = false;
+	}
+	addHistoryItem(p);
+    if (ui.historyTreeWidget->topLevelItemCount() > 30)
+        delete ui.historyTreeWidget->takeTopLevelItem(0);
+
+	if (p.slower)
+	{
+		setStatusMessage(tr("Slower than usual: %1 ms, previous median %2 ms")
+						 .arg(p.durationMs).arg(p.previousMedian));
+	}
+	else if (p.planChanged)
+	{
+		setStatusMessage(tr("The query plan has changed since the last run"));
+	}
+}
+
+void SqlEditor::addHistoryItem(const QueryProfile & profile)
 {
     QStringList l;
-    l << sql << QDateTime::currentDateTime().toString();
+    l << profile.sql << profile.runAt.toString();
+	if (profile.durationMs >= 0)
+	{
+		l << QString::number(profile.durationMs)
+		  << QString::number(profile.rows)
+		  << QString::number(profile.fullScans);
+	}
     QTreeWidgetItem * item = new QTreeWidgetItem(ui.historyTreeWidget, l);
+	item->setTextAlignment(2, Qt::AlignRight);
+	item->setTextAlignment(3, Qt::AlignRight);
+	item->setTextAlignment(4, Qt::AlignRight);
+	QColor warn(255, 210, 210);
+	if (profile.slower)
+	{
+		item->setBackground(2, warn);
+		item->setToolTip(2, profile.previousMedian >= 0
+			? tr("Slower than the median of the previous runs (%1 ms)")
+			  .arg(profile.previousMedian)
+			: tr("Slower than the median of the previous runs"));
+	}
+	if (profile.planChanged)
+	{
+		item->setBackground(4, warn);
+		item->setToolTip(4, tr("The query plan changed since the previous run"));
+	}
     ui.historyTreeWidget->addTopLevelItem(item);
-    if (ui.historyTreeWidget->topLevelItemCount() > 30)
-        delete ui.historyTreeWidget->takeTopLevelItem(0);
+}
+
+void SqlEditor::loadHistory()
+{
+	ui.historyTreeWidget->clear();
+	QList<QueryProfile> list(QueryHistory::instance()->recent(
+		30, ui.historyFilterEdit->text()));
+	// newest first from the database, newest last in the list
+	for (int i = list.count() - 1; i >= 0; --i)
+	{
+		addHistoryItem(list.at(i));
+	}
+}
+
+void SqlEditor::historyFilterEdit_textChanged(const QString &)
+{
+	loadHistory();
 }
 
 void SqlEditor::actionShow_History_triggered()
 {
 	emit showSqlScriptResult("");
-	ui.historyTreeWidget->setVisible(ui.actionShow_History->isChecked());
+	ui.historyWidget->setVisible(ui.actionShow_History->isChecked());
 }
 
 void SqlEditor::action_Save_triggered()
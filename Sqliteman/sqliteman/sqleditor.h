@@ -12,12 +12,15 @@ for which a new license (GPL+exception) is in place.
 #include <QFileSystemWatcher>
 
 #include "litemanwindow.h"
+#include "queryhistory.h"
+#include "statementindex.h"
 #include "ui_sqleditor.h"
 #include "sqlparser/tosqlparse.h"
 
 class QTextDocument;
 class QLabel;
 class QProgressDialog;
+class QueryPlanDialog;
 
 
 /*!
@@ -52,6 +55,9 @@ class SqlEditor : public QMainWindow
 		/*! \brief Emitted on demand in the script.
 		Line is appended to the script output. */
 		void showSqlScriptResult(QString line);
+		/*! \brief Emitted for a script statement which returns rows.
+		The model has read all of them when the statement ran. */
+		void scriptResult(SqlQueryModel * model);
 
 		/*! \brief Request for complete object tree refresh.
 		It's used in "Run as Script" */
@@ -81,6 +87,10 @@ class SqlEditor : public QMainWindow
 
 
         void appendHistory(const QString & sql);
+		//! \brief Add a history row, flagging regressions.
+		void addHistoryItem(const QueryProfile & profile);
+		//! \brief Refill the history list from the history database.
+		void loadHistory();
 
 		void showEvent(QShowEvent * event);
 		bool changedConfirm();
@@ -93,6 +103,14 @@ class SqlEditor : public QMainWindow
 		QString query();
 		//! \brief From TOra
 		QString prepareExec(toSQLParse::tokenizer &tokens, int line, int pos);
+		/*! \brief Run a statement of Run as Script with sqlite3_step().
+		Only a query without side effects gets a model, which reads all
+		its rows at once and is appended to results.
+		\retval bool false on error, with error set
+		*/
+		bool runScriptStatement(const QString & sql,
+								QList<SqlQueryModel*> * results,
+								QString * error);
 
 		void find(QString ttf, bool forward/*, bool backward*/);
 
@@ -103,9 +121,16 @@ class SqlEditor : public QMainWindow
 		// qobject_cast<LiteManWindow*>(parent()) doesn't work
 		LiteManWindow * creator;
 
+		//! \brief Non-modal plan viewer. Created on first explain.
+		QueryPlanDialog * m_planDialog;
+		//! \brief Where the statements in the editor start and end.
+		StatementIndex * m_statements;
+
 	private slots:
 		void action_Run_SQL_triggered();
 		void actionRun_Explain_triggered();
+		void actionAdvise_Indexes_triggered();
+		void actionBenchmark_triggered();
 		void actionRun_as_Script_triggered();
 		void action_Open_triggered();
 		void action_Save_triggered();
@@ -122,6 +147,7 @@ class SqlEditor : public QMainWindow
 		void findNext();
 
         void actionShow_History_triggered();
+		void historyFilterEdit_textChanged(const QString & text);
 		//! \brief Watch file for changes from external apps
 		void externalFileChange(const QString & path);
 		//
@@ -12,12 +12,12 @@ for which a new license (GPL+exception) is in place.
 #include <QStringListModel>
 
 #include <qscilexersql.h>
-#include <qsciapis.h>
 #include <qsciabstractapis.h>
 #include <qscilexer.h>
 
 #include "sqleditorwidget.h"
 #include "preferences.h"
+#include "schemaapis.h"
 // #include "sqlkeywords.h"
 #include "utils.h"
 
@@ -35,15 +35,9 @@ SqlEditorWidget::SqlEditorWidget(QWidget * parent)
 
 	QsciLexerSQL * lexer = new QsciLexerSQL(this);
 
-	QsciAPIs * api = new QsciAPIs(lexer);
-	if (!api->load(":/api/sqlite.api"))
-		qDebug("api is not loaded");
-	else
-	{
-		api->prepare();
-        lexer->setAPIs(api);
-	}
-	setAutoCompletionSource(QsciScintilla::AcsAll);
+	// sets itself as the lexer's APIs
+	new SchemaAPIs(lexer);
+	setAutoCompletionSource(QsciScintilla::AcsAPIs);
 	setAutoCompletionCaseSensitivity(false);
 	setAutoCompletionReplaceWord(true);
 
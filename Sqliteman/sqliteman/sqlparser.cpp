@@ -18,385 +18,244 @@ sqlite_master and describe table leave any quotes around types, but pragma table
 #include "utils.h"
 #include "sqlparser.h"
 
-// state machine tokeniser
-QList<Token> SqlParser::tokenise(QString input)
+// true if c can continue an identifier
+static bool isIdentifierChar(QChar c)
 {
-	static const QString hexDigit("0123456789ABCDEFabcdef");
-	QList<Token> result = QList<Token>();
-	while (!input.isEmpty())
+	return c.isLetterOrNumber() || (c == '_') || (c == '$');
+}
+
+static bool isHexDigit(QChar c)
+{
+	ushort u = c.unicode();
+	return    ((u >= '0') && (u <= '9'))
+		   || ((u >= 'A') && (u <= 'F'))
+		   || ((u >= 'a') && (u <= 'f'));
+}
+
+// end of a token quoted by q starting at i, a doubled q is part of it
+static int quotedEnd(const QChar * data, int i, int n, QChar q)
+{
+	for (++i; i < n; ++i)
 	{
-		Token t;
+		if (data[i] == q)
+		{
+			if ((i + 1 < n) && (data[i + 1] == q)) { ++i; } // doubled
+			else { return i + 1; }
+		}
+	}
+	return n; // unterminated
+}
+
+static bool containsName(const QStringList & list, const QStringRef & s)
+{
+	for (int i = 0; i < list.count(); ++i)
+	{
+		if (s.compare(list.at(i), Qt::CaseInsensitive) == 0) { return true; }
+	}
+	return false;
+}
+
+// Index based tokeniser. It walks the input once without copying it
+// and only records where each token is, so it is linear in the length
+// of the statement. The names are made by tokenName().
+QVector<TokenSpan> SqlParser::scan(const QString & input)
+{
+	QVector<TokenSpan> result;
+	const QChar * data = input.unicode();
+	const int n = input.length();
+	int i = 0;
+	while (i < n)
+	{
+		QChar c = data[i];
+		if (c.isSpace() || (c == 0)) { ++i; continue; } // ignore it
+		TokenSpan t;
+		t.offset = i;
 		t.type = tokenNone;
-		int state = 0; // nothing
-		while (1)
+		int j = i + 1;
+		if ((c == '0') && (j < n) && (data[j].toUpper() == 'X'))
 		{
-			QChar c = input.isEmpty() ? 0 : input.at(0);
-			switch (state)
+			// hex literal
+			for (++j; (j < n) && isHexDigit(data[j]); ++j) {}
+			t.type = tokenNumeric;
+		}
+		else if (c.isDigit() || (c == '.'))
+		{
+			bool hadDot = (c == '.');
+			if (hadDot && !((j < n) && data[j].isDigit()))
 			{
-				case 0: // nothing
-					if (c.isSpace())
-					{
-						input.remove(0, 1);
-						continue;
-					} // ignore it
-					else if (c == '0')
-					{
-						state = 1; // had initial 0
-					}
-					else if (c.isDigit())
-					{
-						state = 3; // in number, no . or E yet
-					}
-					else if (c == '.')
-					{
-						state = 2; // had initial .
-					}
-					else if (c.toUpper() == 'X')
-					{
-						state = 8; // blob literal or identifier
-					}
-					else if (c.isLetter() || (c == '_'))
-					{
-						state = 10; // identifier
-					}
-					else if (c == '"')
-					{
-						t.name = QString(""); // empty, not null
-						state = 11; // "quoted identifier"
-						input.remove(0, 1);
-						continue;
-					}
-					else if (c == '\'')
-					{
-						t.name = QString(""); // empty, not null
-						state = 13; // 'string literal'
-						input.remove(0, 1);
-						continue;
-					}
-					else if (c == '|')
-					{
-						state = 15; // check for ||
-					}
-					else if (c == '<')
-					{
-						state = 16; // check for << <> <=
-					}
-					else if (c == '>')
-					{
-						state = 17; // check for >> >=
-					}
-					else if (c == '=')
-					{
-						state = 18; // check for ==
-					}
-					else if (c == '!')
-					{
-						state = 19; // !=
-					}
-					else if (c == '[')
-					{
-						t.name = QString(""); // empty, not null
-						state = 20; // [quoted identifier]
-						input.remove(0, 1);
-						continue;
-					}
-					else if (c == '`')
-					{
-						t.name = QString(""); // empty, not null
-						state = 21; // `quoted identifier`
-						input.remove(0, 1);
-						continue;
-					}
-					else if (c == 0) { break; }
-					else
-					{
-						// single character token
-						t.name.append(c);
-						if (   (c == '*')
-							|| (c == '/')
-							|| (c == '%')
-							|| (c == '+')
-							|| (c == '-')
-							|| (c == '&')
-							|| (c == '~'))
-						{ t.type = tokenOperator; }
-						else { t.type = tokenSingle; }
-						input.remove(0, 1);
-						break;
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 1: // had initial 0
-					if (c.isDigit())
-					{
-						state = 3; // in number, no . or E yet
-					}
-					else if (c.toUpper() == 'X')
-					{
-						state = 7; // in hex literal
-					}
-					else if (c == '.')
-					{
-						state = 4; // in number, had .
-					}
-					else if (c.toUpper() == 'E')
-					{
-						state = 5; // in number, just had E
-					}
-					else { // token is just 0
-						t.type = tokenNumeric;
-						break;
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 2: // had initial .
-					if (c.isDigit())
-					{
-						state = 4; // in number, had .
-					}
-					else { // token is just .
-						t.type = tokenSingle;
-						break;
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 3: // in number, no . or E yet
-					if (c == '.')
-					{
-						state = 4; // in number, had .
-					}
-					else if (c.toUpper() == 'E')
-					{
-						state = 5; // in number, just had E
-					}
-					else if (!c.isDigit())
-					{
-						t.type = tokenNumeric;
-						break; // end of number
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 4: // in number, had .
-					if (c.toUpper() == 'E')
-					{
-						state = 5; // in number, just had E
-					}
-					else if (!c.isDigit())
-					{
-						t.type = tokenNumeric;
-						break; // end of number
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 5: // in number, just had E
-					if (c.isDigit() || (c == '-') || (c == '+'))
-					{
-						state = 6; // in number after E
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					break; // actually invalid, but end number
-				case 6: // in number after E
-					if (c.isDigit())
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					t.type = tokenNumeric;
-					break; // end number
-				case 7: // in hex literal
-					if (hexDigit.contains(c))
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					t.type = tokenNumeric;
-					break; // end (hex) number
-				case 8: // blob literal or identifier
-					if (c == '\'')
-					{
-						state = 9; // blob literal
-					}
-					else if (c.isLetterOrNumber() || (c == '_') || (c == '$'))
-					{
-						state = 10; // identifier
-					}
-					else { // identifier just X
-						t.type = tokenIdentifier;
-						break;
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 9: // blob literal
-					if (c == '\'')
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-						t.type = tokenBlobLiteral;
-						break; // end of blob literal
-					}
-					else if (hexDigit.contains(c))
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					else { // invalid end of blob literal
-						t.type = tokenBlobLiteral;
-						break;
-					}
-				case 10: // identifier
-					if (c.isLetterOrNumber() || (c == '_') || (c == '$'))
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					else { // end of identifier
-						if (operators.contains(t.name, Qt::CaseInsensitive))
-						{ t.type = tokenOperator; }
-						else if (posts.contains(t.name, Qt::CaseInsensitive))
-						{ t.type = tokenPostfix; }
-						else
-						{ t.type = tokenIdentifier; }
-						break;
-					}
-				case 11: // "quoted identifier"
-					if (c == '"')
-					{
-						state = 12; // look for doubled "
-					}
-					else
-					{
-						t.name.append(c);
-					}
-					input.remove(0, 1);
-					continue;
-				case 12: // look for doubled "
-					if (c == '"')
-					{
-						state = 11; // quoted identifier
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					else { // end of quoted identifier
-						t.type = tokenQuotedIdentifier;
-						break;
-					}
-				case 13: // 'string literal'
-					if (c == '\'')
-					{
-						state = 14; // look for doubled '
-					}
-					else
-					{
-						t.name.append(c);
-					}
-					input.remove(0, 1);
-					continue;
-				case 14: // look for doubled '
-					if (c == '\'')
-					{
-						state = 13; // string literal
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
-					}
-					else { // end of string literal
-						t.type = tokenStringLiteral;
-						break;
-					}
-				case 15: // check for ||
-					if (c == '|')
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-					}
-					t.type = tokenOperator;
-					break;
-				case 16: // check for << <> <=
-					if ((c == '<') || (c == '>') || (c == '='))
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-					}
-					t.type = tokenOperator;
-					break;
-				case 17: // check for >> >=
-					if ((c == '>') || (c == '='))
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-					}
-					t.type = tokenOperator;
-					break;
-				case 18: // check for ==
-					if (c == '=')
-					{
-						t.name.append(c);
-						input.remove(0, 1);
-					}
-					t.type = tokenOperator;
-					break;
-				case 19: // !=
-					// ! without = is invalid, but we treat it as a token
-					t.name.append(c);
-					input.remove(0, 1);
-					t.type = tokenSingle;
-					break;
-				case 20: // [quoted identifier]
-					if (c == ']')
-					{
-						t.type = tokenSquareIdentifier;
-						input.remove(0, 1);
-						break;
-					}
-					t.name.append(c);
-					input.remove(0, 1);
-					continue;
-				case 21: // `quoted identifier`
-					if (c == '`')
-					{
-						state = 22; // look for doubled `
-					}
-					else
+				t.type = tokenSingle; // token is just .
+			}
+			else
+			{
+				t.type = tokenNumeric;
+				for (; j < n; ++j)
+				{
+					if (data[j] == '.')
 					{
-						t.name.append(c);
+						if (hadDot) { break; }
+						hadDot = true;
 					}
-					input.remove(0, 1);
-					continue;
-				case 22:
-					if (c == '`')
+					else if (!data[j].isDigit()) { break; }
+				}
+				if ((j < n) && (data[j].toUpper() == 'E'))
+				{
+					++j;
+					if (   (j < n)
+						&& (   data[j].isDigit()
+							|| (data[j] == '-') || (data[j] == '+')))
 					{
-						state = 21; // `quoted identifier`
-						t.name.append(c);
-						input.remove(0, 1);
-						continue;
+						for (++j; (j < n) && data[j].isDigit(); ++j) {}
 					}
 					else
 					{
-						t.type = tokenBackQuotedIdentifier;
-						break;
+						// invalid, the number is dropped
+						t.type = tokenNone;
 					}
+				}
 			}
-			// if we didn't continue, we're at the end of the token
-			break;
 		}
+		else if ((c.toUpper() == 'X') && (j < n) && (data[j] == '\''))
+		{
+			// blob literal
+			for (++j; (j < n) && isHexDigit(data[j]); ++j) {}
+			if ((j < n) && (data[j] == '\'')) { ++j; }
+			t.type = tokenBlobLiteral;
+		}
+		else if (c.isLetter() || (c == '_'))
+		{
+			for (; (j < n) && isIdentifierChar(data[j]); ++j) {}
+			QStringRef name(&input, i, j - i);
+			if (containsName(operators, name))
+			{ t.type = tokenOperator; }
+			else if (containsName(posts, name))
+			{ t.type = tokenPostfix; }
+			else
+			{ t.type = tokenIdentifier; }
+		}
+		else if (c == '"')
+		{
+			j = quotedEnd(data, i, n, c);
+			t.type = tokenQuotedIdentifier;
+		}
+		else if (c == '\'')
+		{
+			j = quotedEnd(data, i, n, c);
+			t.type = tokenStringLiteral;
+		}
+		else if (c == '`')
+		{
+			j = quotedEnd(data, i, n, c);
+			t.type = tokenBackQuotedIdentifier;
+		}
+		else if (c == '[')
+		{
+			for (; (j < n) && (data[j] != ']'); ++j) {}
+			if (j < n) { ++j; }
+			t.type = tokenSquareIdentifier;
+		}
+		else if (c == '|')
+		{
+			// check for ||
+			if ((j < n) && (data[j] == '|')) { ++j; }
+			t.type = tokenOperator;
+		}
+		else if (c == '<')
+		{
+			// check for << <> <=
+			if (   (j < n)
+				&& ((data[j] == '<') || (data[j] == '>') || (data[j] == '=')))
+			{ ++j; }
+			t.type = tokenOperator;
+		}
+		else if (c == '>')
+		{
+			// check for >> >=
+			if ((j < n) && ((data[j] == '>') || (data[j] == '='))) { ++j; }
+			t.type = tokenOperator;
+		}
+		else if (c == '=')
+		{
+			// check for ==
+			if ((j < n) && (data[j] == '=')) { ++j; }
+			t.type = tokenOperator;
+		}
+		else if (c == '!')
+		{
+			// ! without = is invalid, but we treat it as a token
+			if (j < n) { ++j; }
+			t.type = tokenSingle;
+		}
+		else
+		{
+			// single character token
+			if (   (c == '*')
+				|| (c == '/')
+				|| (c == '%')
+				|| (c == '+')
+				|| (c == '-')
+				|| (c == '&')
+				|| (c == '~'))
+			{ t.type = tokenOperator; }
+			else { t.type = tokenSingle; }
+		}
+		t.length = j - i;
+		i = j;
 		if (t.type != tokenNone) { result.append(t); }
 	}
 	return result;
 }
 
+QString SqlParser::tokenName(const QString & input, const TokenSpan & span)
+{
+	const QChar * data = input.unicode() + span.offset;
+	switch (span.type)
+	{
+		case tokenQuotedIdentifier:
+		case tokenStringLiteral:
+		case tokenBackQuotedIdentifier:
+		{
+			// strip the quotes and undouble the ones inside
+			QChar q = data[0];
+			QString name(""); // empty, not null
+			name.reserve(span.length);
+			for (int i = 1; i < span.length; ++i)
+			{
+				if (data[i] == q)
+				{
+					if ((i + 1 < span.length) && (data[i + 1] == q)) { ++i; }
+					else { break; }
+				}
+				name.append(data[i]);
+			}
+			return name;
+		}
+		case tokenSquareIdentifier:
+		{
+			int length = span.length - 1;
+			if ((length > 0) && (data[length] == ']')) { --length; }
+			return QString(data + 1, length);
+		}
+		default:
+			return QString(data, span.length);
+	}
+}
+
+QList<Token> SqlParser::tokenise(const QString & input)
+{
+	QVector<TokenSpan> spans(scan(input));
+	QList<Token> result;
+	result.reserve(spans.count());
+	for (int i = 0; i < spans.count(); ++i)
+	{
+		Token t;
+		t.name = tokenName(input, spans.at(i));
+		t.type = spans.at(i).type;
+		t.isColName = false;
+		result.append(t);
+	}
+	return result;
+}
+
 void SqlParser::clearField(FieldInfo &f)
 {
 	f.name = QString();
@@ -13,6 +13,8 @@ schema is known to be valid, we do not always detect bad syntax.
 #ifndef SQLPARSER_H
 #define SQLPARSER_H
 
+#include <QVector>
+
 enum tokenType {
 	tokenNone,
 	tokenIdentifier,
@@ -49,6 +51,14 @@ typedef struct
 	bool isColName;
 } Token;
 
+// where a token is in the input, see SqlParser::scan()
+typedef struct
+{
+	int offset;
+	int length; // including any quotes
+	enum tokenType type;
+} TokenSpan;
+
 typedef struct Expression {
 	enum exprType type;
 	struct Expression * left;
@@ -88,7 +98,9 @@ class SqlParser
 		QStringList operators;
 		QStringList posts;
 		int m_depth;
-		QList<Token> tokenise(QString input);
+		// all tokens with their names, made from scan(); the parser
+		// works on names, so this copies every token's text
+		QList<Token> tokenise(const QString & input);
 		void clearField(FieldInfo &f);
 		void addToPrimaryKey(QString s);
 		void addToPrimaryKey(FieldInfo &f);
@@ -102,6 +114,12 @@ class SqlParser
 	public:
 		SqlParser(QString input);
 		~SqlParser();
+		// tokens of input in one pass; spans only, no text is copied,
+		// so callers which need a few names (e.g. SchemaAPIs) save the
+		// copies; SqlParser's own parsing still copies them all
+		QVector<TokenSpan> scan(const QString & input);
+		// name of a token as the parser sees it, without quotes
+		static QString tokenName(const QString & input, const TokenSpan & span);
 		static QString defaultToken(FieldInfo &f);
 		bool replace(QMap<QString,QString> map, QString newTableName);
 		static QString toString(Token t);
@@ -0,0 +1,132 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QtAlgorithms>
+
+#include "sqleditorwidget.h"
+#include "statementindex.h"
+#include "sqlparser/tosqlparse.h"
+
+
+static bool lessThan(const StatementPosition & a, const StatementPosition & b)
+{
+	return (a.line < b.line) || ((a.line == b.line) && (a.offset < b.offset));
+}
+
+static bool isEqual(const StatementPosition & a, const StatementPosition & b)
+{
+	return (a.line == b.line) && (a.offset == b.offset);
+}
+
+
+StatementIndex::StatementIndex(SqlEditorWidget * editor)
+	: QObject(editor),
+	  m_editor(editor)
+{
+	StatementPosition start = { 0, 0 };
+	m_bounds.append(start);
+	connect(m_editor,
+			SIGNAL(SCN_MODIFIED(int, int, const char *, int, int, int, int,
+								int, int, int)),
+			this, SLOT(modified(int, int, const char *, int, int)));
+}
+
+void StatementIndex::modified(int position, int type, const char * /*text*/,
+							  int /*length*/, int linesAdded)
+{
+	if (!(type & (QsciScintillaBase::SC_MOD_INSERTTEXT
+				  | QsciScintillaBase::SC_MOD_DELETETEXT)))
+	{
+		return;
+	}
+
+	// Lines first .. last (before the edit) are damaged. Boundaries
+	// above them stay, the ones below move by linesAdded.
+	int first = m_editor->SendScintilla(
+		QsciScintillaBase::SCI_LINEFROMPOSITION, position);
+	int last = first + (linesAdded < 0 ? -linesAdded : 0);
+
+	QList<StatementPosition> shifted;
+	int keep = m_bounds.count();
+	while ((keep > 0) && (m_bounds.at(keep - 1).line >= first))
+	{
+		StatementPosition p = m_bounds.at(--keep);
+		if (p.line > last)
+		{
+			p.line += linesAdded;
+			shifted.prepend(p);
+		}
+	}
+	m_bounds.resize(keep);
+	if (m_bounds.isEmpty())
+	{
+		StatementPosition start = { 0, 0 };
+		m_bounds.append(start);
+	}
+
+	QList<StatementPosition>::iterator it = m_pending.begin();
+	while (it != m_pending.end())
+	{
+		if (it->line > last)
+		{
+			it->line += linesAdded;
+			++it;
+		}
+		else if (it->line >= first) { it = m_pending.erase(it); }
+		else { ++it; }
+	}
+	m_pending = shifted + m_pending;
+}
+
+bool StatementIndex::parseNext()
+{
+	StatementPosition start = m_bounds.last();
+	int lines = m_editor->lines();
+	if (start.line >= lines) { return false; }
+
+	toSQLParse::editorTokenizer tokens(m_editor, start.offset, start.line);
+	toSQLParse::parseStatement(tokens);
+	StatementPosition p = { tokens.line(), tokens.offset() };
+	if ((p.line >= lines) || !lessThan(start, p))
+	{
+		// the end of the text, always stored the same way
+		p.line = lines;
+		p.offset = 0;
+	}
+	m_bounds.append(p);
+
+	// back in step with the boundaries from before the edit?
+	while (!m_pending.isEmpty() && lessThan(m_pending.first(), p))
+		m_pending.removeFirst();
+	if (!m_pending.isEmpty() && isEqual(m_pending.first(), p))
+	{
+		m_pending.removeFirst();
+		while (!m_pending.isEmpty())
+			m_bounds.append(m_pending.takeFirst());
+	}
+	return true;
+}
+
+int StatementIndex::find(int line, int offset)
+{
+	StatementPosition p = { line, offset };
+	while (lessThan(m_bounds.last(), p) && parseNext()) {}
+	if (m_bounds.count() < 2) { parseNext(); }
+
+	// first statement whose end is not before p
+	QVector<StatementPosition>::const_iterator it =
+		qLowerBound(m_bounds.constBegin() + 1, m_bounds.constEnd(), p,
+					lessThan);
+	if (it == m_bounds.constEnd()) { --it; }
+	return (it - m_bounds.constBegin()) - 1;
+}
+
+int StatementIndex::count()
+{
+	while (parseNext()) {}
+	return m_bounds.count() - 1;
+}
@@ -0,0 +1,69 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef STATEMENTINDEX_H
+#define STATEMENTINDEX_H
+
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+class SqlEditorWidget;
+
+
+//! \brief A position in the editor as toSQLParse::tokenizer counts it.
+typedef struct
+{
+	int line;
+	int offset;
+}
+StatementPosition;
+
+
+/*! \brief Statement boundaries of an SqlEditorWidget.
+The boundaries are the tokenizer positions between the statements, as
+toSQLParse::parseStatement() finds them from the start of the text.
+They are found lazily, only as far as somebody asks for.
+An edit (SCN_MODIFIED) drops the boundaries from the edited line on.
+The ones after the edited text are kept aside, shifted by the lines
+added or removed: when lexing from the last good boundary reaches one
+of them again, the rest is known to be still valid. So only the
+damaged statements are parsed again, and finding the statement at the
+cursor is a binary search.
+*/
+class StatementIndex : public QObject
+{
+		Q_OBJECT
+
+	public:
+		StatementIndex(SqlEditorWidget * editor);
+
+		/*! \brief The statement which ends at or after the position.
+		It is the statement SqlEditor::query() runs for a cursor there.
+		*/
+		int find(int line, int offset);
+		//! \brief Number of statements. It parses the whole text.
+		int count();
+		StatementPosition start(int i) { return m_bounds.at(i); }
+		StatementPosition end(int i) { return m_bounds.at(i + 1); }
+
+	private:
+		SqlEditorWidget * m_editor;
+		//! \brief valid boundaries, from the start of the text
+		QVector<StatementPosition> m_bounds;
+		//! \brief old boundaries after an edit, valid if reached again
+		QList<StatementPosition> m_pending;
+
+		//! \brief Parse one more statement. False at the end of the text.
+		bool parseNext();
+
+	private slots:
+		void modified(int position, int type, const char * text,
+					  int length, int linesAdded);
+};
+
+#endif
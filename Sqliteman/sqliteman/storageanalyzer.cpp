@@ -0,0 +1,167 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QHash>
+
+#include "database.h"
+#include "storageanalyzer.h"
+#include "utils.h"
+
+
+StorageAnalyzer::StorageAnalyzer(sqlite3 * handle, const QString & schema,
+								 QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_schema(schema),
+	  m_pageCount(0),
+	  m_freePages(0),
+	  m_pageSize(0)
+{
+	useOwnConnection(schema, false);
+}
+
+double StorageAnalyzer::fanout(const Object & object)
+{
+	qint64 pages = object.pages[Internal];
+	// an internal page has a child per cell and the right-most one
+	return (pages > 0) ? (double)(object.cells[Internal] + pages) / pages
+					   : 0.0;
+}
+
+double StorageAnalyzer::fragmentation(const Object & object)
+{
+	qint64 pages = object.pages[Internal] + object.pages[Leaf]
+				   + object.pages[Overflow];
+	return (pages > 1) ? (double)object.jumps / (pages - 1) : 0.0;
+}
+
+qint64 StorageAnalyzer::entries(const Object & object)
+{
+	// the internal cells of a rowid table only hold keys to find the
+	// leaves, those of an index are entries too (as are those of a
+	// WITHOUT ROWID table, which is undercounted here)
+	if (object.type == "index")
+		return object.cells[Internal] + object.cells[Leaf];
+	return object.cells[Leaf];
+}
+
+void StorageAnalyzer::readTypes()
+{
+	QHash<QString,int> byName;
+	for (int i = 0; i < m_objects.count(); ++i)
+		byName.insert(m_objects.at(i).name, i);
+
+	QByteArray sql(QString("SELECT name, type, tbl_name FROM %1;")
+				   .arg(Database::getMaster(m_schema)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0)
+		== SQLITE_OK)
+	{
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			QString name(QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 0)));
+			if (!byName.contains(name)) { continue; }
+			Object & object = m_objects[byName.value(name)];
+			object.type = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 1));
+			object.table = QString::fromUtf8(
+				(const char *)sqlite3_column_text(stmt, 2));
+		}
+	}
+	sqlite3_finalize(stmt);
+	// the schema table is not listed in itself
+	for (int i = 0; i < m_objects.count(); ++i)
+	{
+		if (m_objects.at(i).type.isEmpty())
+		{
+			m_objects[i].type = "table";
+			m_objects[i].table = m_objects.at(i).name;
+		}
+	}
+}
+
+void StorageAnalyzer::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	m_pageCount = pragma(m_schema, "page_count");
+	m_freePages = pragma(m_schema, "freelist_count");
+	m_pageSize = pragma(m_schema, "page_size");
+
+	QByteArray sql(QString("SELECT name, pageno, pagetype, ncell, payload, "
+						   "unused, pgsize FROM dbstat(%1);")
+				   .arg(Utils::q(m_schema, "'")).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0)
+		!= SQLITE_OK)
+	{
+		m_error = tr("The sqlite library has no dbstat table (%1)")
+				  .arg(QString::fromUtf8(sqlite3_errmsg(m_handle)));
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	QHash<QString,int> byName;
+	qint64 visited = 0;
+	int rc = SQLITE_DONE;
+	while (!isCancelled() && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+	{
+		QString name(QString::fromUtf8(
+			(const char *)sqlite3_column_text(stmt, 0)));
+		int i = byName.value(name, -1);
+		if (i < 0)
+		{
+			Object o;
+			o.name = name;
+			o.pages[Internal] = o.pages[Leaf] = o.pages[Overflow] = 0;
+			o.bytes = o.payload = o.unused = 0;
+			o.cells[Internal] = o.cells[Leaf] = 0;
+			o.jumps = 0;
+			o.lastPage = -1;
+			i = m_objects.count();
+			m_objects.append(o);
+			byName.insert(name, i);
+		}
+		Object & object = m_objects[i];
+
+		qint64 page = sqlite3_column_int64(stmt, 1);
+		if ((object.lastPage >= 0) && (page != object.lastPage + 1))
+			++object.jumps;
+		object.lastPage = page;
+
+		QByteArray type((const char *)sqlite3_column_text(stmt, 2));
+		qint64 cells = sqlite3_column_int64(stmt, 3);
+		if (type == "internal")
+		{
+			++object.pages[Internal];
+			object.cells[Internal] += cells;
+		}
+		else if (type == "leaf")
+		{
+			++object.pages[Leaf];
+			object.cells[Leaf] += cells;
+		}
+		else
+			++object.pages[Overflow];
+		object.payload += sqlite3_column_int64(stmt, 4);
+		object.unused += sqlite3_column_int64(stmt, 5);
+		object.bytes += sqlite3_column_int64(stmt, 6);
+
+		reportProgress(++visited, m_pageCount);
+	}
+	if (isCancelled())
+		m_error = tr("Cancelled");
+	else if (rc != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+
+	if (m_error.isEmpty())
+		readTypes();
+}
@@ -0,0 +1,84 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef STORAGEANALYZER_H
+#define STORAGEANALYZER_H
+
+#include <QList>
+
+#include "databaseworker.h"
+
+
+/*! \brief Space used by each table and index, read from dbstat.
+It walks the dbstat virtual table of a schema once, on the worker
+thread, and sums its rows up per b-tree. It reads on a connection of
+its own where it can (DatabaseWorker::useOwnConnection()). dbstat lists the pages of a
+b-tree in the order they are reached from its root, so a page which
+does not follow the previous one in the file is a jump for a scan;
+their share of the pages is the fragmentation.
+dbstat exists only when sqlite is built with SQLITE_ENABLE_DBSTAT_VTAB.
+*/
+class StorageAnalyzer : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		typedef enum
+		{
+			Internal,
+			Leaf,
+			Overflow
+		} PageType;
+
+		typedef struct
+		{
+			QString name;
+			//! \brief "table" or "index", the table of an index in table
+			QString type;
+			QString table;
+			qint64 pages[3]; // by PageType
+			qint64 bytes;
+			qint64 payload;
+			qint64 unused;
+			//! \brief cells of the internal and of the leaf pages
+			qint64 cells[2];
+			//! \brief pages not following the previous one in the file
+			qint64 jumps;
+			qint64 lastPage;
+		} Object;
+
+		StorageAnalyzer(sqlite3 * handle, const QString & schema,
+						QObject * parent = 0);
+
+		//! \brief The b-trees in the order dbstat returned them.
+		const QList<Object> & objects() { return m_objects; }
+		qint64 pageCount() { return m_pageCount; }
+		qint64 freePages() { return m_freePages; }
+		qint64 pageSize() { return m_pageSize; }
+
+		//! \brief Average children of an internal page, 0 without any.
+		static double fanout(const Object & object);
+		//! \brief Share of the pages which are out of order, 0 to 1.
+		static double fragmentation(const Object & object);
+		//! \brief Entries of the b-tree: rows of a table, keys of an index.
+		static qint64 entries(const Object & object);
+
+	protected:
+		void run();
+
+	private:
+		QString m_schema;
+		QList<Object> m_objects;
+		qint64 m_pageCount;
+		qint64 m_freePages;
+		qint64 m_pageSize;
+
+		//! \brief Types and tables of the objects from sqlite_master.
+		void readTypes();
+};
+
+#endif
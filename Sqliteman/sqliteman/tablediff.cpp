@@ -0,0 +1,307 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <math.h>
+
+#include <QSet>
+
+#include "database.h"
+#include "rowhash.h"
+#include "tablediff.h"
+#include "utils.h"
+
+// rows of a range hashed as one, as far as the row estimate is right
+#define CHUNK_ROWS 1000
+// highest number of slices hashed in parallel on each side
+#define MAX_SLICES 4
+
+
+TableDiff::TableDiff(const QString & table, const QString & source,
+					 const QString & target, QObject * parent)
+	: DatabaseWorker(Database::sqlite3handle(), parent),
+	  m_table(table),
+	  m_source(source),
+	  m_target(target),
+	  m_rows(-1),
+	  m_hashed(0),
+	  m_rangeCount(0),
+	  m_differing(0)
+{
+	useOwnConnection(source, false);
+	useOwnConnection(target, false);
+	if (ownsConnection())
+	{
+		// m_handle is the source side of the first slice
+		int slices = qBound(1, QThread::idealThreadCount() / 2, MAX_SLICES);
+		m_connections.append(m_handle);
+		for (int i = 1; i < 2 * slices; ++i)
+		{
+			QString error;
+			sqlite3 * handle = Database::openConnection(true, &error);
+			if (!handle)
+				break;
+			m_connections.append(handle);
+		}
+		// the slices go in pairs, one connection for each side; m_handle
+		// alone hashes both
+		if (m_connections.count() % 2)
+		{
+			sqlite3 * handle = m_connections.takeLast();
+			if (handle != m_handle)
+				sqlite3_close(handle);
+		}
+	}
+}
+
+TableDiff::~TableDiff()
+{
+	wait();
+	// DatabaseWorker closes m_handle
+	foreach (sqlite3 * handle, m_connections)
+	{
+		if (handle != m_handle)
+			sqlite3_close(handle);
+	}
+}
+
+QString TableDiff::hashSql(const QString & schema, const QStringList & columns)
+{
+	return QString("SELECT rowid, %1 FROM %2.%3 WHERE rowid BETWEEN ?1 AND ?2;")
+		   .arg(Utils::q(columns, "\""), Utils::q(schema), Utils::q(m_table));
+}
+
+void TableDiff::hashing(qlonglong rows, bool showLabel)
+{
+	// the first pass is most of the work, the second one gets the rest
+	qlonglong total = (m_rows > 0) ? 2 * m_rows : 0;
+	if (total > 0)
+		reportProgress(9 * qMin(rows, total), 10 * total);
+	if (showLabel)
+	{
+		QString text(tr("Hashing rows: %1").arg(rows));
+		if (total > 0)
+			text += tr(" of about %1").arg(total);
+		emit label(text);
+	}
+}
+
+QList<qint64> TableDiff::pieceStarts(sqlite3 * handle, const QString & schema,
+									 qint64 lo, qint64 hi)
+{
+	QList<qint64> result;
+	// the rowids alone, so no column is read or hashed
+	QByteArray sql(QString("SELECT rowid FROM %1.%2 WHERE rowid BETWEEN ?1 AND ?2;")
+				   .arg(Utils::q(schema), Utils::q(m_table)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(handle, sql.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		sqlite3_bind_int64(stmt, 1, lo);
+		sqlite3_bind_int64(stmt, 2, hi);
+		int rows = 0;
+		while (!isCancelled() && ((rc = sqlite3_step(stmt)) == SQLITE_ROW))
+		{
+			if (++rows > CHUNK_ROWS)
+			{
+				result.append(sqlite3_column_int64(stmt, 0));
+				rows = 1;
+			}
+		}
+	}
+	if (!isCancelled() && (rc != SQLITE_OK) && (rc != SQLITE_DONE))
+		m_error = QString::fromUtf8(sqlite3_errmsg(handle));
+	sqlite3_finalize(stmt);
+	return result;
+}
+
+bool TableDiff::compareRows(const QString & sourceSql,
+							const QString & targetSql, qint64 lo, qint64 hi)
+{
+	RangeHasher source(m_connections.value(0, m_handle), sourceSql, lo, hi, 1);
+	RangeHasher target(m_connections.value(1, m_handle), targetSql, lo, hi, 1);
+	if (!source.scan() || !target.scan())
+	{
+		m_error = source.error().isEmpty() ? target.error() : source.error();
+		return false;
+	}
+	QList<qint64> offsets((source.buckets().keys().toSet()
+						   + target.buckets().keys().toSet()).toList());
+	qSort(offsets);
+	foreach (qint64 offset, offsets)
+	{
+		qlonglong rowid = (qint64)((quint64)lo + offset);
+		if (!target.buckets().contains(offset))
+			m_inserted.append(rowid);
+		else if (!source.buckets().contains(offset))
+			m_deleted.append(rowid);
+		else if (source.buckets().value(offset)
+				 != target.buckets().value(offset))
+		{
+			m_changed.append(rowid);
+		}
+	}
+	return true;
+}
+
+void TableDiff::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	// every connection keeps its snapshot for both passes; they are all
+	// taken before the first row is hashed
+	bool ok = true;
+	if (m_connections.isEmpty())
+		ok = beginRead(m_handle, QStringList() << m_source << m_target);
+	for (int i = 0; ok && (i < m_connections.count()); ++i)
+	{
+		ok = beginRead(m_connections.at(i),
+					   QStringList() << ((i % 2) ? m_target : m_source));
+	}
+	if (ok)
+		compare();
+	endReads();
+}
+
+void TableDiff::compare()
+{
+	QStringList sourceColumns(columns(m_source, m_table));
+	if (sourceColumns.isEmpty())
+		return;
+	QStringList targetColumns(columns(m_target, m_table));
+	if (targetColumns.isEmpty())
+		return;
+	if (sourceColumns != targetColumns)
+	{
+		m_error = tr("The tables do not have the same columns");
+		return;
+	}
+
+	qint64 lo = 0;
+	qint64 hi = 0;
+	qint64 targetLo = 0;
+	qint64 targetHi = 0;
+	bool hasSource = rowidRange(m_source, m_table, &lo, &hi);
+	bool hasTarget = rowidRange(m_target, m_table, &targetLo, &targetHi);
+	if (!m_error.isEmpty() || !(hasSource || hasTarget))
+		return;
+	if (!hasSource)
+	{
+		lo = targetLo;
+		hi = targetHi;
+	}
+	else if (hasTarget)
+	{
+		lo = qMin(lo, targetLo);
+		hi = qMax(hi, targetHi);
+	}
+
+	// ranges of about CHUNK_ROWS rows if the rowids are spread evenly;
+	// unsigned, so the span of any two rowids fits
+	double span = (double)((quint64)hi - (quint64)lo) + 1.0;
+	double rows = (m_rows > 0) ? qMin((double)m_rows, span) : span;
+	quint64 width = (quint64)ceil(span / qMax(1.0, rows / CHUNK_ROWS));
+	width = qMax(width, (quint64)1);
+	quint64 ranges = ((quint64)hi - (quint64)lo) / width + 1;
+
+	// slices of whole ranges, one hasher on each side of every slice
+	QString sourceSql(hashSql(m_source, sourceColumns));
+	QString targetSql(hashSql(m_target, targetColumns));
+	int slices = qMax(1, m_connections.count() / 2);
+	quint64 perSlice = (ranges + slices - 1) / slices;
+	QList<RangeHasher *> hashers;
+	QList<quint64> firstRange;
+	for (int i = 0; (i < slices) && ((quint64)i * perSlice < ranges); ++i)
+	{
+		quint64 first = (quint64)i * perSlice;
+		quint64 last = qMin(first + perSlice, ranges) - 1;
+		qint64 sliceLo = (qint64)((quint64)lo + first * width);
+		qint64 sliceHi = (last == ranges - 1)
+						 ? hi : (qint64)((quint64)lo + (last + 1) * width - 1);
+		sqlite3 * sourceHandle = m_connections.value(2 * i, m_handle);
+		sqlite3 * targetHandle = m_connections.value(2 * i + 1, m_handle);
+		hashers.append(new RangeHasher(sourceHandle, sourceSql,
+									   sliceLo, sliceHi, (qint64)width));
+		hashers.append(new RangeHasher(targetHandle, targetSql,
+									   sliceLo, sliceHi, (qint64)width));
+		firstRange.append(first);
+		firstRange.append(first);
+	}
+	emit label(tr("Hashing rows"));
+	foreach (RangeHasher * hasher, hashers)
+		hasher->start();
+	waitFor(hashers);
+
+	QHash<qint64,RowHash> sourceSums;
+	QHash<qint64,RowHash> targetSums;
+	for (int i = 0; i < hashers.count(); ++i)
+	{
+		RangeHasher * hasher = hashers.at(i);
+		m_hashed += hasher->rows();
+		if (m_error.isEmpty() && !hasher->error().isEmpty())
+			m_error = hasher->error();
+		QHash<qint64,RowHash> & sums = (i % 2) ? targetSums : sourceSums;
+		QHashIterator<qint64,RowHash> it(hasher->buckets());
+		while (it.hasNext())
+		{
+			it.next();
+			sums.insert(firstRange.at(i) + it.key(), it.value());
+		}
+	}
+	qDeleteAll(hashers);
+	if (isCancelled())
+		m_error = tr("Cancelled");
+	if (!m_error.isEmpty())
+		return;
+
+	QSet<qint64> keys(sourceSums.keys().toSet() + targetSums.keys().toSet());
+	m_rangeCount = keys.count();
+	QList<qint64> differing;
+	foreach (qint64 key, keys)
+	{
+		if (sourceSums.value(key) != targetSums.value(key))
+			differing.append(key);
+	}
+	qSort(differing);
+	m_differing = differing.count();
+
+	// The second pass reads the differing ranges only. However skewed the
+	// rowids are, each range is cut into pieces of at most CHUNK_ROWS rows
+	// of either side, and the pieces are compared row by row.
+	emit label(tr("Comparing the rows of %1 differing ranges")
+			   .arg(differing.count()));
+	for (int i = 0; (i < differing.count()) && !isCancelled(); ++i)
+	{
+		quint64 range = differing.at(i);
+		qint64 rangeLo = (qint64)((quint64)lo + range * width);
+		qint64 rangeHi = (range == ranges - 1)
+						 ? hi : (qint64)((quint64)rangeLo + width - 1);
+		QSet<qint64> cuts(pieceStarts(m_connections.value(0, m_handle),
+									  m_source, rangeLo, rangeHi).toSet());
+		cuts += pieceStarts(m_connections.value(1, m_handle),
+							m_target, rangeLo, rangeHi).toSet();
+		if (!m_error.isEmpty())
+			break;
+		cuts.insert(rangeLo);
+		QList<qint64> starts(cuts.toList());
+		qSort(starts);
+		for (int j = 0; (j < starts.count()) && !isCancelled(); ++j)
+		{
+			qint64 pieceHi = (j + 1 < starts.count()) ? starts.at(j + 1) - 1
+													  : rangeHi;
+			if (!compareRows(sourceSql, targetSql, starts.at(j), pieceHi))
+				break;
+		}
+		if (!m_error.isEmpty())
+			break;
+		reportProgress(9 * differing.count() + i + 1, 10 * differing.count());
+	}
+	if (isCancelled())
+		m_error = tr("Cancelled");
+}
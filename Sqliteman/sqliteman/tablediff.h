@@ -0,0 +1,95 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef TABLEDIFF_H
+#define TABLEDIFF_H
+
+#include <QStringList>
+
+#include "databaseworker.h"
+
+class RangeHasher;
+
+
+/*! \brief Compares a table of two databases by hashing rowid ranges.
+The rowid span of both tables is cut into ranges of about CHUNK_ROWS
+rows, and every range gets the sum of its row hashes (RowHash) on both
+sides. That is one pass over each table, and the passes are split into
+slices hashed in parallel on read only connections of their own
+(Database::openConnection()). Only the ranges whose sums differ are read
+again, in pieces of at most CHUNK_ROWS rows of either side, row by row,
+to tell the inserted, deleted and changed rows apart; so a range holding
+most of the rows of a table with skewed rowids takes no more memory.
+Where DatabaseWorker::useOwnConnection() rules that out, both sides are
+hashed on the main connection.
+Every connection reads in one transaction over both passes. The
+transactions start together before the first pass, but the slices on
+other connections see one state of the tables only if nothing commits
+meanwhile, so the result is exact on a quiescent database.
+Rows are matched by rowid, so WITHOUT ROWID tables cannot be compared.
+Inserted rows are the ones only the source has, so a patch made of the
+differences turns the target into the source.
+*/
+class TableDiff : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		TableDiff(const QString & table, const QString & source,
+				  const QString & target, QObject * parent = 0);
+		~TableDiff();
+
+		//! \brief Expected rows of the larger table, see Database::rowEstimate().
+		void setRowEstimate(qlonglong rows) { m_rows = rows; }
+
+		//! \brief rowids only in the source
+		const QList<qlonglong> & inserted() { return m_inserted; }
+		//! \brief rowids only in the target
+		const QList<qlonglong> & deleted() { return m_deleted; }
+		//! \brief rowids in both with different values
+		const QList<qlonglong> & changed() { return m_changed; }
+		//! \brief Rows hashed in the first pass, both sides together.
+		qlonglong hashedRows() { return m_hashed; }
+		int rangeCount() { return m_rangeCount; }
+		int differingRanges() { return m_differing; }
+
+	protected:
+		void run();
+
+	private:
+		QString m_table;
+		QString m_source;
+		QString m_target;
+		//! \brief connections of the slices, m_handle first; empty when
+		//! m_handle hashes both sides
+		QList<sqlite3 *> m_connections;
+		qlonglong m_rows;
+		qlonglong m_hashed;
+		int m_rangeCount;
+		int m_differing;
+		QList<qlonglong> m_inserted;
+		QList<qlonglong> m_deleted;
+		QList<qlonglong> m_changed;
+
+		//! \brief SELECT of rowid and columns for RangeHasher.
+		QString hashSql(const QString & schema, const QStringList & columns);
+		void hashing(qlonglong rows, bool showLabel);
+		//! \brief Both passes, within the read transactions of run().
+		void compare();
+		/*! \brief rowids cutting lo to hi of schema into CHUNK_ROWS rows.
+		Every rowid which follows CHUNK_ROWS others starts a piece.
+		*/
+		QList<qint64> pieceStarts(sqlite3 * handle, const QString & schema,
+								  qint64 lo, qint64 hi);
+		/*! \brief Compare lo to hi row by row, adding to the rowid lists.
+		\retval bool false on error, with m_error set
+		*/
+		bool compareRows(const QString & sourceSql, const QString & targetSql,
+						 qint64 lo, qint64 hi);
+};
+
+#endif
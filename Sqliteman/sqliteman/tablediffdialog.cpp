@@ -0,0 +1,277 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSettings>
+#include <QSqlQuery>
+#include <QTextStream>
+
+#include "database.h"
+#include "tablediff.h"
+#include "tablediffdialog.h"
+#include "utils.h"
+
+// rowids listed below a group, the others are only counted
+#define GROUP_ROWS 10000
+// rowids in one DELETE of the patch
+#define PATCH_IDS 500
+
+
+TableDiffDialog::TableDiffDialog(QWidget * parent)
+	: QDialog(parent)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("tablediff/height", QVariant(500)).toInt();
+	int ww = settings.value("tablediff/width", QVariant(600)).toInt();
+	resize(ww, hh);
+
+	m_compareButton =
+		ui.buttonBox->addButton(tr("&Compare"), QDialogButtonBox::ApplyRole);
+	m_patchButton =
+		ui.buttonBox->addButton(tr("Save &Patch..."),
+								QDialogButtonBox::ActionRole);
+	m_patchButton->setEnabled(false);
+	ui.resultTree->setColumnCount(2);
+	ui.resultTree->setHeaderLabels(QStringList() << tr("Change") << tr("Rows"));
+
+	QStringList schemas(Database::getDatabases().keys());
+	ui.sourceCombo->addItems(schemas);
+	ui.targetCombo->addItems(schemas);
+	ui.sourceCombo->setCurrentIndex(ui.sourceCombo->findText("main"));
+	// the first attached database, if any
+	foreach (QString schema, schemas)
+	{
+		if ((schema != "main") && (schema != "temp"))
+		{
+			ui.targetCombo->setCurrentIndex(ui.targetCombo->findText(schema));
+			break;
+		}
+	}
+	schemaCombo_currentIndexChanged();
+
+	connect(ui.sourceCombo, SIGNAL(currentIndexChanged(int)),
+			this, SLOT(schemaCombo_currentIndexChanged()));
+	connect(ui.targetCombo, SIGNAL(currentIndexChanged(int)),
+			this, SLOT(schemaCombo_currentIndexChanged()));
+	connect(m_compareButton, SIGNAL(clicked()),
+			this, SLOT(compareButton_clicked()));
+	connect(m_patchButton, SIGNAL(clicked()), this, SLOT(patchButton_clicked()));
+}
+
+TableDiffDialog::~TableDiffDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("tablediff/height", QVariant(height()));
+	settings.setValue("tablediff/width", QVariant(width()));
+}
+
+void TableDiffDialog::schemaCombo_currentIndexChanged()
+{
+	QString current(ui.tableCombo->currentText());
+	ui.tableCombo->clear();
+	QString source(ui.sourceCombo->currentText());
+	QString target(ui.targetCombo->currentText());
+	if (source.isEmpty() || target.isEmpty())
+		return;
+
+	// tables of the same name in both
+	DbObjects targetTables(Database::getObjects("table", target));
+	foreach (QString table, Database::getObjects("table", source).keys())
+	{
+		if (targetTables.contains(table))
+			ui.tableCombo->addItem(table);
+	}
+	int i = ui.tableCombo->findText(current);
+	if (i != -1)
+		ui.tableCombo->setCurrentIndex(i);
+	m_compareButton->setEnabled((source != target)
+								&& (ui.tableCombo->count() > 0));
+}
+
+void TableDiffDialog::addGroup(const QString & title,
+							   const QList<qlonglong> & rowids)
+{
+	if (rowids.isEmpty())
+		return;
+	QTreeWidgetItem * group = new QTreeWidgetItem(ui.resultTree);
+	group->setText(0, title);
+	group->setText(1, QString::number(rowids.count()));
+	group->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+	for (int i = 0; (i < rowids.count()) && (i < GROUP_ROWS); ++i)
+	{
+		QTreeWidgetItem * row = new QTreeWidgetItem(group);
+		row->setText(0, tr("rowid %1").arg(rowids.at(i)));
+	}
+}
+
+void TableDiffDialog::compareButton_clicked()
+{
+	QString table(ui.tableCombo->currentText());
+	QString source(ui.sourceCombo->currentText());
+	QString target(ui.targetCombo->currentText());
+
+	ui.resultTree->clear();
+	ui.resultLabel->clear();
+	m_patchButton->setEnabled(false);
+
+	TableDiff diff(table, source, target, this);
+	diff.setRowEstimate(qMax(Database::rowEstimate(table, source),
+							 Database::rowEstimate(table, target)));
+	QElapsedTimer timer;
+	timer.start();
+	diff.runWithProgress(tr("Comparing %1").arg(table), this);
+	double seconds = timer.elapsed() / 1000.0;
+
+	if (!diff.errorMessage().isEmpty())
+	{
+		ui.resultLabel->setText(tr("Cannot compare %1").arg(table)
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ diff.errorMessage() + "<br/></span>");
+		return;
+	}
+	m_table = table;
+	m_source = source;
+	m_inserted = diff.inserted();
+	m_deleted = diff.deleted();
+	m_changed = diff.changed();
+	addGroup(tr("Inserted"), m_inserted);
+	addGroup(tr("Deleted"), m_deleted);
+	addGroup(tr("Changed"), m_changed);
+	ui.resultTree->resizeColumnToContents(0);
+
+	if (m_inserted.isEmpty() && m_deleted.isEmpty() && m_changed.isEmpty())
+	{
+		ui.resultLabel->setText(tr("The tables are equal: %1 rows hashed "
+								   "in %2 s.")
+								.arg(diff.hashedRows())
+								.arg(seconds, 0, 'f', 1));
+		return;
+	}
+	ui.resultLabel->setText(tr("%1 inserted, %2 deleted and %3 changed rows "
+							   "in %4 of %5 ranges; %6 rows hashed in %7 s.")
+							.arg(m_inserted.count())
+							.arg(m_deleted.count())
+							.arg(m_changed.count())
+							.arg(diff.differingRanges())
+							.arg(diff.rangeCount())
+							.arg(diff.hashedRows())
+							.arg(seconds, 0, 'f', 1));
+	m_patchButton->setEnabled(true);
+}
+
+bool TableDiffDialog::writePatch(QTextStream & out)
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	QSqlQuery query(QString("PRAGMA %1.table_info(%2);")
+					.arg(Utils::q(m_source), Utils::q(m_table)), db);
+	QStringList columns;
+	QStringList quoted;
+	int pkColumns = 0;
+	bool integerKey = false;
+	while (query.next())
+	{
+		columns.append(Utils::q(query.value(1).toString()));
+		quoted.append(QString("quote(%1)").arg(columns.last()));
+		if (query.value(5).toInt() > 0)
+		{
+			++pkColumns;
+			integerKey = (query.value(2).toString().toUpper() == "INTEGER");
+		}
+	}
+	// an INTEGER PRIMARY KEY column is the rowid itself
+	bool aliased = (pkColumns == 1) && integerKey;
+
+	// the values as SQL literals, with the types they have in the source
+	QSqlQuery row(db);
+	if (!row.prepare(QString("SELECT %1 FROM %2.%3 WHERE rowid = ?;")
+					 .arg(quoted.join(", "), Utils::q(m_source),
+						  Utils::q(m_table))))
+	{
+		return false;
+	}
+
+	QString table(Utils::q(m_table));
+	out << "-- " << tr("Makes %1 equal to %2.%1, to be run on the target "
+					   "database").arg(m_table, m_source) << "\n"
+		<< "-- " << tr("The values are those of the source when the patch "
+					   "was saved") << "\n";
+	out << "BEGIN TRANSACTION;\n";
+	for (int i = 0; i < m_deleted.count(); i += PATCH_IDS)
+	{
+		QStringList ids;
+		foreach (qlonglong rowid, m_deleted.mid(i, PATCH_IDS))
+			ids.append(QString::number(rowid));
+		out << "DELETE FROM " << table << " WHERE rowid IN ("
+			<< ids.join(", ") << ");\n";
+	}
+	foreach (qlonglong rowid, m_changed)
+	{
+		row.bindValue(0, rowid);
+		if (!row.exec())
+			return false;
+		if (!row.next())
+			continue;
+		QStringList set;
+		for (int i = 0; i < columns.count(); ++i)
+			set.append(columns.at(i) + " = " + row.value(i).toString());
+		out << "UPDATE " << table << " SET " << set.join(", ")
+			<< " WHERE rowid = " << rowid << ";\n";
+	}
+	QString names(columns.join(", "));
+	if (!aliased)
+		names.prepend("rowid, ");
+	foreach (qlonglong rowid, m_inserted)
+	{
+		row.bindValue(0, rowid);
+		if (!row.exec())
+			return false;
+		if (!row.next())
+			continue;
+		QStringList values;
+		if (!aliased)
+			values.append(QString::number(rowid));
+		for (int i = 0; i < columns.count(); ++i)
+			values.append(row.value(i).toString());
+		out << "INSERT INTO " << table << " (" << names << ") VALUES ("
+			<< values.join(", ") << ");\n";
+	}
+	out << "COMMIT;\n";
+	return true;
+}
+
+void TableDiffDialog::patchButton_clicked()
+{
+	QString fileName = QFileDialog::getSaveFileName(this,
+		tr("Save Patch"), QDir::currentPath(),
+		tr("SQL file (*.sql);;All Files (*)"));
+	if (fileName.isNull()) { return; }
+
+	QFile f(fileName);
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		QMessageBox::warning(this, tr("Save Patch"),
+							 tr("Cannot open file %1 for writing")
+							 .arg(fileName));
+		return;
+	}
+	QTextStream out(&f);
+	out.setCodec("UTF-8");
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	bool ok = writePatch(out);
+	QApplication::restoreOverrideCursor();
+	if (!ok)
+	{
+		QMessageBox::warning(this, tr("Save Patch"),
+							 tr("Cannot read the rows of %1").arg(m_table));
+	}
+}
@@ -0,0 +1,57 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef TABLEDIFFDIALOG_H
+#define TABLEDIFFDIALOG_H
+
+#include <qdialog.h>
+
+#include "ui_tablediffdialog.h"
+
+class QPushButton;
+class QTextStream;
+
+
+/*! \brief Compares a table of two databases, e.g. main and an attached copy.
+The comparison runs in a TableDiff; the inserted, deleted and changed
+rows are listed by rowid, and can be saved as an SQL script which makes
+the target table equal to the source one.
+The script names the table without a schema, so it can be run on any
+copy of the target database, attached under any name or not at all.
+The values are read from the source table on the main connection when
+the script is saved, so changes made to it after the comparison end up
+in the script too, while the list of rows does not change.
+*/
+class TableDiffDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		TableDiffDialog(QWidget * parent = 0);
+		~TableDiffDialog();
+
+	private:
+		Ui::TableDiffDialog ui;
+		QPushButton * m_compareButton;
+		QPushButton * m_patchButton;
+		//! \brief the last comparison, for the patch
+		QString m_table;
+		QString m_source;
+		QList<qlonglong> m_inserted;
+		QList<qlonglong> m_deleted;
+		QList<qlonglong> m_changed;
+
+		void addGroup(const QString & title, const QList<qlonglong> & rowids);
+		bool writePatch(QTextStream & out);
+
+	private slots:
+		void schemaCombo_currentIndexChanged();
+		void compareButton_clicked();
+		void patchButton_clicked();
+};
+
+#endif
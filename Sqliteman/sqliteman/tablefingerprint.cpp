@@ -0,0 +1,180 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "database.h"
+#include "rowhash.h"
+#include "sqlparser.h"
+#include "tablefingerprint.h"
+#include "utils.h"
+
+
+TableFingerprint::TableFingerprint(const QString & schema, int connections,
+								   QObject * parent)
+	: DatabaseWorker(Database::sqlite3handle(), parent),
+	  m_schema(schema),
+	  m_current(0),
+	  m_span(0)
+{
+	useOwnConnection(schema, false);
+	if (ownsConnection())
+	{
+		// m_handle hashes the first slice
+		m_connections.append(m_handle);
+		for (int i = 1; i < connections; ++i)
+		{
+			QString error;
+			sqlite3 * handle = Database::openConnection(true, &error);
+			if (!handle)
+				break;
+			m_connections.append(handle);
+		}
+	}
+}
+
+TableFingerprint::~TableFingerprint()
+{
+	wait();
+	// DatabaseWorker closes m_handle
+	foreach (sqlite3 * handle, m_connections)
+	{
+		if (handle != m_handle)
+			sqlite3_close(handle);
+	}
+}
+
+void TableFingerprint::addTable(const QString & name)
+{
+	// the schema says it, as the prepared SELECT of rowidRange() could
+	// fail for other reasons too
+	SqlParser * parsed = Database::parseTable(name, m_schema);
+	m_tables.append(name);
+	m_hasRowid.append(parsed->m_hasRowid);
+	delete parsed;
+}
+
+bool TableFingerprint::fingerprint(const QString & table, int index)
+{
+	QElapsedTimer timer;
+	timer.start();
+	QStringList names(columns(m_schema, table));
+	if (names.isEmpty())
+		return false;
+	qint64 lo = 0;
+	qint64 hi = 0;
+	// 1 with rows, 0 if empty, -1 without rowid
+	int found = -1;
+	if (m_hasRowid.at(index))
+		found = rowidRange(m_schema, table, &lo, &hi) ? 1 : 0;
+	if (!m_error.isEmpty())
+		return false;
+	if (found == 0)
+	{
+		emit fingerprinted(table, RowHash().toString(), 0, timer.elapsed());
+		return true;
+	}
+
+	// the rowid is selected for the slices, but not hashed
+	QList<RangeHasher *> hashers;
+	m_current = index;
+	m_span = 0;
+	if (found < 0)
+	{
+		hashers.append(new RangeHasher(m_handle,
+			QString("SELECT NULL, %1 FROM %2.%3;")
+			.arg(Utils::q(names, "\""), Utils::q(m_schema), Utils::q(table)),
+			0, 0));
+	}
+	else
+	{
+		QString sql(QString("SELECT rowid, %1 FROM %2.%3 "
+							"WHERE rowid BETWEEN ?1 AND ?2;")
+					.arg(Utils::q(names, "\""), Utils::q(m_schema),
+						 Utils::q(table)));
+		// unsigned, so the span of any two rowids fits
+		m_span = (quint64)hi - (quint64)lo;
+		int slices = connections();
+		quint64 perSlice = m_span / slices + 1;
+		for (int i = 0; i < slices; ++i)
+		{
+			quint64 first = (quint64)i * perSlice;
+			bool last = (i == slices - 1) || (m_span - first < perSlice);
+			hashers.append(new RangeHasher(m_connections.value(i, m_handle),
+				sql, (qint64)((quint64)lo + first),
+				last ? hi : (qint64)((quint64)lo + first + perSlice - 1)));
+			if (last)
+				break;
+		}
+	}
+	foreach (RangeHasher * hasher, hashers)
+	{
+		hasher->setHashRowid(false);
+		hasher->start();
+	}
+
+	waitFor(hashers);
+
+	RowHash sum;
+	qlonglong rows = 0;
+	foreach (RangeHasher * hasher, hashers)
+	{
+		sum += hasher->sum();
+		rows += hasher->rows();
+		if (m_error.isEmpty())
+			m_error = hasher->error();
+	}
+	qDeleteAll(hashers);
+	if (isCancelled())
+		m_error = tr("Cancelled");
+	if (!m_error.isEmpty())
+		return false;
+	emit fingerprinted(table, sum.toString(), rows, timer.elapsed());
+	return true;
+}
+
+void TableFingerprint::hashing(qlonglong rows, bool showLabel)
+{
+	// progress against a densely filled rowid span
+	qint64 part = (m_span > 0)
+				  ? (qint64)(1000.0 * qMin((double)rows, (double)m_span) / m_span)
+				  : 0;
+	reportProgress(1000 * m_current + part, 1000 * m_tables.count());
+	if (showLabel)
+	{
+		emit label(tr("Hashing %1: %2 rows")
+				   .arg(m_tables.at(m_current)).arg(rows));
+	}
+}
+
+void TableFingerprint::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	// every connection keeps its snapshot for all the tables; they are
+	// all taken before the first slice is hashed
+	bool ok = true;
+	if (m_connections.isEmpty())
+		ok = beginRead(m_handle, QStringList() << m_schema);
+	for (int i = 0; ok && (i < m_connections.count()); ++i)
+		ok = beginRead(m_connections.at(i), QStringList() << m_schema);
+	for (int i = 0; ok && (i < m_tables.count()) && !isCancelled(); ++i)
+	{
+		emit label(tr("Hashing %1 (%2 of %3)")
+				   .arg(m_tables.at(i)).arg(i + 1).arg(m_tables.count()));
+		if (!fingerprint(m_tables.at(i), i) && !isCancelled())
+		{
+			// the other tables are hashed anyway
+			emit failed(m_tables.at(i), m_error);
+			m_error.clear();
+		}
+	}
+	endReads();
+	if (isCancelled())
+		m_error = tr("Cancelled");
+}
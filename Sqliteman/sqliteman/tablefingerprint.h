@@ -0,0 +1,75 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef TABLEFINGERPRINT_H
+#define TABLEFINGERPRINT_H
+
+#include <QStringList>
+
+#include "databaseworker.h"
+
+
+/*! \brief Order independent checksums of tables, e.g. to verify replicas.
+The fingerprint of a table is the sum of the MD5 hashes of its rows
+(RowHash) and does not depend on the row order, the rowids or the page
+layout, so copies of a table made in any way can be compared by it.
+The rowid span of each table is split into slices, one for each read
+only connection of its own (Database::openConnection()), which are
+hashed in parallel; in WAL mode that does not keep writers waiting.
+Where DatabaseWorker::useOwnConnection() rules that out, the tables are
+hashed in one slice on the main connection, WITHOUT ROWID tables in one
+slice anyway.
+Each connection reads all the tables in one transaction
+(DatabaseWorker::beginRead()), and all of them are begun before the first
+slice. With several connections a fingerprint still matches a single
+state of its table only if no write commits while they begin.
+*/
+class TableFingerprint : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		//! \param connections slices hashed in parallel
+		TableFingerprint(const QString & schema, int connections,
+						 QObject * parent = 0);
+		~TableFingerprint();
+
+		void addTable(const QString & name);
+		//! \brief Slices hashed in parallel, 1 on the main connection.
+		int connections() { return qMax(1, m_connections.count()); }
+
+	signals:
+		//! \brief 32 hex digits of the sum of row hashes of table.
+		void fingerprinted(QString table, QString fingerprint, qlonglong rows,
+						   qlonglong ms);
+		//! \brief table could not be hashed; the others still are.
+		void failed(QString table, QString message);
+
+	protected:
+		void run();
+
+	private:
+		QString m_schema;
+		QStringList m_tables;
+		//! \brief by m_tables, false for WITHOUT ROWID
+		QList<bool> m_hasRowid;
+		//! \brief connections of the slices, m_handle first; empty when
+		//! m_handle hashes in one slice
+		QList<sqlite3 *> m_connections;
+		//! \brief index of the table being hashed
+		int m_current;
+		//! \brief its rowid span, 0 for a single slice
+		quint64 m_span;
+
+		/*! \brief Hash table in slices.
+		\retval bool false on error, with m_error set
+		*/
+		bool fingerprint(const QString & table, int index);
+		void hashing(qlonglong rows, bool showLabel);
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "tablerebuilder.h"
+
+// counts the copied rows, see run()
+#define COUNT_FUNCTION "sqliteman_count_row"
+// milliseconds between two label updates
+#define LABEL_INTERVAL 500
+
+
+TableRebuilder::TableRebuilder(sqlite3 * handle, qlonglong rows,
+							   QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_rows(rows),
+	  m_copied(0),
+	  m_phase(0)
+{
+}
+
+void TableRebuilder::addIndex(const QString & name, const QString & sql,
+							  bool unique)
+{
+	Index ix;
+	ix.name = name;
+	ix.sql = sql;
+	ix.unique = unique;
+	ix.ms = 0;
+	int i = m_indexes.count();
+	if (unique)
+	{
+		for (i = 0; (i < m_indexes.count()) && m_indexes.at(i).unique; ++i) {}
+	}
+	m_indexes.insert(i, ix);
+}
+
+void TableRebuilder::countRow(sqlite3_context * context, int /*argc*/,
+							  sqlite3_value ** /*argv*/)
+{
+	TableRebuilder * self = (TableRebuilder *)sqlite3_user_data(context);
+	if (QThread::currentThread() == self)
+		++self->m_copied;
+	sqlite3_result_int(context, 1);
+}
+
+int TableRebuilder::progressHandler(void * worker)
+{
+	TableRebuilder * self = (TableRebuilder *)worker;
+	// a statement of the GUI thread is neither counted nor stopped
+	if (QThread::currentThread() != self) { return 0; }
+	self->update();
+	return self->isCancelled() ? 1 : 0;
+}
+
+void TableRebuilder::update()
+{
+	if (m_rows > 0)
+	{
+		qlonglong done = (m_phase == 0) ? qMin(m_copied, m_rows)
+										: m_rows * m_phase;
+		reportProgress(done, m_rows * (m_indexes.count() + 1));
+	}
+	if ((m_phase > 0) || (m_labelTimer.elapsed() < LABEL_INTERVAL))
+		return;
+	m_labelTimer.restart();
+
+	QString text(tr("Copying rows: %1").arg(m_copied));
+	if (m_rows > 0)
+	{
+		text += tr(" of about %1").arg(m_rows);
+		if ((m_copied > 0) && (m_copied < m_rows))
+		{
+			qint64 left = (m_rows - m_copied) * m_timer.elapsed() / m_copied;
+			text += tr(", %1 s left").arg(left / 1000 + 1);
+		}
+	}
+	emit label(text);
+}
+
+bool TableRebuilder::step(const QString & sql)
+{
+	if (exec(sql)) { return true; }
+	m_failedSql = sql;
+	return false;
+}
+
+void TableRebuilder::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	// both are on the shared main connection, so they are removed
+	// whichever way rebuild() ends
+	sqlite3_create_function(m_handle, COUNT_FUNCTION, 0, SQLITE_UTF8,
+							this, countRow, NULL, NULL);
+	sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+	rebuild();
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+	sqlite3_create_function(m_handle, COUNT_FUNCTION, 0, SQLITE_UTF8,
+							NULL, NULL, NULL, NULL);
+}
+
+void TableRebuilder::rebuild()
+{
+	m_timer.start();
+	m_labelTimer.start();
+
+	bool ok = true;
+	if (!m_copy.isEmpty())
+	{
+		emit label(tr("Copying rows"));
+		ok = step(m_copy + " WHERE " + COUNT_FUNCTION + "();");
+	}
+	if (ok && !m_drop.isEmpty())
+	{
+		m_phase = 1;
+		emit label(tr("Dropping the old table"));
+		ok = step(m_drop);
+	}
+	for (int i = 0; ok && (i < m_indexes.count()) && !isCancelled(); ++i)
+	{
+		Index & ix = m_indexes[i];
+		m_phase = i + 1;
+		emit label(tr("Creating index %1 (%2 of %3)")
+				   .arg(ix.name).arg(i + 1).arg(m_indexes.count()));
+		update();
+		QElapsedTimer timer;
+		timer.start();
+		if (!exec(ix.sql))
+		{
+			// the other indexes are created anyway
+			ix.error = m_error;
+			m_error.clear();
+		}
+		ix.ms = timer.elapsed();
+	}
+	if (isCancelled() && m_error.isEmpty())
+		m_error = tr("Cancelled");
+}
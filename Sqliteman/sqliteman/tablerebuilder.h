@@ -0,0 +1,84 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef TABLEREBUILDER_H
+#define TABLEREBUILDER_H
+
+#include "databaseworker.h"
+
+
+/*! \brief Copy step of AlterTableDialog when the table has to be rebuilt.
+It copies the rows into the new table, drops the old one and creates
+the indexes again, on the worker thread but on the main connection, so
+it all stays inside the dialog's savepoint and a cancel can be rolled
+back by the dialog.
+Copied rows are counted by a function in the WHERE clause of the copy,
+and a sqlite3_progress_handler() turns the count into progress and a
+time estimate against the expected row count. Both are installed on the
+main connection for the run only and ignore statements of other threads;
+MainConnectionMonitor keeps the GUI thread's pollers off it meanwhile.
+The indexes are created after the copy, since building an index in one
+go is cheaper than updating it for every row. Unique ones come first as
+they can fail on the copied data; a failed index does not stop the
+others, see indexes().
+*/
+class TableRebuilder : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		typedef struct
+		{
+			QString name;
+			QString sql;
+			bool unique;
+			//! \brief empty if it has been created
+			QString error;
+			qint64 ms;
+		} Index;
+
+		//! \param rows expected row count, -1 if unknown
+		TableRebuilder(sqlite3 * handle, qlonglong rows, QObject * parent = 0);
+
+		//! \brief INSERT ... SELECT ... FROM table, without WHERE and ';'
+		void setCopy(const QString & sql) { m_copy = sql; }
+		//! \brief DROP TABLE of the old table
+		void setDrop(const QString & sql) { m_drop = sql; }
+		void addIndex(const QString & name, const QString & sql, bool unique);
+
+		//! \brief Statement which failed, see errorMessage().
+		QString failedSql() { return m_failedSql; }
+		//! \brief The indexes in the order they were created in.
+		const QList<Index> & indexes() { return m_indexes; }
+		qlonglong copied() { return m_copied; }
+
+	protected:
+		void run();
+
+	private:
+		QString m_copy;
+		QString m_drop;
+		QString m_failedSql;
+		QList<Index> m_indexes;
+		qlonglong m_rows;
+		qlonglong m_copied;
+		//! \brief 0 while copying, then 1 + the indexes created
+		int m_phase;
+		QElapsedTimer m_timer;
+		QElapsedTimer m_labelTimer;
+
+		//! \brief The work of run(), with the hooks installed.
+		void rebuild();
+		bool step(const QString & sql);
+		//! \brief Progress and label for the current phase.
+		void update();
+		static int progressHandler(void * worker);
+		static void countRow(sqlite3_context * context, int argc,
+							 sqlite3_value ** argv);
+};
+
+#endif
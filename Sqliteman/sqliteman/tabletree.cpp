@@ -8,11 +8,14 @@ for which a new license (GPL+exception) is in place.
 #include <QApplication>
 
 #include "database.h"
+#include "databaseworker.h"
 #include "tabletree.h"
 #include "utils.h"
 
 
-TableTree::TableTree(QWidget * parent) : QTreeWidget(parent)
+TableTree::TableTree(QWidget * parent)
+	: QTreeWidget(parent),
+	  m_loader(0)
 {
 	trDatabase = tr("Database");
 	trTables = tr("Tables");
@@ -32,17 +35,100 @@ TableTree::TableTree(QWidget * parent) : QTreeWidget(parent)
 	setDragEnabled(true);
 	setDropIndicatorShown(true);
 	setAcceptDrops(false);
+
+	connect(this, SIGNAL(itemExpanded(QTreeWidgetItem *)),
+			this, SLOT(populateItem(QTreeWidgetItem *)));
+}
+
+TableTree::~TableTree()
+{
+	delete m_loader;
 }
 
 void TableTree::buildTree()
 {
 	QStringList databases(Database::getDatabases().keys());
 	clear();
+	m_shown.clear();
+	// an older read is useless now
+	if (m_loader)
+	{
+		m_loader->disconnect(this);
+		m_loader->deleteLater();
+		m_loader = 0;
+		MainConnectionMonitor::instance()->disconnect(this);
+	}
 
+	// Another connection sees neither the temp schema nor uncommitted
+	// changes, and schemas which are cached already are quick anyway.
+	QStringList background;
+	bool autoCommit = Database::isAutoCommit();
 	foreach(QString schema, databases)
 	{
-		buildDatabase(schema);
+		if (   autoCommit && (schema != "temp")
+			&& !SchemaCatalog::instance()->isCurrent(schema))
+		{
+			background.append(schema);
+		}
 	}
+	if (!background.isEmpty())
+	{
+		m_loader = new SchemaCatalogLoader(background, this);
+		if (m_loader->isValid())
+		{
+			connect(m_loader, SIGNAL(finished()),
+					this, SLOT(catalogLoaded()));
+		}
+		else
+		{
+			// e.g. an in-memory database: read it here
+			delete m_loader;
+			m_loader = 0;
+			background.clear();
+		}
+	}
+
+	foreach(QString schema, databases)
+	{
+		addDatabaseItem(schema, !background.contains(schema));
+	}
+	if (m_loader) { m_loader->start(); }
+}
+
+void TableTree::catalogLoaded()
+{
+	// storing the snapshots reads the main connection, so a worker on
+	// it is waited for
+	MainConnectionMonitor * monitor = MainConnectionMonitor::instance();
+	if (monitor->isBusy())
+	{
+		connect(monitor, SIGNAL(idle()), this, SLOT(catalogLoaded()),
+				Qt::UniqueConnection);
+		return;
+	}
+	monitor->disconnect(this);
+
+	SchemaCatalogLoader * loader = m_loader;
+	m_loader = 0;
+	if (!loader) { return; }
+	QMapIterator<QString,SchemaSnapshot> it(loader->snapshots());
+	while (it.hasNext())
+	{
+		it.next();
+		SchemaCatalog::instance()->store(it.key(), it.value());
+	}
+	// Schemas which could not be read, or have changed meanwhile, are
+	// read again on the main connection by fillDatabase().
+	foreach (QString schema, loader->schemas())
+	{
+		for (int i = 0; i < topLevelItemCount(); ++i)
+		{
+			QTreeWidgetItem * dbItem = topLevelItem(i);
+			if (dbItem->text(1) == schema)
+				fillDatabase(dbItem, schema);
+		}
+	}
+	loader->deleteLater();
 }
 
 void TableTree::buildDatabase(QTreeWidgetItem * dbItem, const QString & schema)
@@ -52,6 +138,11 @@ void TableTree::buildDatabase(QTreeWidgetItem * dbItem, const QString & schema)
 }
 
 void TableTree::buildDatabase(const QString & schema)
+{
+	addDatabaseItem(schema, true);
+}
+
+QTreeWidgetItem * TableTree::addDatabaseItem(const QString & schema, bool fill)
 {
 	QTreeWidgetItem * dbItem = new QTreeWidgetItem(this, DatabaseItemType);
 	dbItem->setIcon(0, Utils::getIcon("database.png"));
@@ -67,16 +158,102 @@ void TableTree::buildDatabase(const QString & schema)
 	QTreeWidgetItem * systemItem = new QTreeWidgetItem(dbItem, SystemItemType);
 	systemItem->setIcon(0, Utils::getIcon("system.png"));
 
-	buildTables(tablesItem, schema);
-	buildViews(viewsItem, schema);
-	buildCatalogue(systemItem, schema);
+	if (fill)
+	{
+		fillDatabase(dbItem, schema);
+	}
+	else
+	{
+		// filled by catalogLoaded()
+		tablesItem->setText(0, trTables);
+		viewsItem->setText(0, trViews);
+		systemItem->setText(0, trSys);
+		addPlaceholder(tablesItem);
+		addPlaceholder(viewsItem);
+		addPlaceholder(systemItem);
+	}
 
 	dbItem->setExpanded(true);
+	return dbItem;
+}
+
+void TableTree::fillDatabase(QTreeWidgetItem * dbItem, const QString & schema)
+{
+	// the base for updateTree()
+	QString error;
+	const SchemaSnapshot * snapshot =
+		SchemaCatalog::instance()->snapshot(schema, &error);
+	if (snapshot)
+		m_shown.insert(schema, *snapshot);
+	else
+		m_shown.remove(schema);
+
+	for (int i = 0; i < dbItem->childCount(); ++i)
+	{
+		QTreeWidgetItem * item = dbItem->child(i);
+		switch (item->type())
+		{
+			case TablesItemType:
+				buildTables(item, schema);
+				break;
+			case ViewsItemType:
+				buildViews(item, schema);
+				break;
+			case SystemItemType:
+				buildCatalogue(item, schema);
+				break;
+		}
+	}
+}
+
+void TableTree::addPlaceholder(QTreeWidgetItem * item)
+{
+	QTreeWidgetItem * placeholder = new QTreeWidgetItem(item, PlaceholderType);
+	placeholder->setText(0, tr("Loading..."));
+	placeholder->setFlags(Qt::ItemIsEnabled);
+}
+
+bool TableTree::isPopulated(QTreeWidgetItem * item)
+{
+	return    (item->childCount() == 0)
+		   || (item->child(0)->type() != PlaceholderType);
+}
+
+void TableTree::ensurePopulated(QTreeWidgetItem * item)
+{
+	if (!item || isPopulated(item)) { return; }
+	switch (item->type())
+	{
+		case TableType:
+			deleteChildren(item);
+			buildTableItem(item, false);
+			break;
+		case ViewType:
+		{
+			deleteChildren(item);
+			QTreeWidgetItem *triggersItem = new QTreeWidgetItem(item, TriggersItemType);
+			buildTriggers(triggersItem, item->text(1), item->text(0));
+			break;
+		}
+		default:
+			// Tables, Views and System nodes wait for catalogLoaded()
+			break;
+	}
+}
+
+void TableTree::populateItem(QTreeWidgetItem * item)
+{
+	ensurePopulated(item);
 }
 
 void TableTree::buildTableItem(QTreeWidgetItem * tableItem, bool rebuild)
 {
-	if (rebuild) { deleteChildren(tableItem); }
+	if (rebuild)
+	{
+		// not expanded yet: it gets built from the new schema on expand
+		if (!isPopulated(tableItem)) { return; }
+		deleteChildren(tableItem);
+	}
 
 	QString schema = tableItem->text(1);
 	QString table = tableItem->text(0);
@@ -102,13 +279,16 @@ void TableTree::buildTables(QTreeWidgetItem * tablesItem, const QString & schema
 	tablesItem->setText(0, trLabel(trTables).arg(tables.size()));
 	tablesItem->setText(1, schema);
 
+	QList<QTreeWidgetItem *> items;
 	foreach(QString table, tables)
 	{
-		QTreeWidgetItem * tableItem = new QTreeWidgetItem(tablesItem, TableType);
+		QTreeWidgetItem * tableItem = new QTreeWidgetItem(TableType);
 		tableItem->setText(0, table);
 		tableItem->setText(1, schema);
-		buildTableItem(tableItem, false);
+		addPlaceholder(tableItem);
+		items.append(tableItem);
 	}
+	tablesItem->addChildren(items);
 }
 
 void TableTree::buildIndexes(QTreeWidgetItem *indexesItem, const QString & schema, const QString & table)
@@ -194,14 +374,16 @@ void TableTree::buildViews(QTreeWidgetItem * viewsItem, const QString & schema)
 	QStringList views = Database::getObjects("view", schema).keys();
 	viewsItem->setText(0, trLabel(trViews).arg(views.size()));
 	viewsItem->setText(1, schema);
+	QList<QTreeWidgetItem *> items;
 	foreach(QString view, views)
 	{
-		QTreeWidgetItem * viewItem = new QTreeWidgetItem(viewsItem, ViewType);
+		QTreeWidgetItem * viewItem = new QTreeWidgetItem(ViewType);
 		viewItem->setText(0, view);
 		viewItem->setText(1, schema);
-		QTreeWidgetItem *triggersItem = new QTreeWidgetItem(viewItem, TriggersItemType);
-		buildTriggers(triggersItem, schema, view);
+		addPlaceholder(viewItem);
+		items.append(viewItem);
 	}
+	viewsItem->addChildren(items);
 }
 
 void TableTree::buildCatalogue(QTreeWidgetItem * systemItem, const QString & schema)
@@ -220,6 +402,194 @@ void TableTree::buildCatalogue(QTreeWidgetItem * systemItem, const QString & sch
 }
 
 
+QTreeWidgetItem * TableTree::databaseItem(const QString & schema)
+{
+	for (int i = 0; i < topLevelItemCount(); ++i)
+	{
+		if (topLevelItem(i)->text(1) == schema)
+			return topLevelItem(i);
+	}
+	return 0;
+}
+
+QTreeWidgetItem * TableTree::childOfType(QTreeWidgetItem * parent, int type)
+{
+	for (int i = 0; i < parent->childCount(); ++i)
+	{
+		if (parent->child(i)->type() == type)
+			return parent->child(i);
+	}
+	return 0;
+}
+
+QTreeWidgetItem * TableTree::findChild(QTreeWidgetItem * parent,
+									   const QString & name)
+{
+	for (int i = 0; i < parent->childCount(); ++i)
+	{
+		if (parent->child(i)->text(0).compare(name, Qt::CaseInsensitive) == 0)
+			return parent->child(i);
+	}
+	return 0;
+}
+
+void TableTree::insertObject(QTreeWidgetItem * parent, int type,
+							 const QString & name, const QString & schema)
+{
+	// it may be there already if a dialog has rebuilt the node
+	if (findChild(parent, name)) { return; }
+	// keep the order of getObjects()
+	int i = 0;
+	while ((i < parent->childCount()) && (parent->child(i)->text(0) < name))
+		++i;
+	QTreeWidgetItem * item = new QTreeWidgetItem(type);
+	item->setText(0, name);
+	item->setText(1, schema);
+	addPlaceholder(item);
+	parent->insertChild(i, item);
+}
+
+void TableTree::rebuildObject(QTreeWidgetItem * item)
+{
+	if (!isPopulated(item)) { return; }
+	// remember which of the Columns, Indexes... nodes were open
+	QList<int> expanded;
+	for (int i = 0; i < item->childCount(); ++i)
+	{
+		if (item->child(i)->isExpanded())
+			expanded.append(item->child(i)->type());
+	}
+	if (item->type() == TableType)
+	{
+		buildTableItem(item, true);
+	}
+	else
+	{
+		QTreeWidgetItem * triggersItem = childOfType(item, TriggersItemType);
+		if (triggersItem)
+			buildTriggers(triggersItem, item->text(1), item->text(0));
+	}
+	for (int i = 0; i < item->childCount(); ++i)
+	{
+		if (expanded.contains(item->child(i)->type()))
+			item->child(i)->setExpanded(true);
+	}
+}
+
+void TableTree::updateTree()
+{
+	QStringList databases(Database::getDatabases().keys());
+	// detached
+	for (int i = topLevelItemCount() - 1; i >= 0; --i)
+	{
+		if (!databases.contains(topLevelItem(i)->text(1)))
+		{
+			m_shown.remove(topLevelItem(i)->text(1));
+			delete takeTopLevelItem(i);
+		}
+	}
+	foreach (QString schema, databases)
+	{
+		QTreeWidgetItem * dbItem = databaseItem(schema);
+		if (dbItem)
+			updateDatabase(dbItem, schema);
+		else
+			addDatabaseItem(schema, true); // attached
+	}
+}
+
+void TableTree::updateDatabase(QTreeWidgetItem * dbItem, const QString & schema)
+{
+	// not filled yet, catalogLoaded() will do it
+	QHash<QString,SchemaSnapshot>::const_iterator shown = m_shown.find(schema);
+	if (shown == m_shown.end()) { return; }
+
+	QString error;
+	const SchemaSnapshot * snapshot =
+		SchemaCatalog::instance()->snapshot(schema, &error);
+	if (!snapshot) { return; }
+	// a copy: rebuilding nodes below may refresh the catalog
+	const SchemaSnapshot now(*snapshot);
+	const SchemaSnapshot * current = &now;
+	if (   (current->version == shown->version)
+		&& (current->fileName == shown->fileName)
+		&& (current->generation == shown->generation))
+	{
+		return;
+	}
+
+	QTreeWidgetItem * tablesItem = childOfType(dbItem, TablesItemType);
+	QTreeWidgetItem * viewsItem = childOfType(dbItem, ViewsItemType);
+	QTreeWidgetItem * systemItem = childOfType(dbItem, SystemItemType);
+	if (!tablesItem || !viewsItem || !systemItem) { return; }
+
+	// objects which were removed, added or have a different CREATE
+	QList<SchemaObject> removed;
+	QList<SchemaObject> added;
+	QList<SchemaObject> changed;
+	foreach (SchemaObject o, shown->objects)
+	{
+		int i = current->byName.value(o.name.toLower(), -1);
+		if ((i < 0) || (current->objects.at(i).type != o.type))
+			removed.append(o);
+	}
+	foreach (SchemaObject o, current->objects)
+	{
+		int i = shown->byName.value(o.name.toLower(), -1);
+		if ((i < 0) || (shown->objects.at(i).type != o.type))
+			added.append(o);
+		else if (   (shown->objects.at(i).sql != o.sql)
+				 || (shown->objects.at(i).name != o.name))
+			changed.append(o);
+	}
+
+	QStringList dirty; // tables and views with changed children
+	bool sysChanged = false;
+	QList<SchemaObject> all(removed + added + changed);
+	for (int n = 0; n < all.count(); ++n)
+	{
+		const SchemaObject & o = all.at(n);
+		bool isRemoved = n < removed.count();
+		bool isAdded = !isRemoved && (n < removed.count() + added.count());
+		bool system = (o.name.length() > 6)
+					  && o.name.startsWith("sqlite", Qt::CaseInsensitive);
+		if ((o.type == "table") && system)
+		{
+			sysChanged = true;
+		}
+		else if ((o.type == "table") || (o.type == "view"))
+		{
+			QTreeWidgetItem * parent =
+				(o.type == "table") ? tablesItem : viewsItem;
+			if (isRemoved)
+				delete findChild(parent, o.name);
+			else if (isAdded)
+				insertObject(parent, (o.type == "table") ? TableType : ViewType,
+							 o.name, schema);
+			else if (o.type == "table")
+				dirty.append(o.name); // columns may have changed
+		}
+		else if (!dirty.contains(o.tblName, Qt::CaseInsensitive))
+		{
+			// index or trigger
+			dirty.append(o.tblName);
+		}
+	}
+
+	foreach (QString name, dirty)
+	{
+		QTreeWidgetItem * item = findChild(tablesItem, name);
+		if (!item) { item = findChild(viewsItem, name); }
+		if (item) { rebuildObject(item); }
+	}
+	if (sysChanged)
+		buildCatalogue(systemItem, schema);
+	tablesItem->setText(0, trLabel(trTables).arg(tablesItem->childCount()));
+	viewsItem->setText(0, trLabel(trViews).arg(viewsItem->childCount()));
+
+	m_shown.insert(schema, now);
+}
+
 void TableTree::deleteChildren(QTreeWidgetItem * item)
 {
 	QList<QTreeWidgetItem *> items = item->takeChildren();
@@ -10,9 +10,16 @@ for which a new license (GPL+exception) is in place.
 
 #include <QTreeWidget>
 
+#include "schemacatalog.h"
 
 /*! \brief Schema browser.
 A tree structure containing sorted database objects.
+Table and view nodes are built with a placeholder child and filled
+when they are expanded first (see ensurePopulated()). buildTree() reads
+the object lists of the database files in the background, so the
+top level of the tree appears at once even for huge schemas.
+After DDL, updateTree() compares the sqlite_master shown with the
+current one and touches only the nodes of the objects which changed.
 \author Petr Vanek <petr@scribus.info>
 */
 class TableTree : public QTreeWidget
@@ -34,9 +41,10 @@ class TableTree : public QTreeWidget
 		static const int SysIndexType = QTreeWidgetItem::UserType + 12;
 		static const int ColumnType = QTreeWidgetItem::UserType + 13;
 		static const int ColumnItemType = QTreeWidgetItem::UserType + 14;
+		static const int PlaceholderType = QTreeWidgetItem::UserType + 15;
 
 		TableTree(QWidget * parent = 0);
-		~TableTree(){};
+		~TableTree();
 
 		void buildDatabase(QTreeWidgetItem * dbItem, const QString & schema);
 		void buildDatabase(const QString & schema);
@@ -60,15 +68,45 @@ class TableTree : public QTreeWidget
 
 		QList<QTreeWidgetItem*> searchMask(const QString & trStr);
 
+		/*! \brief Build the children of a table or view node now.
+		Call it before looking at the children of a node which may not
+		have been expanded yet.
+		*/
+		void ensurePopulated(QTreeWidgetItem * item);
+
 	public slots:
 		void buildTree();
+		/*! \brief Apply schema changes to the tree.
+		Unchanged nodes, including their expansion state, are kept.
+		*/
+		void updateTree();
 		void buildViewTree(QString schema, QString name);
 
+	private slots:
+		void populateItem(QTreeWidgetItem * item);
+		void catalogLoaded();
+
 	private:
 		void deleteChildren(QTreeWidgetItem * item);
 		QString trLabel(const QString & trStr);
+		QTreeWidgetItem * addDatabaseItem(const QString & schema, bool fill);
+		void fillDatabase(QTreeWidgetItem * dbItem, const QString & schema);
+		void addPlaceholder(QTreeWidgetItem * item);
+		bool isPopulated(QTreeWidgetItem * item);
+		QTreeWidgetItem * databaseItem(const QString & schema);
+		QTreeWidgetItem * childOfType(QTreeWidgetItem * parent, int type);
+		QTreeWidgetItem * findChild(QTreeWidgetItem * parent,
+									const QString & name);
+		void insertObject(QTreeWidgetItem * parent, int type,
+						  const QString & name, const QString & schema);
+		void rebuildObject(QTreeWidgetItem * item);
+		void updateDatabase(QTreeWidgetItem * dbItem, const QString & schema);
 
 		QPoint m_dragStartPosition;
+		//! \brief background read of the catalog for buildTree()
+		SchemaCatalogLoader * m_loader;
+		//! \brief sqlite_master as shown in the tree, by schema
+		QHash<QString,SchemaSnapshot> m_shown;
 
 		void mousePressEvent(QMouseEvent *event);
 		void mouseMoveEvent(QMouseEvent *event);
@@ -61,6 +61,11 @@ QString startswith(QString s);
 
 void setColumnWidths(QTableView * tv);
 
+/*! \brief Format a size in bytes to the human readable form.
+It's taken from FatRat http://fatrat.dolezel.info/. Cheers!
+*/
+QString formatSize(qulonglong size/*, bool persec*/);
+
 //debugging hacks
 void dump(QString s);
 void dump(QModelIndex x);
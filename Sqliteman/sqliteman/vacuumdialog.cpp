@@ -6,10 +6,12 @@ for which a new license (GPL+exception) is in place.
 */
 
 #include <QSettings>
+#include <QSqlQuery>
 
 #include "vacuumdialog.h"
 #include "database.h"
 #include "utils.h"
+#include "vacuumrunner.h"
 
 VacuumDialog::VacuumDialog(LiteManWindow * parent)
 	: QDialog(parent)
@@ -20,12 +22,27 @@ VacuumDialog::VacuumDialog(LiteManWindow * parent)
 	int hh = settings.value("vacuum/height", QVariant(500)).toInt();
 	int ww = settings.value("vacuum/width", QVariant(600)).toInt();
 	resize(ww, hh);
+	ui.sliceSpinBox->setValue(settings.value("vacuum/slice", 200).toInt());
+	ui.pauseSpinBox->setValue(settings.value("vacuum/pause", 1000).toInt());
 
-	ui.tableList->addItems(Database::getObjects("table").values());
-	ui.tableList->addItems(Database::getObjects("index").values());
+	ui.schemaTree->setHeaderLabels(QStringList() << tr("Database")
+		<< tr("Size") << tr("Free Pages") << tr("Reclaimable")
+		<< tr("Auto Vacuum"));
+	refresh();
+	QList<QTreeWidgetItem *> main(
+		ui.schemaTree->findItems("main", Qt::MatchExactly));
+	if (!main.isEmpty())
+		main.at(0)->setSelected(true);
+	updateForecast();
 
-	connect(ui.allButton, SIGNAL(clicked()), this, SLOT(allButton_clicked()));
-	connect(ui.tableButton, SIGNAL(clicked()), this, SLOT(tableButton_clicked()));
+	connect(ui.schemaTree, SIGNAL(itemSelectionChanged()),
+			this, SLOT(updateForecast()));
+	connect(ui.measureButton, SIGNAL(clicked()),
+			this, SLOT(measureButton_clicked()));
+	connect(ui.vacuumButton, SIGNAL(clicked()),
+			this, SLOT(vacuumButton_clicked()));
+	connect(ui.incrementalButton, SIGNAL(clicked()),
+			this, SLOT(incrementalButton_clicked()));
 }
 
 VacuumDialog::~VacuumDialog()
@@ -33,27 +50,202 @@ VacuumDialog::~VacuumDialog()
 	QSettings settings("yarpen.cz", "sqliteman");
     settings.setValue("vacuum/height", QVariant(height()));
     settings.setValue("vacuum/width", QVariant(width()));
+	settings.setValue("vacuum/slice", ui.sliceSpinBox->value());
+	settings.setValue("vacuum/pause", ui.pauseSpinBox->value());
 }
 
-void VacuumDialog::allButton_clicked()
+void VacuumDialog::refresh()
 {
-	if (creator && creator->checkForPending())
+	QStringList selected(selectedSchemas());
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+	QStringList modes(QStringList() << tr("None") << tr("Full")
+									<< tr("Incremental"));
+
+	ui.schemaTree->clear();
+	m_spaces.clear();
+	foreach (QString schema, Database::getDatabases().keys())
 	{
-		Database::execSql("vacuum;");
+		Space space;
+		qint64 * values[] = { &space.pageSize, &space.pages,
+							  &space.freePages };
+		const char * pragmas[] = { "page_size", "page_count",
+								   "freelist_count" };
+		for (int i = 0; i < 3; ++i)
+		{
+			QSqlQuery query(QString("PRAGMA %1.%2;")
+							.arg(Utils::q(schema), pragmas[i]), db);
+			*values[i] = query.next() ? query.value(0).toLongLong() : 0;
+		}
+		QSqlQuery query(QString("PRAGMA %1.auto_vacuum;")
+						.arg(Utils::q(schema)), db);
+		space.autoVacuum = query.next() ? query.value(0).toInt() : 0;
+		m_spaces.insert(schema, space);
+
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.schemaTree);
+		item->setText(0, schema);
+		item->setText(1, Utils::formatSize(space.pages * space.pageSize));
+		item->setText(2, QString::number(space.freePages));
+		QString reclaim(Utils::formatSize(reclaimable(schema)));
+		if (!m_unused.contains(schema))
+			reclaim += " + ?";
+		item->setText(3, reclaim);
+		item->setText(4, modes.value(space.autoVacuum));
+		for (int i = 1; i < 4; ++i)
+			item->setTextAlignment(i, Qt::AlignRight | Qt::AlignVCenter);
+		item->setSelected(selected.contains(schema));
 	}
+	for (int i = 0; i < ui.schemaTree->columnCount(); ++i)
+		ui.schemaTree->resizeColumnToContents(i);
+}
+
+QStringList VacuumDialog::selectedSchemas()
+{
+	QStringList schemas;
+	foreach (QTreeWidgetItem * item, ui.schemaTree->selectedItems())
+		schemas.append(item->text(0));
+	return schemas;
+}
+
+qint64 VacuumDialog::reclaimable(const QString & schema)
+{
+	Space space(m_spaces.value(schema));
+	// VACUUM packs the pages again, so the space unused inside them
+	// comes back too
+	return   space.freePages * space.pageSize
+		   + qMax(m_unused.value(schema, 0), (qint64)0);
 }
 
-void VacuumDialog::tableButton_clicked()
+void VacuumDialog::updateForecast()
 {
-	QList<QListWidgetItem *> list(ui.tableList->selectedItems());
-	if (creator && creator->checkForPending())
+	QStringList schemas(selectedSchemas());
+	qint64 vacuum = 0;
+	qint64 incremental = 0;
+	bool unmeasured = false;
+	bool noDbstat = false;
+	bool allIncremental = !schemas.isEmpty();
+	foreach (QString schema, schemas)
 	{
-		for (int i = 0; i < list.size(); ++i)
-		{
-			if (!Database::execSql(QString("vacuum %1;")
-					.arg(Utils::q(list.at(i)->text()))))
-				break;
-		}
+		Space space(m_spaces.value(schema));
+		vacuum += reclaimable(schema);
+		unmeasured = unmeasured || !m_unused.contains(schema);
+		noDbstat = noDbstat || (m_unused.value(schema, 0) < 0);
+		if (space.autoVacuum == 2)
+			incremental += space.freePages * space.pageSize;
+		else
+			allIncremental = false;
+	}
+
+	QString text;
+	if (!schemas.isEmpty())
+	{
+		text = tr("VACUUM would give back about %1.")
+			   .arg(Utils::formatSize(vacuum));
+		if (unmeasured)
+			text += " " + tr("Use Measure to count the space unused inside "
+							 "the pages too.");
+		if (noDbstat)
+			text += " " + tr("The sqlite library has no dbstat table, so "
+							 "only the free pages are counted.");
+		if (incremental > 0)
+			text += " " + tr("Incremental vacuum can give back %1.")
+						  .arg(Utils::formatSize(incremental));
 	}
+	ui.forecastLabel->setText(text);
+	ui.measureButton->setEnabled(!schemas.isEmpty());
+	ui.vacuumButton->setEnabled(!schemas.isEmpty());
+	ui.incrementalButton->setEnabled(allIncremental && (incremental > 0));
 }
 
+bool VacuumDialog::runWorker(VacuumRunner & runner, const QString & label)
+{
+	ui.resultLabel->clear();
+	runner.runWithProgress(label, this);
+	if (runner.errorMessage().isEmpty())
+		return true;
+
+	QString schema(runner.failedSchema());
+	ui.resultLabel->setText((schema.isEmpty() ? tr("Stopped")
+								: tr("Failed on %1").arg(schema))
+		+ ":<br/><span style=\" color:#ff0000;\">"
+		+ runner.errorMessage() + "<br/></span>");
+	return false;
+}
+
+void VacuumDialog::measureButton_clicked()
+{
+	VacuumRunner runner(Database::sqlite3handle(), VacuumRunner::Measure, this);
+	foreach (QString schema, selectedSchemas())
+	{
+		Space space(m_spaces.value(schema));
+		runner.addSchema(schema, space.pages - space.freePages);
+	}
+	runWorker(runner, tr("Measuring unused space"));
+	QMap<QString,qint64> unused(runner.unused());
+	QMap<QString,qint64>::const_iterator it;
+	for (it = unused.constBegin(); it != unused.constEnd(); ++it)
+		m_unused.insert(it.key(), it.value());
+	refresh();
+	updateForecast();
+}
+
+void VacuumDialog::vacuumButton_clicked()
+{
+	if (!creator || !creator->checkForPending())
+		return;
+
+	QStringList schemas(selectedSchemas());
+	VacuumRunner runner(Database::sqlite3handle(), VacuumRunner::Vacuum, this);
+	foreach (QString schema, schemas)
+	{
+		Space space(m_spaces.value(schema));
+		runner.addSchema(schema, space.pages - space.freePages);
+	}
+	QMap<QString,Space> before(m_spaces);
+	bool ok = runWorker(runner, tr("Vacuuming"));
+	foreach (QString schema, schemas)
+		m_unused.remove(schema);
+	refresh();
+	updateForecast();
+	if (!ok)
+		return;
+
+	QStringList lines;
+	foreach (QString schema, schemas)
+	{
+		Space was(before.value(schema));
+		Space is(m_spaces.value(schema));
+		lines.append(tr("%1: %2 before, %3 now")
+					 .arg(schema, Utils::formatSize(was.pages * was.pageSize),
+						  Utils::formatSize(is.pages * is.pageSize)));
+	}
+	ui.resultLabel->setText(lines.join("<br/>"));
+}
+
+void VacuumDialog::incrementalButton_clicked()
+{
+	if (!creator || !creator->checkForPending())
+		return;
+
+	VacuumRunner runner(Database::sqlite3handle(),
+						VacuumRunner::Incremental, this);
+	runner.setSlices(ui.sliceSpinBox->value(), ui.pauseSpinBox->value());
+	foreach (QString schema, selectedSchemas())
+		runner.addSchema(schema, m_spaces.value(schema).freePages);
+	bool ok = runWorker(runner, tr("Reclaiming free pages"));
+
+	// a cancel keeps the slices done so far
+	QStringList lines;
+	QMap<QString,qint64> reclaimed(runner.reclaimed());
+	QMap<QString,qint64>::const_iterator it;
+	for (it = reclaimed.constBegin(); it != reclaimed.constEnd(); ++it)
+	{
+		lines.append(tr("%1: %2 pages given back")
+					 .arg(it.key()).arg(it.value()));
+	}
+	refresh();
+	updateForecast();
+	if (ok)
+		ui.resultLabel->setText(lines.join("<br/>"));
+	else if (!lines.isEmpty())
+		ui.resultLabel->setText(ui.resultLabel->text() + lines.join("<br/>"));
+}
@@ -13,8 +13,13 @@ for which a new license (GPL+exception) is in place.
 #include "litemanwindow.h"
 #include "ui_vacuumdialog.h"
 
+class VacuumRunner;
+
 /*! \brief Handle DB file (un)used space.
 Sqlite3 offers VACUUM option for its internal data structures.
+The dialog lists the attached databases with the space a VACUUM would
+give back: the free pages, plus the bytes unused inside the pages once
+they have been measured. The work runs in a VacuumRunner.
 \author Petr Vanek <petr@scribus.info>
  */
 class VacuumDialog : public QDialog
@@ -26,15 +31,38 @@ class VacuumDialog : public QDialog
 		~VacuumDialog();
 
 	private:
+		typedef struct
+		{
+			qint64 pageSize;
+			qint64 pages;
+			qint64 freePages;
+			//! \brief 0 none, 1 full, 2 incremental
+			int autoVacuum;
+		} Space;
+
 		Ui::VacuumDialog ui;
+		QMap<QString,Space> m_spaces;
+		//! \brief measured by VacuumRunner::Measure, see VacuumRunner::unused()
+		QMap<QString,qint64> m_unused;
 
 		// We ought to be able use use parent() for this, but for some reason
 		// qobject_cast<LiteManWindow*>(parent()) doesn't work
 		LiteManWindow * creator;
 
+		//! \brief Read the page counts of all databases again.
+		void refresh();
+		QStringList selectedSchemas();
+		//! \brief Bytes a VACUUM of schema is expected to give back.
+		qint64 reclaimable(const QString & schema);
+		//! \brief Run the worker, show an error in resultLabel.
+		bool runWorker(VacuumRunner & runner, const QString & label);
+
     private slots:
-		void allButton_clicked();
-		void tableButton_clicked();
+		void measureButton_clicked();
+		void vacuumButton_clicked();
+		void incrementalButton_clicked();
+		//! \brief Forecast for the selection and button states.
+		void updateForecast();
 };
 
 #endif
@@ -0,0 +1,172 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include "vacuumrunner.h"
+#include "utils.h"
+
+// pages of the first incremental_vacuum slice, the next ones are sized
+// by the time it took
+#define FIRST_SLICE_PAGES 64
+// a slice grows at most this many times from one to the next
+#define SLICE_GROWTH 4
+
+
+VacuumRunner::VacuumRunner(sqlite3 * handle, Mode mode, QObject * parent)
+	: DatabaseWorker(handle, parent),
+	  m_mode(mode),
+	  m_total(0),
+	  m_done(0),
+	  m_current(0),
+	  m_startPages(0),
+	  m_slice(200),
+	  m_pause(1000)
+{
+}
+
+void VacuumRunner::addSchema(const QString & schema, qint64 pages)
+{
+	useOwnConnection(schema, m_mode != Measure);
+	m_schemas.append(schema);
+	m_pages.append(pages);
+	m_total += pages;
+}
+
+void VacuumRunner::setSlices(int slice, int pause)
+{
+	m_slice = qMax(slice, 1);
+	m_pause = qMax(pause, 0);
+}
+
+qint64 VacuumRunner::value(const QString & sql, bool * ok)
+{
+	qint64 result = 0;
+	QByteArray utf(sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(m_handle, utf.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		rc = sqlite3_step(stmt);
+		if (rc == SQLITE_ROW)
+		{
+			result = sqlite3_column_int64(stmt, 0);
+			rc = SQLITE_OK;
+		}
+		else if (rc == SQLITE_DONE)
+			rc = SQLITE_OK;
+	}
+	if (rc != SQLITE_OK)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	if (ok)
+		*ok = (rc == SQLITE_OK);
+	return result;
+}
+
+int VacuumRunner::progressHandler(void * worker)
+{
+	VacuumRunner * self = (VacuumRunner *)worker;
+	qint64 done = self->pagesRead() - self->m_startPages;
+	self->reportProgress(self->m_done + qMin(done, self->m_current),
+						 self->m_total);
+	return self->isCancelled() ? 1 : 0;
+}
+
+bool VacuumRunner::measure(const QString & schema)
+{
+	QByteArray sql(QString("SELECT sum(unused) FROM dbstat(%1);")
+				   .arg(Utils::q(schema, "'")).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(m_handle, sql.constData(), -1, &stmt, 0)
+		!= SQLITE_OK)
+	{
+		// the library was built without SQLITE_ENABLE_DBSTAT_VTAB
+		sqlite3_finalize(stmt);
+		m_unused[schema] = -1;
+		return true;
+	}
+	int rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+		m_unused[schema] = sqlite3_column_int64(stmt, 0);
+	else
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_handle));
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_ROW;
+}
+
+bool VacuumRunner::incremental(const QString & schema)
+{
+	QString count(QString("PRAGMA %1.freelist_count;").arg(Utils::q(schema)));
+	bool ok;
+	qint64 start = value(count, &ok);
+	qint64 left = start;
+	qint64 pages = FIRST_SLICE_PAGES;
+	QElapsedTimer timer;
+	while (ok && (left > 0) && !isCancelled())
+	{
+		reportProgress(m_done + qMin(start - left, m_current), m_total);
+		emit label(tr("Reclaiming free pages of %1: %2 left")
+				   .arg(schema).arg(left));
+		timer.start();
+		if (!exec(QString("PRAGMA %1.incremental_vacuum(%2);")
+				  .arg(Utils::q(schema)).arg(pages)))
+		{
+			ok = false;
+			break;
+		}
+		// size the next slice to take about m_slice milliseconds
+		qint64 ms = qMax(timer.elapsed(), (qint64)1);
+		pages = qBound((qint64)1, pages * m_slice / ms, pages * SLICE_GROWTH);
+		left = value(count, &ok);
+		if (ok && (left > 0) && (m_pause > 0) && !isCancelled())
+			msleep(m_pause);
+	}
+	m_reclaimed[schema] = start - left;
+	return ok;
+}
+
+void VacuumRunner::run()
+{
+	if (!m_handle)
+	{
+		m_error = tr("No database is open");
+		return;
+	}
+	if (m_mode != Incremental)
+		sqlite3_progress_handler(m_handle, ProgressOps, progressHandler, this);
+
+	for (int i = 0; (i < m_schemas.count()) && !isCancelled(); ++i)
+	{
+		QString schema(m_schemas.at(i));
+		m_current = m_pages.at(i);
+		m_startPages = pagesRead();
+		bool ok = true;
+		switch (m_mode)
+		{
+			case Measure:
+				emit label(tr("Measuring %1").arg(schema));
+				ok = measure(schema);
+				break;
+			case Vacuum:
+				emit label(tr("Vacuuming %1").arg(schema));
+				ok = exec(QString("VACUUM %1;").arg(Utils::q(schema)));
+				break;
+			case Incremental:
+				ok = incremental(schema);
+				break;
+		}
+		if (!ok)
+		{
+			m_failedSchema = schema;
+			break;
+		}
+		m_done += m_current;
+	}
+	if (isCancelled())
+		m_error = tr("Cancelled");
+
+	sqlite3_progress_handler(m_handle, 0, NULL, NULL);
+}
@@ -0,0 +1,94 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef VACUUMRUNNER_H
+#define VACUUMRUNNER_H
+
+#include <QMap>
+#include <QStringList>
+
+#include "databaseworker.h"
+
+
+/*! \brief The work of VacuumDialog, on the worker thread.
+Measure sums the unused bytes inside the used pages with the dbstat
+virtual table, which VACUUM would get back on top of the free pages.
+Vacuum rebuilds the files. Both read every page, so their progress is
+the number of pages the connection has fetched
+(DatabaseWorker::pagesRead()) against the used pages of the schemas.
+Incremental runs PRAGMA incremental_vacuum in slices of about the given
+time with pauses in between. Each slice is a transaction of its own, so
+other connections get the database between the slices and a cancel
+keeps what has been reclaimed so far.
+Measure reads on a connection of its own, the others write on one in WAL
+mode (DatabaseWorker::useOwnConnection()); otherwise they use the main
+connection, so the temp schema and in-memory databases can be vacuumed
+too.
+*/
+class VacuumRunner : public DatabaseWorker
+{
+		Q_OBJECT
+
+	public:
+		typedef enum
+		{
+			Measure,
+			Vacuum,
+			Incremental
+		} Mode;
+
+		VacuumRunner(sqlite3 * handle, Mode mode, QObject * parent = 0);
+
+		/*! \brief Add a schema to work on.
+		\param pages its weight in the progress: the used pages, or the
+		free pages for Incremental
+		*/
+		void addSchema(const QString & schema, qint64 pages);
+		/*! \brief Pace of Incremental.
+		\param slice milliseconds one incremental_vacuum should take
+		\param pause milliseconds to wait between two slices
+		*/
+		void setSlices(int slice, int pause);
+
+		/*! \brief Unused bytes inside the used pages, by schema.
+		-1 when dbstat is not compiled into the sqlite library.
+		*/
+		const QMap<QString,qint64> & unused() { return m_unused; }
+		//! \brief Pages returned by Incremental, by schema.
+		const QMap<QString,qint64> & reclaimed() { return m_reclaimed; }
+		//! \brief The schema the error occurred in.
+		QString failedSchema() { return m_failedSchema; }
+
+	protected:
+		void run();
+
+	private:
+		Mode m_mode;
+		QStringList m_schemas;
+		QList<qint64> m_pages;
+		qint64 m_total;
+		//! \brief weight of the schemas already done
+		qint64 m_done;
+		//! \brief weight of the current schema
+		qint64 m_current;
+		int m_startPages;
+		int m_slice;
+		int m_pause;
+		QMap<QString,qint64> m_unused;
+		QMap<QString,qint64> m_reclaimed;
+		QString m_failedSchema;
+
+		bool measure(const QString & schema);
+		bool incremental(const QString & schema);
+		/*! \brief First column of the first row of sql.
+		\param ok set to false when the statement fails
+		*/
+		qint64 value(const QString & sql, bool * ok = 0);
+		static int progressHandler(void * worker);
+};
+
+#endif